@@ -0,0 +1,62 @@
+/*
+The results of the calculations of the place, grasp and push actions
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_ACTION_STATUS_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_ACTION_STATUS_HEADER
+
+#include <array>
+
+// The calculators return the reason of the failure instead of throwing
+// std::runtime_error, so that the particles for which the action fails are
+// rejected without unwinding the stack. 'number_of_action_statuses' is the
+// number of the statuses, not a status.
+enum action_status {
+  success_status,
+  invalid_gripper_transform_status,
+  balanced_at_first_rotation_status,
+  balanced_at_second_rotation_status,
+  vertex_not_found_status,
+  center_of_gravity_outside_status,
+  gripper_does_not_reach_status,
+  cannot_be_grasped_status,
+  cannot_be_pushed_status,
+  unstable_after_placing_status,
+  unstable_after_gripping_status,
+  number_of_action_statuses
+};
+
+// The number of the calculations which end with each status
+using ActionStatusCounts = std::array<int, number_of_action_statuses>;
+
+// The message of the exception thrown for the status, which is a string
+// literal
+inline const char *action_status_message(const action_status &status) {
+  switch (status) {
+  case success_status:
+    return "Success";
+  case invalid_gripper_transform_status:
+    return "Invalid gripper transform";
+  case balanced_at_first_rotation_status:
+    return "Balanced at the first rotation";
+  case balanced_at_second_rotation_status:
+    return "Balanced at the second rotation";
+  case vertex_not_found_status:
+    return "The vertex of the hull is not found";
+  case center_of_gravity_outside_status:
+    return "center of gravity is out of the convex hull";
+  case gripper_does_not_reach_status:
+    return "gripper does not reach the object";
+  case cannot_be_grasped_status:
+    return "The object cannot be grasped";
+  case cannot_be_pushed_status:
+    return "The object cannot be pushed";
+  case unstable_after_placing_status:
+    return "Unstable after placing";
+  case unstable_after_gripping_status:
+    return "Unstable after gripping";
+  default:
+    return "Unknown status";
+  }
+}
+
+#endif
@@ -0,0 +1,67 @@
+/*
+Buffers reused by the per-particle calculations of the actions
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_ACTION_WORKSPACE_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_ACTION_WORKSPACE_HEADER
+
+#include "o2ac_pose_distribution_updater/base/action_status.hpp"
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <boost/array.hpp>
+#include <vector>
+
+struct ActionWorkspace {
+  // The helpers of the actions clear or resize these vectors before use, so
+  // their capacities grow to the size of the object once and are kept. Each
+  // worker thread of the estimator has its own workspace, so the particles
+  // are evaluated without heap allocations after the first step. The helpers
+  // create a temporary workspace when none is given.
+
+  // vertices of the object at the current pose and during the action
+  std::vector<Eigen::Vector3d> current_vertices, current_all_vertices,
+      rotated_vertices, final_vertices, final_all_vertices;
+  // values per vertex, such as the rotation angles to touch the ground
+  std::vector<double> vertex_values;
+  // points projected to a plane and their convex hulls
+  std::vector<Eigen::Vector2d> projected_points, hull, points_on_ground,
+      points_on_left_gripper, points_on_right_gripper, left_hull, right_hull;
+
+  // The vertices of the object truncated by the planes of the gripper
+  std::vector<Eigen::Vector3d> cut_vertices;
+  // used by clipping_object: the signed distances of each vertex to the planes
+  std::vector<Eigen::Vector3d> plane_distances;
+
+  // The number of the particles evaluated by this worker in the current step
+  // with each status, summed up by the estimator after the step
+  ActionStatusCounts status_counts = ActionStatusCounts();
+
+  // Reserve the buffers for an object with 'number_of_vertices' vertices,
+  // whose truncation by the gripper has at most 'number_of_clipped_vertices'
+  // vertices. The sizes of the points on the ground, on the grippers or of
+  // the truncated object depend on the pose, so a worker which evaluates
+  // other particles in a later step would grow them then without this. The
+  // grasp and push calculators work on the truncated object, so the buffers
+  // of the current, rotated and final vertices and of their projections
+  // hold as many points as it.
+  void reserve(const int &number_of_vertices,
+               const int &number_of_clipped_vertices = 0) {
+    int number_of_points = std::max(number_of_vertices,
+                                    number_of_clipped_vertices);
+    for (auto *buffer : {&current_vertices, &rotated_vertices,
+                         &final_vertices, &cut_vertices}) {
+      buffer->reserve(number_of_points);
+    }
+    for (auto *buffer :
+         {&current_all_vertices, &final_all_vertices, &plane_distances}) {
+      buffer->reserve(number_of_vertices);
+    }
+    vertex_values.reserve(number_of_points);
+    for (auto *buffer : {&projected_points, &hull, &points_on_left_gripper,
+                         &points_on_right_gripper, &left_hull, &right_hull}) {
+      buffer->reserve(number_of_points);
+    }
+    points_on_ground.reserve(number_of_vertices);
+  }
+};
+
+#endif
@@ -0,0 +1,286 @@
+/*
+The exponential map and the logarithm of SE(3) applied to many particles at once
+
+The particles are processed in groups of SE3_BATCH_SIZE. Each coordinate of a
+group, e.g. the x coordinates of the rotation vectors, is loaded into an
+Eigen::Array of that size and the closed forms of
+operators_for_Lie_distribution.hpp are evaluated on the whole array, so Eigen
+computes SE3_BATCH_SIZE particles per instruction stream with the SIMD
+instructions it is compiled for (SSE2 or AVX/AVX2 on x86 depending on the
+-march flags, NEON on ARM, or scalar code otherwise). The last group is padded
+by the identity, so every particle goes through the same arithmetic whatever
+its position is.
+
+The exponential is calculated in the scalar of the poses of the particle set,
+so a group has 16 particles if they are float. The logarithm, whose results
+are accumulated to the distributions, is always calculated in double.
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_BATCH_OPERATORS_FOR_LIE_DISTRIBUTION_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_BATCH_OPERATORS_FOR_LIE_DISTRIBUTION_HEADER
+
+#include "o2ac_pose_distribution_updater/base/operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/particle_set.hpp"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+// The lanes of a group fill 64 bytes, i.e. 8 doubles or 16 floats, which are
+// one AVX-512 register or two AVX registers
+template <typename Scalar> struct SE3Batch {
+  static const int size = 64 / sizeof(Scalar);
+  using Lanes = Eigen::Array<Scalar, size, 1>;
+  using LaneMask = Eigen::Array<bool, size, 1>;
+};
+
+const int SE3_BATCH_SIZE = SE3Batch<double>::size;
+using SE3Lanes = SE3Batch<double>::Lanes;
+using SE3LaneMask = SE3Batch<double>::LaneMask;
+
+// SE3_Taylor_series on each lane
+template <typename Lanes>
+inline Lanes SE3_batch_Taylor_series(const Lanes &x, const int &offset) {
+  using Scalar = typename Lanes::Scalar;
+  Lanes sum = Lanes::Zero();
+  for (int k = 5; k >= 0; k--) {
+    sum = Scalar(1.0 / SE3_factorial(2 * k + offset)) - x * sum;
+  }
+  return sum;
+}
+
+// SO3_exp_coefficients on each lane
+template <typename Lanes>
+inline void SE3_batch_exp_coefficients(const Lanes &theta_squared, Lanes &a,
+                                       Lanes &b, Lanes &c) {
+  using Scalar = typename Lanes::Scalar;
+  Eigen::Array<bool, Lanes::RowsAtCompileTime, 1> small =
+      theta_squared < Scalar(SE3_TAYLOR_THRESHOLD);
+  // The closed forms are evaluated on all lanes, with the angle 1 on the lanes
+  // of small angles to avoid the division by zero
+  Lanes safe_theta_squared = small.select(Lanes::Ones(), theta_squared);
+  Lanes theta = safe_theta_squared.sqrt();
+  Lanes sin_theta = theta.sin(), cos_theta = theta.cos();
+  a = small.select(SE3_batch_Taylor_series(theta_squared, 1),
+                   sin_theta / theta);
+  b = small.select(SE3_batch_Taylor_series(theta_squared, 2),
+                   (Scalar(1.0) - cos_theta) / safe_theta_squared);
+  c = small.select(SE3_batch_Taylor_series(theta_squared, 3),
+                   (theta - sin_theta) / (safe_theta_squared * theta));
+}
+
+// m = I + p * W + q * W^2 for W = hat(omega) on each lane, using
+// W^2 = omega * omega^T - theta^2 * I
+template <typename Lanes>
+inline void SE3_batch_polynomial_of_hat(const Lanes omega[3],
+                                        const Lanes &theta_squared,
+                                        const Lanes &p, const Lanes &q,
+                                        Lanes m[3][3]) {
+  using Scalar = typename Lanes::Scalar;
+  for (int i = 0; i < 3; i++) {
+    m[i][i] = Scalar(1.0) + q * (omega[i] * omega[i] - theta_squared);
+    int j = (i + 1) % 3, k = (i + 2) % 3;
+    // W(i, j) = -omega(k) and W(j, i) = omega(k)
+    Lanes symmetric = q * omega[i] * omega[j], skew = p * omega[k];
+    m[i][j] = symmetric - skew;
+    m[j][i] = symmetric + skew;
+  }
+}
+
+// Coefficients of the Taylor series of arcsin(y) / y in y^2, which are
+// (2k)! / (4^k (k!)^2 (2k + 1)) as in se3_log
+inline const std::array<double, 16> &SE3_arcsin_coefficients() {
+  static const std::array<double, 16> coefficients = [] {
+    std::array<double, 16> c;
+    c[0] = 1.0;
+    for (int k = 1; k < 16; k++) {
+      c[k] = c[k - 1] * (2 * k - 1) * (2 * k - 1) / (2.0 * k * (2 * k + 1));
+    }
+    return c;
+  }();
+  return coefficients;
+}
+
+// particle_set.transform(i) = se3_exp(particle_set.tangents.col(i)) * right
+// for i in [first, last), calculated in the scalar of the poses
+template <typename PoseScalar>
+inline void batch_se3_exp(BasicParticleSet<PoseScalar> &particle_set,
+                          const Eigen::Isometry3d &right, const int &first,
+                          const int &last) {
+  using Lanes = typename SE3Batch<PoseScalar>::Lanes;
+  const int batch_size = SE3Batch<PoseScalar>::size;
+  const Eigen::Matrix<PoseScalar, 3, 3> right_rotation =
+      right.linear().cast<PoseScalar>();
+  const Eigen::Matrix<PoseScalar, 3, 1> right_translation =
+      right.translation().cast<PoseScalar>();
+  for (int group = first; group < last; group += batch_size) {
+    int size = std::min(batch_size, last - group);
+    Lanes rho[3], omega[3];
+    for (int d = 0; d < 3; d++) {
+      rho[d].setZero();
+      omega[d].setZero();
+      for (int l = 0; l < size; l++) {
+        rho[d](l) = PoseScalar(particle_set.tangents(d, group + l));
+        omega[d](l) = PoseScalar(particle_set.tangents(d + 3, group + l));
+      }
+    }
+    Lanes theta_squared =
+        omega[0] * omega[0] + omega[1] * omega[1] + omega[2] * omega[2];
+    Lanes a, b, c;
+    SE3_batch_exp_coefficients(theta_squared, a, b, c);
+    // exp(hat_operator(v)) = [R, V * rho; 0, 1] where R = I + a * W + b * W^2
+    // and V = I + b * W + c * W^2
+    Lanes R[3][3], V[3][3];
+    SE3_batch_polynomial_of_hat(omega, theta_squared, a, b, R);
+    SE3_batch_polynomial_of_hat(omega, theta_squared, b, c, V);
+    for (int i = 0; i < 3; i++) {
+      Lanes translation = V[i][0] * rho[0] + V[i][1] * rho[1] +
+                             V[i][2] * rho[2] +
+                             R[i][0] * right_translation(0) +
+                             R[i][1] * right_translation(1) +
+                             R[i][2] * right_translation(2);
+      for (int l = 0; l < size; l++) {
+        particle_set.translations(i, group + l) = translation(l);
+      }
+      for (int j = 0; j < 3; j++) {
+        Lanes rotation = R[i][0] * right_rotation(0, j) +
+                            R[i][1] * right_rotation(1, j) +
+                            R[i][2] * right_rotation(2, j);
+        for (int l = 0; l < size; l++) {
+          particle_set.rotations(i + 3 * j, group + l) = rotation(l);
+        }
+      }
+    }
+  }
+}
+
+// xis.col(k) = se3_log(particle_set.transform(indices[k]) * right) for k in
+// [begin, end). It is calculated in double whatever the scalar of the poses
+// is, since the distributions are accumulated from xis.
+template <typename PoseScalar>
+inline void batch_se3_log(const BasicParticleSet<PoseScalar> &particle_set,
+                          const std::vector<int> &indices,
+                          const Eigen::Isometry3d &right, const int &begin,
+                          const int &end,
+                          ParticleSet::TangentMatrix &xis) {
+  const Eigen::Matrix3d right_rotation = right.linear();
+  const Eigen::Vector3d right_translation = right.translation();
+  const std::array<double, 16> &arcsin_coefficients =
+      SE3_arcsin_coefficients();
+  for (int group = begin; group < end; group += SE3_BATCH_SIZE) {
+    int size = std::min(SE3_BATCH_SIZE, end - group);
+    // [R, t] = particle_set.transform(indices[k]) * right
+    SE3Lanes R[3][3], t[3];
+    for (int i = 0; i < 3; i++) {
+      SE3Lanes left_rotation[3];
+      for (int j = 0; j < 3; j++) {
+        left_rotation[j] = (i == j ? SE3Lanes::Ones() : SE3Lanes::Zero());
+        for (int l = 0; l < size; l++) {
+          left_rotation[j](l) =
+              double(particle_set.rotations(i + 3 * j, indices[group + l]));
+        }
+      }
+      t[i].setZero();
+      for (int l = 0; l < size; l++) {
+        t[i](l) = double(particle_set.translations(i, indices[group + l]));
+      }
+      for (int j = 0; j < 3; j++) {
+        R[i][j] = left_rotation[0] * right_rotation(0, j) +
+                  left_rotation[1] * right_rotation(1, j) +
+                  left_rotation[2] * right_rotation(2, j);
+        t[i] += left_rotation[j] * right_translation(j);
+      }
+    }
+
+    // The branches of se3_log. The lanes near theta = pi are rare and
+    // calculated by se3_log afterwards.
+    SE3Lanes twice_sin_axis[3] = {R[2][1] - R[1][2], R[0][2] - R[2][0],
+                                  R[1][0] - R[0][1]};
+    SE3Lanes cos_theta = (R[0][0] + R[1][1] + R[2][2] - 1.0) / 2.0;
+    SE3Lanes sin_theta_squared =
+        (twice_sin_axis[0] * twice_sin_axis[0] +
+         twice_sin_axis[1] * twice_sin_axis[1] +
+         twice_sin_axis[2] * twice_sin_axis[2]) /
+        4.0;
+    SE3LaneMask use_Taylor_series =
+        cos_theta > 0.0 && sin_theta_squared < SE3_TAYLOR_THRESHOLD;
+    SE3LaneMask near_pi = cos_theta < 0.0 && sin_theta_squared < 0.25;
+    // half of theta / sin(theta)
+    SE3Lanes factor = SE3Lanes::Constant(arcsin_coefficients[15]);
+    for (int k = 14; k >= 0; k--) {
+      factor = arcsin_coefficients[k] + sin_theta_squared * factor;
+    }
+    factor /= 2.0;
+    SE3Lanes sin_theta = sin_theta_squared.sqrt();
+    for (int l = 0; l < SE3_BATCH_SIZE; l++) {
+      if (!use_Taylor_series(l) && !near_pi(l)) {
+        factor(l) =
+            std::atan2(sin_theta(l), cos_theta(l)) / (2.0 * sin_theta(l));
+      }
+    }
+    SE3Lanes omega[3];
+    for (int i = 0; i < 3; i++) {
+      omega[i] = factor * twice_sin_axis[i];
+    }
+
+    // SO3_inverse_left_Jacobian(omega) * t = t - omega x t / 2 +
+    // d * omega x (omega x t), where sin(theta) and cos(theta) are those of R
+    SE3Lanes theta_squared =
+        omega[0] * omega[0] + omega[1] * omega[1] + omega[2] * omega[2];
+    SE3LaneMask small = theta_squared < SE3_TAYLOR_THRESHOLD;
+    SE3Lanes safe_theta_squared = small.select(SE3Lanes::Ones(), theta_squared);
+    SE3Lanes d = small.select(
+        1.0 / 12.0 +
+            theta_squared *
+                (1.0 / 720.0 +
+                 theta_squared *
+                     (1.0 / 30240.0 +
+                      theta_squared * (1.0 / 1209600.0 +
+                                       theta_squared / 47900160.0))),
+        (1.0 - safe_theta_squared.sqrt() * sin_theta /
+                   (2.0 * (1.0 - cos_theta))) /
+            safe_theta_squared);
+    SE3Lanes omega_cross_t[3], omega_cross_omega_cross_t[3];
+    for (int i = 0; i < 3; i++) {
+      int j = (i + 1) % 3, k = (i + 2) % 3;
+      omega_cross_t[i] = omega[j] * t[k] - omega[k] * t[j];
+    }
+    for (int i = 0; i < 3; i++) {
+      int j = (i + 1) % 3, k = (i + 2) % 3;
+      omega_cross_omega_cross_t[i] =
+          omega[j] * omega_cross_t[k] - omega[k] * omega_cross_t[j];
+    }
+    for (int i = 0; i < 3; i++) {
+      SE3Lanes rho =
+          t[i] - omega_cross_t[i] / 2.0 + d * omega_cross_omega_cross_t[i];
+      for (int l = 0; l < size; l++) {
+        xis(i, group + l) = rho(l);
+        xis(i + 3, group + l) = omega[i](l);
+      }
+    }
+    for (int l = 0; l < size; l++) {
+      if (near_pi(l)) {
+        xis.col(group + l) = se3_log<double>(
+            particle_set.transform(indices[group + l]) * right);
+      }
+    }
+  }
+}
+
+// transformed[i] = t * points[i] for all i, as a single matrix product
+inline void transform_points(const Eigen::Isometry3d &t,
+                             const std::vector<Eigen::Vector3d> &points,
+                             std::vector<Eigen::Vector3d> &transformed) {
+  static_assert(sizeof(Eigen::Vector3d) == 3 * sizeof(double),
+                "Eigen::Vector3d must not be padded");
+  transformed.resize(points.size());
+  if (points.empty()) {
+    return;
+  }
+  Eigen::Map<const Eigen::Matrix3Xd> source(points[0].data(), 3,
+                                            points.size());
+  Eigen::Map<Eigen::Matrix3Xd> destination(transformed[0].data(), 3,
+                                           transformed.size());
+  destination.noalias() = t.linear() * source;
+  destination.colwise() += t.translation();
+}
+
+#endif
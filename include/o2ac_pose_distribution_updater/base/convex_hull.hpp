@@ -1,6 +1,11 @@
 #include <Eigen/Geometry>
+#include <boost/array.hpp>
 #include <vector>
 
+// The planar convex hulls by CGAL, which allocate at each call. The
+// calculations per particle use planar_convex_hull.hpp instead, which the tests
+// validate by these.
+
 void convex_hull_for_Eigen_Vector2d(std::vector<Eigen::Vector2d> &points,
                                     std::vector<Eigen::Vector2d> &hull);
 
@@ -9,3 +14,12 @@ bool check_inside_convex_hull(const Eigen::Vector2d &point,
 
 bool do_intersect_convex_hulls(const std::vector<Eigen::Vector2d> &points_0,
                                const std::vector<Eigen::Vector2d> &points_1);
+
+// The vertices of the convex hull of the points, and the triangles of its
+// boundary, counterclockwise seen from the outside, whose indices refer to the
+// vertices of the hull. The facets with more than three vertices are split
+// into triangles.
+void convex_hull_for_Eigen_Vector3d(
+    const std::vector<Eigen::Vector3d> &points,
+    std::vector<Eigen::Vector3d> &hull_vertices,
+    std::vector<boost::array<int, 3>> &hull_faces);
@@ -11,13 +11,16 @@
 #include <iostream>
 #include <stdexcept>
 
+#include "o2ac_pose_distribution_updater/base/action_status.hpp"
+#include "o2ac_pose_distribution_updater/base/action_workspace.hpp"
 #include "o2ac_pose_distribution_updater/base/grasp_action_helpers.hpp"
+#include "o2ac_pose_distribution_updater/base/particle_set.hpp"
 #include "o2ac_pose_distribution_updater/base/place_action_helpers.hpp"
+#include "o2ac_pose_distribution_updater/base/prepared_object.hpp"
 #include "o2ac_pose_distribution_updater/base/push_action_helpers.hpp"
 #include "o2ac_pose_distribution_updater/base/random_particle.hpp"
-
-using object_geometry = fcl::BVHModel<fcl::OBBRSS>;
-using object_geometry_ptr = std::shared_ptr<object_geometry>;
+#include "o2ac_pose_distribution_updater/base/thread_pool.hpp"
+#include "o2ac_pose_distribution_updater/base/weighted_moments.hpp"
 
 // Conversion functions associated with fcl types
 
@@ -29,6 +32,9 @@ Eigen::Isometry3d fcl_to_eigen_transform(const fcl::Transform3f &t);
 
 fcl::Transform3f eigen_to_fcl_transform(const Eigen::Isometry3d &t);
 
+fcl::Transform3f eigen_to_fcl_transform(const Eigen::Matrix3d &rotation,
+                                        const Eigen::Vector3d &translation);
+
 double calculate_distance(
     const std::shared_ptr<fcl::CollisionObject> &touched_object,
     const std::shared_ptr<fcl::CollisionGeometry> &gripped_geometry,
@@ -40,7 +46,169 @@ calculate_center_of_gravity(const std::vector<Eigen::Vector3d> &vertices,
 
 CovarianceMatrix safe_XXT(const CovarianceMatrix &A);
 
+// Methods to draw the perturbations of particles
+enum sampling_method {
+  monte_carlo_sampling,      // independent normal samples
+  quasi_monte_carlo_sampling // scrambled Sobol points
+};
+
+// Methods to update the Lie distribution by place, grasp and push actions
+enum update_method {
+  linear_approximation_update, // linearization of the action by AutoDiff
+  particle_update,             // Gaussian particle filter
+  sigma_point_update, // 13 sigma points of the unscented transform. Particles
+                      // are used instead if the action fails at any of them.
+  rotation_particle_update, // particles of the rotations only. The covariance
+                            // of the translations conditioned on the rotation
+                            // is propagated analytically.
+  automatic_update, // one of the linearization, the sigma points and the
+                    // particles, chosen by the nonlinearity of each step
+  number_of_update_methods
+};
+
+// Methods to resample the particles kept between steps
+enum resampling_method {
+  systematic_resampling, // a single uniform offset for all particles
+  residual_resampling    // floor(n * w) copies first, and then systematically
+};
+
+// The state of a sequence of steps: the particles, the persistent particle
+// belief, the position in the random sequence and the buffers of the
+// calculations. The steps taking a context are const member functions of
+// PoseEstimator, so one estimator, whose parameters are shared, serves
+// several sequences of steps at once if each thread uses its own context. A
+// context must not be used by two threads at once.
+struct EstimatorContext {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // The particles of the current step
+  ParticleSet particle_set;
+
+  // The i-th particle of the k-th sampling of this context is drawn from the
+  // random stream (random_seed, k, i) of the estimator, independent of the
+  // thread count
+  std::uint64_t random_step = 0;
+
+  // The kept particles with normalized weights and the distribution
+  // calculated from them, used if the persistent particle belief is enabled
+  bool has_particle_belief = false;
+  ParticleSet belief_particles;
+  Eigen::Isometry3d belief_mean;
+  CovarianceMatrix belief_covariance;
+
+  // The buffers of the per-particle calculations of the actions of each
+  // worker, which are selected by the worker id
+  std::vector<ActionWorkspace> workspaces = std::vector<ActionWorkspace>(1);
+
+  // Buffers of the weighted distributions, which keep their sizes between
+  // steps with the same number of particles
+  std::vector<int> weighted_indices;
+  Eigen::VectorXd compact_weights;
+  ParticleSet::TangentMatrix xis;
+  std::vector<CovarianceMatrix, Eigen::aligned_allocator<CovarianceMatrix>>
+      chunk_sums_of_xi_dash;
+  std::vector<WeightedMomentAccumulator<6>,
+              Eigen::aligned_allocator<WeightedMomentAccumulator<6>>>
+      chunk_moments;
+  // The weighted moments of the tangents of the first
+  // 'number_of_particles_in_moments' particles of particle_set, which
+  // sample_particles accumulates batch by batch
+  WeightedMomentAccumulator<6> particle_moments;
+  int number_of_particles_in_moments = 0;
+
+  // The number of the particles evaluated by the last place, grasp or push
+  // step of the Lie distribution with each status, i.e. the successes and the
+  // reasons of the failures. The sigma points are also counted.
+  ActionStatusCounts action_status_counts = ActionStatusCounts();
+  // The counts of the statuses of each chunk of the particles of a batch of
+  // steps, which are summed up for the belief of the chunk
+  std::vector<ActionStatusCounts> chunk_status_counts;
+
+  // The update method used by the last place, grasp or push step of the Lie
+  // distribution, which is chosen by the step if its method is
+  // automatic_update, and the nonlinearity measured by automatic_update, or -1
+  // if it is not measured
+  update_method last_update_method = particle_update;
+  double last_nonlinearity = -1.0;
+  // The effective sample size of the weights of the particles of the last
+  // step, or 0 if the step evaluates no particles. sample_particles reads it
+  // after each batch to decide whether to add particles.
+  double last_effective_sample_size = 0.0;
+  // The numbers of such steps updated by each method and their total time in
+  // seconds
+  std::array<int, number_of_update_methods> update_method_counts =
+      std::array<int, number_of_update_methods>();
+  std::array<double, number_of_update_methods> update_method_seconds =
+      std::array<double, number_of_update_methods>();
+
+  // Make sure that each of 'number_of_threads' workers has a workspace for
+  // an object with 'number_of_vertices' vertices, whose truncation by the
+  // gripper has at most 'number_of_clipped_vertices' vertices
+  void reserve_workspaces(const int &number_of_threads,
+                          const int &number_of_vertices = 0,
+                          const int &number_of_clipped_vertices = 0) {
+    if (workspaces.size() < number_of_threads) {
+      workspaces.resize(number_of_threads);
+    }
+    for (auto &workspace : workspaces) {
+      workspace.reserve(number_of_vertices, number_of_clipped_vertices);
+    }
+  }
+
+  // Reset the counts of the statuses of the workspaces
+  void clear_action_status_counts() {
+    for (auto &workspace : workspaces) {
+      workspace.status_counts.fill(0);
+    }
+  }
+
+  // Sum up the counts of the statuses of the workspaces into
+  // 'action_status_counts'
+  void collect_action_status_counts() {
+    action_status_counts.fill(0);
+    for (const auto &workspace : workspaces) {
+      for (int k = 0; k < number_of_action_statuses; k++) {
+        action_status_counts[k] += workspace.status_counts[k];
+      }
+    }
+  }
+
+  void clear_particle_belief() { has_particle_belief = false; }
+
+  // Whether the kept particles give the distribution (mean, covariance)
+  bool matches_particle_belief(const Eigen::Isometry3d &mean,
+                               const CovarianceMatrix &covariance) const;
+};
+
+using EstimatorContexts =
+    std::vector<EstimatorContext, Eigen::aligned_allocator<EstimatorContext>>;
+
+// A belief updated by a batch of steps of the same action. 'object' is the
+// index of the object in the objects of the batch. The batch sets the results,
+// and 'error_message' is the reason of the failure if 'success' is false.
+struct BatchedBelief {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  int object = 0;
+  Eigen::Isometry3d gripper_transform = Eigen::Isometry3d::Identity();
+  double support_surface = 0.0; // used only by the place action
+  Eigen::Isometry3d old_mean = Eigen::Isometry3d::Identity();
+  CovarianceMatrix old_covariance = CovarianceMatrix::Zero();
+
+  bool success = false;
+  std::string error_message;
+  Eigen::Isometry3d new_mean = Eigen::Isometry3d::Identity();
+  CovarianceMatrix new_covariance = CovarianceMatrix::Zero();
+};
+
+using BatchedBeliefs =
+    std::vector<BatchedBelief, Eigen::aligned_allocator<BatchedBelief>>;
+
 class PoseEstimator {
+  // The parameters are set by the non-const member functions and shared by
+  // the const ones, which keep the state of the steps in the given
+  // EstimatorContext. The steps without a context use 'default_context'.
+
 public:
   // Parameters for Gaussian particle filter
   int number_of_particles;
@@ -48,11 +216,47 @@ public:
       place_number_of_particles, grasp_number_of_particles,
       push_number_of_particles;
   Particle noise_variance;
-  // Variables for Gaussian particle filter
-  std::vector<Particle> particles;
-  std::vector<Eigen::Isometry3d> particle_transforms;
-  std::vector<fcl::Transform3f> fcl_particle_transforms;
-  std::vector<double> likelihoods;
+  // Parameters for adaptive sampling. If it is enabled, the first batch has
+  // *_min_number_of_particles particles, and the number of particles is
+  // doubled until the effective sample size reaches
+  // effective_sample_size_ratio * *_number_of_particles or the number of
+  // particles reaches *_max_number_of_particles. Otherwise
+  // *_number_of_particles particles are drawn.
+  bool use_adaptive_sampling = false;
+  double effective_sample_size_ratio = 0.5;
+  int touch_min_number_of_particles, look_min_number_of_particles,
+      place_min_number_of_particles, grasp_min_number_of_particles,
+      push_min_number_of_particles;
+  int touch_max_number_of_particles, look_max_number_of_particles,
+      place_max_number_of_particles, grasp_max_number_of_particles,
+      push_max_number_of_particles;
+  // Sampling method of each action
+  sampling_method touch_sampling_method = monte_carlo_sampling,
+                  look_sampling_method = monte_carlo_sampling,
+                  place_sampling_method = monte_carlo_sampling,
+                  grasp_sampling_method = monte_carlo_sampling,
+                  push_sampling_method = monte_carlo_sampling;
+
+  // Parameters for the persistent particle belief. If it is enabled, the
+  // weighted particles of the last step of the Lie distribution are kept in
+  // the context, and the next step resamples them instead of sampling from
+  // the Gaussian when its input is the distribution calculated from them, so
+  // the distribution keeps its non-Gaussian shape through a sequence of
+  // steps. The resampled particles are moved by the noise of
+  // generate_particles and by the normal distribution whose covariance is
+  // resampling_jitter^2 times the covariance of the input.
+  bool use_persistent_particles = false;
+  resampling_method persistent_resampling_method = systematic_resampling;
+  double resampling_jitter = 0.0;
+
+  // Workers to evaluate particles in parallel, shared by all contexts
+  std::shared_ptr<ThreadPool> thread_pool = std::make_shared<ThreadPool>(1);
+
+  // The seed of the random streams of the particles
+  std::uint64_t random_seed = 0;
+
+  // The context of the steps called without a context
+  EstimatorContext default_context;
 
   // Parameters for touch action
   std::vector<std::shared_ptr<fcl::CollisionObject>> touched_objects;
@@ -64,11 +268,21 @@ public:
   unsigned int image_height, image_width;
   Eigen::Vector3d looked_point;
 
-  // Variables for look action
+  // The pose of the camera calculated from the calibration points
   cv::Mat camera_r, camera_t;
 
   // Parameters to place, grasp and push actions
-  bool use_linear_approximation;
+  update_method place_update_method = particle_update,
+                grasp_update_method = particle_update,
+                push_update_method = particle_update;
+  // Thresholds of automatic_update. The nonlinearity of a step is the relative
+  // difference between the covariances by the linearization at the mean and
+  // by the sigma points. The linearization is used if it is at most
+  // automatic_linear_threshold, the sigma points if it is at most
+  // automatic_sigma_point_threshold, and the particles otherwise or if the
+  // action fails at the mean or at a sigma point.
+  double automatic_linear_threshold = 0.05,
+         automatic_sigma_point_threshold = 0.2;
 
   // Parameters for grasp and push action
   double gripper_height, gripper_width, gripper_thickness;
@@ -80,6 +294,36 @@ public:
                                const Particle &noise_variance);
   void reset_number_of_particles(const int &number_of_particles);
 
+  // If number_of_threads is 0, the number of hardware threads is used
+  void set_number_of_threads(const int &number_of_threads) {
+    thread_pool = std::make_shared<ThreadPool>(number_of_threads);
+    default_context.reserve_workspaces(thread_pool->get_number_of_threads());
+  }
+
+  void set_adaptive_sampling(const bool &use_adaptive_sampling,
+                             const double &effective_sample_size_ratio) {
+    this->use_adaptive_sampling = use_adaptive_sampling;
+    this->effective_sample_size_ratio = effective_sample_size_ratio;
+  }
+
+  void set_persistent_particles(
+      const bool &use_persistent_particles,
+      const resampling_method &method = systematic_resampling,
+      const double &resampling_jitter = 0.0) {
+    this->use_persistent_particles = use_persistent_particles;
+    this->persistent_resampling_method = method;
+    this->resampling_jitter = resampling_jitter;
+    clear_particle_belief();
+  }
+
+  void clear_particle_belief() { default_context.clear_particle_belief(); }
+
+  // Restart the random sequence of the default context
+  void set_random_seed(const std::uint64_t &random_seed) {
+    this->random_seed = random_seed;
+    default_context.random_step = 0;
+  }
+
   void set_touch_parameters(
       const std::vector<std::shared_ptr<fcl::CollisionObject>> &touched_objects,
       const double &distance_threshold);
@@ -90,11 +334,23 @@ public:
       const double &camera_fx, const double &camera_fy, const double &camera_cx,
       const double &camera_cy);
 
+  // Set the update methods of place, grasp and push actions at once
+  void set_update_method(const update_method &method) {
+    place_update_method = grasp_update_method = push_update_method = method;
+  }
+
+  void set_automatic_update_thresholds(const double &linear_threshold,
+                                       const double &sigma_point_threshold) {
+    automatic_linear_threshold = linear_threshold;
+    automatic_sigma_point_threshold = sigma_point_threshold;
+  }
+
   void set_use_linear_approximation(const bool &use_linear_approximation) {
-    this->use_linear_approximation = use_linear_approximation;
+    set_update_method(use_linear_approximation ? linear_approximation_update
+                                               : particle_update);
   }
 
-  Eigen::Isometry3d get_camera_pose();
+  Eigen::Isometry3d get_camera_pose() const;
 
   void set_grasp_parameters(const double &gripper_height,
                             const double &gripper_width,
@@ -110,19 +366,342 @@ public:
 
   void load_config_file(const std::string &file_path);
 
-  void generate_particles(const Particle &old_mean,
-                          const CovarianceMatrix &old_covariance);
-
-  void calculate_touch_likelihoods(const unsigned char &touched_object_id,
+  // The functions below keep their state in 'context'
+
+  void generate_particles(EstimatorContext &context, const Particle &old_mean,
+                          const CovarianceMatrix &old_covariance) const;
+
+  void generate_particles(EstimatorContext &context, const Particle &old_mean,
+                          const CovarianceMatrix &X, const std::uint64_t &step,
+                          const int &first, const int &last,
+                          const sampling_method &method) const;
+
+  void sample_particles(
+      EstimatorContext &context, const int &min_number_of_particles,
+      const int &nominal_number_of_particles,
+      const int &max_number_of_particles, const sampling_method &method,
+      const Particle &old_mean, const CovarianceMatrix &old_covariance,
+      const FunctionRef<void(const int &first, const int &last)>
+          &evaluate_particles) const;
+
+  // Sample the particles of the Lie distribution (old_mean, old_covariance)
+  // and evaluate them by 'evaluate_particles', which receives particles whose
+  // transforms are set. If the persistent particle belief matches the input,
+  // nominal_number_of_particles particles are resampled from it. Otherwise they
+  // are drawn from the Gaussian by sample_particles.
+  void sample_Lie_particles(
+      EstimatorContext &context, const int &min_number_of_particles,
+      const int &nominal_number_of_particles,
+      const int &max_number_of_particles, const sampling_method &method,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      const FunctionRef<void(const int &first, const int &last)>
+          &evaluate_particles) const;
+
+  // Set the transforms of the particles in [first, last) of the Lie
+  // distribution to exp(hat_operator(tangent)) * old_mean by the batch
+  // operators
+  void set_Lie_particle_transforms(EstimatorContext &context,
+                                   const Eigen::Isometry3d &old_mean,
+                                   const int &first, const int &last) const;
+
+  // Call 'evaluate_particle' for the particles in [first, last) in parallel.
+  // It also receives the id of the worker, which selects its workspace in the
+  // context.
+  void evaluate_particles(
+      EstimatorContext &context, const int &first, const int &last,
+      const FunctionRef<void(const int &i, const int &worker_id)>
+          &evaluate_particle) const;
+
+  // Update the Lie distribution by the sigma points. 'evaluate_particle'
+  // receives the i-th particle whose transform is the sigma point, and sets the
+  // transform after the action and its weight, 1 if the action succeeds and 0
+  // otherwise. Returns false if the action fails at some sigma point.
+  bool propagate_sigma_points(
+      EstimatorContext &context, const Eigen::Isometry3d &old_mean,
+      const CovarianceMatrix &old_covariance,
+      const FunctionRef<void(const int &i, const int &worker_id)>
+          &evaluate_particle,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const;
+
+  // Update the Lie distribution by the Rao-Blackwellized particle filter. The
+  // particles are drawn from the marginal distribution of the rotations, and
+  // the translation of each particle is the mean conditioned on its rotation.
+  // Once the rotation is fixed, the translation after the action is affine in
+  // that before the action with the derivative 'translation_Jacobian', so the
+  // conditional covariance of the translations is added analytically.
+  // 'evaluate_particle' is the same as that of propagate_sigma_points.
+  void propagate_rotation_particles(
+      EstimatorContext &context, const int &min_number_of_particles,
+      const int &nominal_number_of_particles,
+      const int &max_number_of_particles, const sampling_method &method,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      const Eigen::Matrix3d &translation_Jacobian,
+      const FunctionRef<void(const int &i, const int &worker_id)>
+          &evaluate_particle,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const;
+
+  // Update the Lie distribution by a place, grasp or push action with
+  // 'method'. 'linearize' sets the distribution by the linearization of the
+  // action at the mean, and throws std::runtime_error if the action fails at
+  // the mean. 'evaluate_particle' is the same as that of
+  // propagate_sigma_points. The used method and the time are recorded in the
+  // context.
+  void update_Lie_distribution_by_action(
+      EstimatorContext &context, const update_method &method,
+      const int &min_number_of_particles,
+      const int &nominal_number_of_particles,
+      const int &max_number_of_particles,
+      const sampling_method &sampling, const Eigen::Isometry3d &old_mean,
+      const CovarianceMatrix &old_covariance,
+      const Eigen::Matrix3d &translation_Jacobian,
+      const FunctionRef<void(Eigen::Isometry3d &new_mean,
+                             CovarianceMatrix &new_covariance)> &linearize,
+      const FunctionRef<void(const int &i, const int &worker_id)>
+          &evaluate_particle,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const;
+
+  void calculate_touch_likelihoods(EstimatorContext &context,
+                                   const unsigned char &touched_object_id,
                                    const object_geometry_ptr &gripped_geometry,
-                                   const fcl::Transform3f &gripper_transform);
+                                   const fcl::Transform3f &gripper_transform,
+                                   const int &first, const int &last) const;
+
+  // Add the weighted moments of the tangents of the particles in
+  // [first, last) to context.particle_moments, which are then those of the
+  // first 'last' particles, and set context.last_effective_sample_size
+  void accumulate_particle_moments(EstimatorContext &context,
+                                   const int &first, const int &last) const;
+
+  void calculate_new_distribution(EstimatorContext &context,
+                                  Particle &new_mean,
+                                  CovarianceMatrix &new_covariance) const;
+
+  // The particles are kept as the persistent particle belief if it is enabled
+  void calculate_new_Lie_distribution(EstimatorContext &context,
+                                      const Eigen::Isometry3d &old_mean,
+                                      Eigen::Isometry3d &new_mean,
+                                      CovarianceMatrix &new_covariance) const;
+
+  // The weighted mean and covariance of the particles, whose weights are
+  // normalized, without Bessel's correction
+  void calculate_weighted_Lie_distribution(
+      EstimatorContext &context, Eigen::Isometry3d &new_mean,
+      CovarianceMatrix &new_covariance) const;
+
+  // The steps taking an object have two overloads. One takes the object
+  // prepared by prepare_object, which is shared by the steps on the same
+  // object, so that they pay only for the particles. The other takes the mesh
+  // and prepares the parts of the object used by the step at each call. Both
+  // of the place, grasp and push steps forward to the overload taking the
+  // ObjectParts, which refer to the object without copying it.
+
+  void touched_step(EstimatorContext &context,
+                    const unsigned char &touched_object_id,
+                    const std::vector<Eigen::Vector3d> &vertices,
+                    const std::vector<boost::array<int, 3>> &triangles,
+                    const fcl::Transform3f &gripper_transform,
+                    const Particle &old_mean,
+                    const CovarianceMatrix &old_covariance, Particle &new_mean,
+                    CovarianceMatrix &new_covariance) const;
 
-  void calculate_new_distribution(Particle &new_mean,
-                                  CovarianceMatrix &new_covariance);
+  void touched_step(EstimatorContext &context,
+                    const unsigned char &touched_object_id,
+                    const PreparedObject &object,
+                    const fcl::Transform3f &gripper_transform,
+                    const Particle &old_mean,
+                    const CovarianceMatrix &old_covariance, Particle &new_mean,
+                    CovarianceMatrix &new_covariance) const;
 
-  void calculate_new_Lie_distribution(const Eigen::Isometry3d &old_mean,
-                                      Eigen::Isometry3d &new_mean,
-                                      CovarianceMatrix &new_covariance);
+  void touched_step_with_Lie_distribution(
+      EstimatorContext &context, const unsigned char &touched_object_id,
+      const std::vector<Eigen::Vector3d> &vertices,
+      const std::vector<boost::array<int, 3>> &triangles,
+      const fcl::Transform3f &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const;
+
+  void touched_step_with_Lie_distribution(
+      EstimatorContext &context, const unsigned char &touched_object_id,
+      const PreparedObject &object, const fcl::Transform3f &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const;
+
+  void place_step_with_Lie_distribution(
+      EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
+      const std::vector<boost::array<int, 3>> &triangles,
+      const Eigen::Isometry3d &gripper_transform, const double &support_surface,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void place_step_with_Lie_distribution(
+      EstimatorContext &context, const PreparedObject &object,
+      const Eigen::Isometry3d &gripper_transform, const double &support_surface,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void place_step_with_Lie_distribution(
+      EstimatorContext &context, const ObjectParts &object,
+      const Eigen::Isometry3d &gripper_transform, const double &support_surface,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void grasp_step_with_Lie_distribution(
+      EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
+      const std::vector<boost::array<int, 3>> &triangles,
+      const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void grasp_step_with_Lie_distribution(
+      EstimatorContext &context, const PreparedObject &object,
+      const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void grasp_step_with_Lie_distribution(
+      EstimatorContext &context, const ObjectParts &object,
+      const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void push_step_with_Lie_distribution(
+      EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
+      const std::vector<boost::array<int, 3>> &triangles,
+      const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void push_step_with_Lie_distribution(
+      EstimatorContext &context, const PreparedObject &object,
+      const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  void push_step_with_Lie_distribution(
+      EstimatorContext &context, const ObjectParts &object,
+      const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) const;
+
+  // Update the beliefs by the actions of the same type at once. The i-th
+  // belief is updated as by the step with contexts[i], which is added if it
+  // does not exist. The particles of all beliefs are evaluated as one parallel
+  // workload with the workspaces of contexts[0]. The beliefs are updated one
+  // by one instead if the update method is not particle_update, or adaptive
+  // sampling or the persistent particle belief is enabled. A failure of a
+  // belief does not stop the others.
+  void place_steps_with_Lie_distribution(
+      EstimatorContexts &contexts,
+      const std::vector<PreparedObjectPtr> &objects,
+      BatchedBeliefs &beliefs) const;
+
+  void grasp_steps_with_Lie_distribution(
+      EstimatorContexts &contexts,
+      const std::vector<PreparedObjectPtr> &objects,
+      BatchedBeliefs &beliefs) const;
+
+  void push_steps_with_Lie_distribution(
+      EstimatorContexts &contexts,
+      const std::vector<PreparedObjectPtr> &objects,
+      BatchedBeliefs &beliefs) const;
+
+  // Update the Lie distributions of the beliefs by the Gaussian particle
+  // filter with 'number_of_particles' particles each, evaluated by one
+  // parallel loop. 'act' sets the pose after the action of the belief-th
+  // belief of the object at 'object_pose', and returns the status.
+  // 'truncates_object' tells if 'act' truncates the object by the gripper.
+  // The statuses of the particles and the update method are recorded in the
+  // context of each belief as by the single steps.
+  void update_Lie_distributions_by_particles(
+      EstimatorContexts &contexts,
+      const std::vector<PreparedObjectPtr> &objects, BatchedBeliefs &beliefs,
+      const int &number_of_particles,
+      const sampling_method &method, const bool &truncates_object,
+      const FunctionRef<action_status(
+          const int &belief, const Eigen::Isometry3d &object_pose,
+          ActionWorkspace &workspace, Eigen::Isometry3d &new_transform)> &act)
+      const;
+
+  // Truncate the object at 'object_pose' to the part between the fingers of
+  // the gripper, which is stored in workspace.cut_vertices. The vertices are
+  // clipped by the planes of the gripper in one pass over the connectivity of
+  // the object.
+  action_status truncate_grasped_object(const Eigen::Isometry3d &object_pose,
+                                        const ObjectParts &object,
+                                        ActionWorkspace &workspace) const;
+
+  action_status truncate_pushed_object(const Eigen::Isometry3d &object_pose,
+                                       const ObjectParts &object,
+                                       ActionWorkspace &workspace) const;
+
+  void calculate_look_likelihoods(
+      EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
+      const std::vector<boost::array<int, 3>> &triangles,
+      const Eigen::Isometry3d &gripper_transform,
+      const cv::Mat &binary_looked_image,
+      const boost::array<unsigned int, 4> &ROI, const int &first,
+      const int &last) const;
+
+  void look_step(EstimatorContext &context,
+                 const std::vector<Eigen::Vector3d> &vertices,
+                 const std::vector<boost::array<int, 3>> &triangles,
+                 const Eigen::Isometry3d &gripper_transform,
+                 const cv::Mat &looked_image,
+                 const boost::array<unsigned int, 4> &ROI,
+                 const Particle &old_mean,
+                 const CovarianceMatrix &old_covariance, Particle &new_mean,
+                 CovarianceMatrix &new_covariance) const;
+
+  // The look action uses only the mesh of the prepared object
+  void look_step(EstimatorContext &context, const PreparedObject &object,
+                 const Eigen::Isometry3d &gripper_transform,
+                 const cv::Mat &looked_image,
+                 const boost::array<unsigned int, 4> &ROI,
+                 const Particle &old_mean,
+                 const CovarianceMatrix &old_covariance, Particle &new_mean,
+                 CovarianceMatrix &new_covariance) const {
+    look_step(context, object.vertices, object.triangles, gripper_transform,
+              looked_image, ROI, old_mean, old_covariance, new_mean,
+              new_covariance);
+  }
+
+  void look_step_with_Lie_distribution(
+      EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
+      const std::vector<boost::array<int, 3>> &triangles,
+      const Eigen::Isometry3d &gripper_transform, const cv::Mat &looked_image,
+      const boost::array<unsigned int, 4> &ROI,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool already_binary = false) const;
+
+  void look_step_with_Lie_distribution(
+      EstimatorContext &context, const PreparedObject &object,
+      const Eigen::Isometry3d &gripper_transform, const cv::Mat &looked_image,
+      const boost::array<unsigned int, 4> &ROI,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool already_binary = false) const {
+    look_step_with_Lie_distribution(
+        context, object.vertices, object.triangles, gripper_transform,
+        looked_image, ROI, old_mean, old_covariance, new_mean, new_covariance,
+        already_binary);
+  }
+
+  // The steps with the default context
+
+  void generate_particles(const Particle &old_mean,
+                          const CovarianceMatrix &old_covariance) {
+    generate_particles(default_context, old_mean, old_covariance);
+  }
 
   void touched_step(const unsigned char &touched_object_id,
                     const std::vector<Eigen::Vector3d> &vertices,
@@ -130,7 +709,21 @@ public:
                     const fcl::Transform3f &gripper_transform,
                     const Particle &old_mean,
                     const CovarianceMatrix &old_covariance, Particle &new_mean,
-                    CovarianceMatrix &new_covariance);
+                    CovarianceMatrix &new_covariance) {
+    touched_step(default_context, touched_object_id, vertices, triangles,
+                 gripper_transform, old_mean, old_covariance, new_mean,
+                 new_covariance);
+  }
+
+  void touched_step(const unsigned char &touched_object_id,
+                    const PreparedObject &object,
+                    const fcl::Transform3f &gripper_transform,
+                    const Particle &old_mean,
+                    const CovarianceMatrix &old_covariance, Particle &new_mean,
+                    CovarianceMatrix &new_covariance) {
+    touched_step(default_context, touched_object_id, object, gripper_transform,
+                 old_mean, old_covariance, new_mean, new_covariance);
+  }
 
   void touched_step_with_Lie_distribution(
       const unsigned char &touched_object_id,
@@ -138,14 +731,22 @@ public:
       const std::vector<boost::array<int, 3>> &triangles,
       const fcl::Transform3f &gripper_transform,
       const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
-      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance);
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) {
+    touched_step_with_Lie_distribution(
+        default_context, touched_object_id, vertices, triangles,
+        gripper_transform, old_mean, old_covariance, new_mean, new_covariance);
+  }
 
-  void place_step(const std::vector<Eigen::Vector3d> &vertices,
-                  const std::vector<boost::array<int, 3>> &triangles,
-                  const Eigen::Isometry3d &gripper_transform,
-                  const double &support_surface, const Particle &old_mean,
-                  const CovarianceMatrix &old_covariance, Particle &new_mean,
-                  CovarianceMatrix &new_covariance);
+  void touched_step_with_Lie_distribution(
+      const unsigned char &touched_object_id, const PreparedObject &object,
+      const fcl::Transform3f &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) {
+    touched_step_with_Lie_distribution(default_context, touched_object_id,
+                                       object, gripper_transform, old_mean,
+                                       old_covariance, new_mean,
+                                       new_covariance);
+  }
 
   void place_step_with_Lie_distribution(
       const std::vector<Eigen::Vector3d> &vertices,
@@ -153,7 +754,22 @@ public:
       const Eigen::Isometry3d &gripper_transform, const double &support_surface,
       const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
       Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
-      const bool validity_check = false);
+      const bool validity_check = false) {
+    place_step_with_Lie_distribution(
+        default_context, vertices, triangles, gripper_transform,
+        support_surface, old_mean, old_covariance, new_mean, new_covariance,
+        validity_check);
+  }
+
+  void place_step_with_Lie_distribution(
+      const PreparedObject &object, const Eigen::Isometry3d &gripper_transform,
+      const double &support_surface, const Eigen::Isometry3d &old_mean,
+      const CovarianceMatrix &old_covariance, Eigen::Isometry3d &new_mean,
+      CovarianceMatrix &new_covariance, const bool validity_check = false) {
+    place_step_with_Lie_distribution(default_context, object, gripper_transform,
+                                     support_surface, old_mean, old_covariance,
+                                     new_mean, new_covariance, validity_check);
+  }
 
   void grasp_step_with_Lie_distribution(
       const std::vector<Eigen::Vector3d> &vertices,
@@ -161,7 +777,22 @@ public:
       const Eigen::Isometry3d &gripper_transform,
       const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
       Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
-      const bool validity_check = false);
+      const bool validity_check = false) {
+    grasp_step_with_Lie_distribution(default_context, vertices, triangles,
+                                     gripper_transform, old_mean,
+                                     old_covariance, new_mean, new_covariance,
+                                     validity_check);
+  }
+
+  void grasp_step_with_Lie_distribution(
+      const PreparedObject &object, const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) {
+    grasp_step_with_Lie_distribution(default_context, object, gripper_transform,
+                                     old_mean, old_covariance, new_mean,
+                                     new_covariance, validity_check);
+  }
 
   void push_step_with_Lie_distribution(
       const std::vector<Eigen::Vector3d> &vertices,
@@ -169,25 +800,22 @@ public:
       const Eigen::Isometry3d &gripper_transform,
       const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
       Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
-      const bool validity_check = false);
-
-  void generate_image(cv::Mat &image,
-                      const std::vector<Eigen::Vector3d> &vertices,
-                      const std::vector<boost::array<int, 3>> &triangles,
-                      const Eigen::Isometry3d &transform,
-                      const boost::array<unsigned int, 4> &ROI);
-
-  double similarity_of_images(const cv::Mat &estimated_image,
-                              const cv::Mat &binary_looked_image);
-
-  void
-  calculate_look_likelihoods(const std::vector<Eigen::Vector3d> &vertices,
-                             const std::vector<boost::array<int, 3>> &triangles,
-                             const Eigen::Isometry3d &gripper_transform,
-                             const cv::Mat &binary_looked_image,
-                             const boost::array<unsigned int, 4> &ROI);
+      const bool validity_check = false) {
+    push_step_with_Lie_distribution(default_context, vertices, triangles,
+                                    gripper_transform, old_mean,
+                                    old_covariance, new_mean, new_covariance,
+                                    validity_check);
+  }
 
-  void to_binary_image(const cv::Mat &bgr_image, cv::Mat &binary_image);
+  void push_step_with_Lie_distribution(
+      const PreparedObject &object, const Eigen::Isometry3d &gripper_transform,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool validity_check = false) {
+    push_step_with_Lie_distribution(default_context, object, gripper_transform,
+                                    old_mean, old_covariance, new_mean,
+                                    new_covariance, validity_check);
+  }
 
   void look_step(const std::vector<Eigen::Vector3d> &vertices,
                  const std::vector<boost::array<int, 3>> &triangles,
@@ -196,7 +824,22 @@ public:
                  const boost::array<unsigned int, 4> &ROI,
                  const Particle &old_mean,
                  const CovarianceMatrix &old_covariance, Particle &new_mean,
-                 CovarianceMatrix &new_covariance);
+                 CovarianceMatrix &new_covariance) {
+    look_step(default_context, vertices, triangles, gripper_transform,
+              looked_image, ROI, old_mean, old_covariance, new_mean,
+              new_covariance);
+  }
+
+  void look_step(const PreparedObject &object,
+                 const Eigen::Isometry3d &gripper_transform,
+                 const cv::Mat &looked_image,
+                 const boost::array<unsigned int, 4> &ROI,
+                 const Particle &old_mean,
+                 const CovarianceMatrix &old_covariance, Particle &new_mean,
+                 CovarianceMatrix &new_covariance) {
+    look_step(default_context, object, gripper_transform, looked_image, ROI,
+              old_mean, old_covariance, new_mean, new_covariance);
+  }
 
   void look_step_with_Lie_distribution(
       const std::vector<Eigen::Vector3d> &vertices,
@@ -205,5 +848,54 @@ public:
       const boost::array<unsigned int, 4> &ROI,
       const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
       Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
-      const bool already_binary = false);
+      const bool already_binary = false) {
+    look_step_with_Lie_distribution(default_context, vertices, triangles,
+                                    gripper_transform, looked_image, ROI,
+                                    old_mean, old_covariance, new_mean,
+                                    new_covariance, already_binary);
+  }
+
+  void look_step_with_Lie_distribution(
+      const PreparedObject &object, const Eigen::Isometry3d &gripper_transform,
+      const cv::Mat &looked_image, const boost::array<unsigned int, 4> &ROI,
+      const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+      Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+      const bool already_binary = false) {
+    look_step_with_Lie_distribution(default_context, object, gripper_transform,
+                                    looked_image, ROI, old_mean, old_covariance,
+                                    new_mean, new_covariance, already_binary);
+  }
+
+  // Functions without state
+
+  // The place action by the linear approximation of the RPY distribution
+  void place_step(const std::vector<Eigen::Vector3d> &vertices,
+                  const std::vector<boost::array<int, 3>> &triangles,
+                  const Eigen::Isometry3d &gripper_transform,
+                  const double &support_surface, const Particle &old_mean,
+                  const CovarianceMatrix &old_covariance, Particle &new_mean,
+                  CovarianceMatrix &new_covariance) const;
+
+  void place_step(const PreparedObject &object,
+                  const Eigen::Isometry3d &gripper_transform,
+                  const double &support_surface, const Particle &old_mean,
+                  const CovarianceMatrix &old_covariance, Particle &new_mean,
+                  CovarianceMatrix &new_covariance) const;
+
+  void place_step(const ObjectParts &object,
+                  const Eigen::Isometry3d &gripper_transform,
+                  const double &support_surface, const Particle &old_mean,
+                  const CovarianceMatrix &old_covariance, Particle &new_mean,
+                  CovarianceMatrix &new_covariance) const;
+
+  void generate_image(cv::Mat &image,
+                      const std::vector<Eigen::Vector3d> &vertices,
+                      const std::vector<boost::array<int, 3>> &triangles,
+                      const Eigen::Isometry3d &transform,
+                      const boost::array<unsigned int, 4> &ROI) const;
+
+  double similarity_of_images(const cv::Mat &estimated_image,
+                              const cv::Mat &binary_looked_image) const;
+
+  void to_binary_image(const cv::Mat &bgr_image, cv::Mat &binary_image) const;
 };
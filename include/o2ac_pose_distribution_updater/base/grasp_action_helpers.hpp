@@ -4,16 +4,45 @@ Helper functions for the grasp action
 
 #include <Eigen/Geometry>
 
+#include "o2ac_pose_distribution_updater/base/action_workspace.hpp"
 #include "o2ac_pose_distribution_updater/base/conversions.hpp"
 #include "o2ac_pose_distribution_updater/base/operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/prepared_object.hpp"
+#include <array>
 #include <unsupported/Eigen/AutoDiff>
 
+// Cut the mesh by the plane and keep the part on its positive side, as a mesh
+// whose faces on the plane are missing. The grasp and push steps use
+// clipping_object instead, and this is the reference of the tests.
 void cutting_object(const std::vector<Eigen::Vector3d> &vertices,
                     const std::vector<boost::array<int, 3>> &triangles,
                     const Eigen::Hyperplane<double, 3> &plane,
                     std::vector<Eigen::Vector3d> &result_vertices,
                     std::vector<boost::array<int, 3>> &result_triangles);
 
+// The planes bounding the part of an object touched by the gripper
+using ClippingPlanes = std::array<Eigen::Hyperplane<double, 3>, 3>;
+
+// The vertices of the part of the surface of the object on the positive sides
+// of all the planes, which are the vertices of the triangles clipped by the
+// planes, each found once. The triangles are not made, since the grasp and
+// push steps read only the vertices. Unlike cutting_object by each plane in
+// turn, it makes no points inside the faces where a cut splits a triangle, and
+// keeps the intersections with the open edges left by the earlier cuts.
+void clipping_object(const std::vector<Eigen::Vector3d> &vertices,
+                     const std::vector<boost::array<int, 3>> &triangles,
+                     const MeshConnectivity &connectivity,
+                     const ClippingPlanes &planes,
+                     std::vector<Eigen::Vector3d> &result_vertices,
+                     ActionWorkspace *workspace = nullptr);
+
+// The largest number of the vertices made by clipping_object, which are all
+// the vertices, a point on each edge for each plane and a point on each
+// triangle for each pair of the planes
+int max_number_of_clipped_vertices(const int &number_of_vertices,
+                                   const int &number_of_triangles,
+                                   const MeshConnectivity &connectivity);
+
 class grasp_calculator {
 public:
   // data for calculating the pose
@@ -32,14 +61,32 @@ public:
   int fourth_vertex_side;
   Eigen::Isometry3d rotated_gripper_transform, old_mean, new_mean;
 
-  // constructor, which calculates new_mean
+  grasp_calculator() {}
+
+  // constructor, which calculates new_mean and throws std::runtime_error if
+  // the object cannot be grasped
   grasp_calculator(const std::vector<Eigen::Vector3d> &vertices,
                    const std::vector<Eigen::Vector3d> &all_vertices,
                    const Eigen::Isometry3d &gripper_transform,
                    const Eigen::Isometry3d &old_mean,
                    const Eigen::Vector3d &center_of_gravity,
                    const bool balance_check = true,
-                   const bool stability_check = true);
+                   const bool stability_check = true,
+                   ActionWorkspace *workspace = nullptr);
+
+  // calculates new_mean, and returns the reason of the failure instead of
+  // throwing it. If convex_hull is given, all_vertices must be its vertices,
+  // and the lowest vertices are found by find_support_vertex instead of a
+  // scan.
+  action_status calculate(const std::vector<Eigen::Vector3d> &vertices,
+                          const std::vector<Eigen::Vector3d> &all_vertices,
+                          const Eigen::Isometry3d &gripper_transform,
+                          const Eigen::Isometry3d &old_mean,
+                          const Eigen::Vector3d &center_of_gravity,
+                          const bool balance_check = true,
+                          const bool stability_check = true,
+                          ActionWorkspace *workspace = nullptr,
+                          const ConvexHull *convex_hull = nullptr);
 
   // provide function to calculate the pose after grasping given a initial pose
   // in the neighborhood of old_mean
@@ -55,3 +102,10 @@ void grasp_update_Lie_distribution(
     const Eigen::Vector3d &center_of_gravity,
     const Eigen::Isometry3d &gripper_transform, Eigen::Isometry3d &new_mean,
     CovarianceMatrix &new_covariance);
+
+// The derivative of the translation after grasping by that before grasping when
+// the rotation before grasping is fixed. The x-coordinate of the object in the
+// rotated gripper coordinates is determined by the gripper, and the y and
+// z-coordinates are kept. The change of the truncated object is ignored.
+Eigen::Matrix3d
+grasp_translation_Jacobian(const Eigen::Isometry3d &gripper_transform);
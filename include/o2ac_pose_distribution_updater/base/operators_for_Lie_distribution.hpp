@@ -1,7 +1,9 @@
 #ifndef O2AC_POSE_DISTRIBUTION_UPDATER_OPERATORS_FOR_LIE_DISTRIBUTION_HEADER
 #define O2AC_POSE_DISTRIBUTION_UPDATER_OPERATORS_FOR_LIE_DISTRIBUTION_HEADER
 
-#include <unsupported/Eigen/MatrixFunctions>
+#include <Eigen/Geometry>
+#include <boost/math/special_functions/factorials.hpp>
+#include <cmath>
 
 // The bijection from R^3 to so(3), the Lie algebra corresponding SO(3)
 template <typename T>
@@ -49,21 +51,251 @@ template <typename T>
 Eigen::Matrix<T, 6, 6>
 Adjoint(const Eigen::Transform<T, 3, Eigen::Isometry> &t) {
   // return a matrix m such that
-  // hat_operator(m * u) = t * hat_operator(u) * t^{-1} for all u in R^6
+  // hat_operator(m * u) = t * hat_operator(u) * t^{-1} for all u in R^6,
+  // which is [R, hat(p) * R; 0, R] for t = [R, p; 0, 1]
+  Eigen::Matrix<T, 3, 3> R = t.linear();
   Eigen::Matrix<T, 6, 6> m;
-  for (int i = 0; i < 6; i++) {
-    Eigen::Matrix<T, 6, 1> unit_vector;
-    for (int j = 0; j < 6; j++) {
-      unit_vector[j] = (i == j ? 1.0 : 0.0);
+  m.template topLeftCorner<3, 3>() = R;
+  m.template topRightCorner<3, 3>() =
+      SO3_hat_operator<T>(Eigen::Matrix<T, 3, 1>(t.translation())) * R;
+  m.template bottomLeftCorner<3, 3>().setZero();
+  m.template bottomRightCorner<3, 3>() = R;
+  return m;
+}
+
+// The closed forms of the exponential map from se(3) to SE(3), its inverse and
+// their Jacobians. They agree with hat_operator(v).exp() and
+// check_operator(t.matrix().log()) by unsupported/Eigen/MatrixFunctions but are
+// much faster. The coefficients are calculated by Taylor series near the
+// identity, where the closed forms lose precision, so they can be
+// differentiated by AutoDiff everywhere.
+
+// Threshold of the squared rotation angle below which Taylor series are used
+const double SE3_TAYLOR_THRESHOLD = 0.1;
+
+constexpr double SE3_factorial(const int n) {
+  return n <= 1 ? 1.0 : n * SE3_factorial(n - 1);
+}
+
+// sum of (-x)^k / (2k + offset)! for k = 0, ..., 5, which is accurate to
+// 1e-15 for 0 <= x < SE3_TAYLOR_THRESHOLD
+template <typename T> T SE3_Taylor_series(const T &x, const int &offset) {
+  T sum = T(0.0);
+  for (int k = 5; k >= 0; k--) {
+    sum = T(1.0 / SE3_factorial(2 * k + offset)) - x * sum;
+  }
+  return sum;
+}
+
+// a = sin(theta) / theta, b = (1 - cos(theta)) / theta^2 and
+// c = (theta - sin(theta)) / theta^3
+template <typename T>
+void SO3_exp_coefficients(const T &theta_squared, T &a, T &b, T &c) {
+  if (theta_squared < T(SE3_TAYLOR_THRESHOLD)) {
+    a = SE3_Taylor_series<T>(theta_squared, 1);
+    b = SE3_Taylor_series<T>(theta_squared, 2);
+    c = SE3_Taylor_series<T>(theta_squared, 3);
+  } else {
+    using std::cos;
+    using std::sin;
+    using std::sqrt;
+    T theta = sqrt(theta_squared);
+    T sin_theta = sin(theta);
+    a = sin_theta / theta;
+    b = (T(1.0) - cos(theta)) / theta_squared;
+    c = (theta - sin_theta) / (theta_squared * theta);
+  }
+}
+
+// The left Jacobian of SO(3), I + b * W + c * W^2 for W = hat(omega)
+template <typename T>
+Eigen::Matrix<T, 3, 3> SO3_left_Jacobian(const Eigen::Matrix<T, 3, 1> &omega) {
+  T a, b, c;
+  SO3_exp_coefficients<T>(omega.squaredNorm(), a, b, c);
+  Eigen::Matrix<T, 3, 3> W = SO3_hat_operator<T>(omega);
+  return Eigen::Matrix<T, 3, 3>::Identity() + b * W + c * W * W;
+}
+
+// The inverse of SO3_left_Jacobian, I - W / 2 + d * W^2 where
+// d = (1 - a / (2 * b)) / theta^2
+template <typename T>
+Eigen::Matrix<T, 3, 3>
+SO3_inverse_left_Jacobian(const Eigen::Matrix<T, 3, 1> &omega) {
+  T theta_squared = omega.squaredNorm();
+  T d;
+  if (theta_squared < T(SE3_TAYLOR_THRESHOLD)) {
+    // d = 1/12 + theta^2/720 + theta^4/30240 + theta^6/1209600 + ...
+    d = T(1.0 / 12.0) +
+        theta_squared *
+            (T(1.0 / 720.0) +
+             theta_squared * (T(1.0 / 30240.0) +
+                              theta_squared * (T(1.0 / 1209600.0) +
+                                               theta_squared / T(47900160.0))));
+  } else {
+    using std::cos;
+    using std::sin;
+    using std::sqrt;
+    T theta = sqrt(theta_squared);
+    d = (T(1.0) - theta * sin(theta) / (T(2.0) * (T(1.0) - cos(theta)))) /
+        theta_squared;
+  }
+  Eigen::Matrix<T, 3, 3> W = SO3_hat_operator<T>(omega);
+  return Eigen::Matrix<T, 3, 3>::Identity() - W / T(2.0) + d * W * W;
+}
+
+template <typename T>
+Eigen::Transform<T, 3, Eigen::Isometry>
+se3_exp(const Eigen::Matrix<T, 6, 1> &v) {
+  // exp(hat_operator(v)) = [R, V * v.head(3); 0, 1] where
+  // R = I + a * W + b * W^2, V = I + b * W + c * W^2 and W = hat(v.tail(3))
+  Eigen::Matrix<T, 3, 1> omega = v.template tail<3>();
+  T a, b, c;
+  SO3_exp_coefficients<T>(omega.squaredNorm(), a, b, c);
+  Eigen::Matrix<T, 3, 3> W = SO3_hat_operator<T>(omega);
+  Eigen::Matrix<T, 3, 3> W_squared = W * W;
+  Eigen::Transform<T, 3, Eigen::Isometry> t;
+  t.linear() = Eigen::Matrix<T, 3, 3>::Identity() + a * W + b * W_squared;
+  t.translation() = (Eigen::Matrix<T, 3, 3>::Identity() + b * W +
+                     c * W_squared) *
+                    v.template head<3>();
+  t.makeAffine();
+  return t;
+}
+
+template <typename T>
+Eigen::Matrix<T, 6, 1>
+se3_log(const Eigen::Transform<T, 3, Eigen::Isometry> &t) {
+  // The inverse of se3_exp for the rotation angle theta in [0, pi]
+  using std::atan2;
+  using std::sqrt;
+  Eigen::Matrix<T, 3, 3> R = t.linear();
+  // 2 * sin(theta) * axis and 2 * cos(theta)
+  Eigen::Matrix<T, 3, 1> twice_sin_axis(R(2, 1) - R(1, 2), R(0, 2) - R(2, 0),
+                                        R(1, 0) - R(0, 1));
+  T cos_theta = (R.trace() - T(1.0)) / T(2.0);
+  T sin_theta_squared = twice_sin_axis.squaredNorm() / T(4.0);
+  Eigen::Matrix<T, 3, 1> omega;
+  if (cos_theta > T(0.0) && sin_theta_squared < T(SE3_TAYLOR_THRESHOLD)) {
+    // theta / sin(theta) = arcsin(y) / y for y = sin(theta), whose Taylor
+    // series is the sum of (2k)! / (4^k (k!)^2 (2k + 1)) y^(2k)
+    T factor = T(1.0), power = T(1.0);
+    double coefficient = 1.0;
+    for (int k = 1; k < 16; k++) {
+      coefficient *= (2 * k - 1) * (2 * k - 1) / (2.0 * k * (2 * k + 1));
+      power *= sin_theta_squared;
+      factor += coefficient * power;
     }
-    m.col(i) = check_operator<T>(t.matrix() * hat_operator<T>(unit_vector) *
-                                 t.inverse().matrix());
+    omega = factor / T(2.0) * twice_sin_axis;
+  } else if (cos_theta < T(0.0) && sin_theta_squared < T(0.25)) {
+    // Near theta = pi, the axis is found from the symmetric part
+    // (R + R^T) / 2 - cos(theta) * I = (1 - cos(theta)) * axis * axis^T, whose
+    // largest diagonal element gives the most accurate column
+    Eigen::Matrix<T, 3, 3> S = (R + R.transpose()) / T(2.0);
+    S.diagonal().array() -= cos_theta;
+    int j = 0;
+    for (int i = 1; i < 3; i++) {
+      if (S(i, i) > S(j, j)) {
+        j = i;
+      }
+    }
+    Eigen::Matrix<T, 3, 1> axis =
+        S.col(j) / sqrt(S(j, j) * (T(1.0) - cos_theta));
+    if (axis.dot(twice_sin_axis) < T(0.0)) {
+      axis = -axis;
+    }
+    omega = atan2(sqrt(sin_theta_squared), cos_theta) * axis;
+  } else {
+    T sin_theta = sqrt(sin_theta_squared);
+    omega = atan2(sin_theta, cos_theta) / (T(2.0) * sin_theta) * twice_sin_axis;
+  }
+  Eigen::Matrix<T, 6, 1> v;
+  v.template head<3>() = SO3_inverse_left_Jacobian<T>(omega) * t.translation();
+  v.template tail<3>() = omega;
+  return v;
+}
+
+// The upper right block Q of the left Jacobian of SE(3)
+// (T. D. Barfoot, "State Estimation for Robotics", (7.86))
+template <typename T>
+Eigen::Matrix<T, 3, 3> SE3_left_Jacobian_Q(const Eigen::Matrix<T, 6, 1> &v) {
+  Eigen::Matrix<T, 3, 1> omega = v.template tail<3>();
+  T theta_squared = omega.squaredNorm();
+  // c = (theta - sin(theta)) / theta^3,
+  // e = (theta^2 + 2 * cos(theta) - 2) / (2 * theta^4) and
+  // f = (2 * theta - 3 * sin(theta) + theta * cos(theta)) / (2 * theta^5)
+  T c, e, f;
+  if (theta_squared < T(SE3_TAYLOR_THRESHOLD)) {
+    c = SE3_Taylor_series<T>(theta_squared, 3);
+    e = SE3_Taylor_series<T>(theta_squared, 4);
+    // f is the sum of (-x)^k (k + 1) / (2k + 5)!
+    f = T(0.0);
+    for (int k = 5; k >= 0; k--) {
+      f = T((k + 1) / SE3_factorial(2 * k + 5)) - theta_squared * f;
+    }
+  } else {
+    using std::cos;
+    using std::sin;
+    using std::sqrt;
+    T theta = sqrt(theta_squared);
+    T sin_theta = sin(theta), cos_theta = cos(theta);
+    T theta_fourth = theta_squared * theta_squared;
+    c = (theta - sin_theta) / (theta_squared * theta);
+    e = (theta_squared + T(2.0) * cos_theta - T(2.0)) / (T(2.0) * theta_fourth);
+    f = (T(2.0) * theta - T(3.0) * sin_theta + theta * cos_theta) /
+        (T(2.0) * theta_fourth * theta);
   }
+  Eigen::Matrix<T, 3, 3> W = SO3_hat_operator<T>(omega);
+  Eigen::Matrix<T, 3, 3> P =
+      SO3_hat_operator<T>(Eigen::Matrix<T, 3, 1>(v.template head<3>()));
+  Eigen::Matrix<T, 3, 3> WP = W * P, PW = P * W, WPW = WP * W;
+  return P / T(2.0) + c * (WP + PW + WPW) +
+         e * (W * WP + PW * W - T(3.0) * WPW) + f * (WPW * W + W * WPW);
+}
+
+// The left Jacobian of SE(3), the sum of adjoint(v)^n / (n + 1)!, which is
+// [J, Q; 0, J] for the left Jacobian J of SO(3)
+template <typename T>
+Eigen::Matrix<T, 6, 6> se3_left_Jacobian(const Eigen::Matrix<T, 6, 1> &v) {
+  Eigen::Matrix<T, 6, 6> m;
+  m.template topLeftCorner<3, 3>() = m.template bottomRightCorner<3, 3>() =
+      SO3_left_Jacobian<T>(Eigen::Matrix<T, 3, 1>(v.template tail<3>()));
+  m.template topRightCorner<3, 3>() = SE3_left_Jacobian_Q<T>(v);
+  m.template bottomLeftCorner<3, 3>().setZero();
   return m;
 }
 
+// The inverse of se3_left_Jacobian, which is equal to
+// Bernoulli_series(adjoint(v)) and [J^{-1}, -J^{-1} Q J^{-1}; 0, J^{-1}]
+template <typename T>
+Eigen::Matrix<T, 6, 6>
+se3_inverse_left_Jacobian(const Eigen::Matrix<T, 6, 1> &v) {
+  Eigen::Matrix<T, 3, 1> omega = v.template tail<3>();
+  Eigen::Matrix<T, 3, 3> J_inverse = SO3_inverse_left_Jacobian<T>(omega);
+  Eigen::Matrix<T, 6, 6> m;
+  m.template topLeftCorner<3, 3>() = m.template bottomRightCorner<3, 3>() =
+      J_inverse;
+  m.template topRightCorner<3, 3>() =
+      -J_inverse * SE3_left_Jacobian_Q<T>(v) * J_inverse;
+  m.template bottomLeftCorner<3, 3>().setZero();
+  return m;
+}
+
+// The right Jacobians, such that
+// exp(v + dv) = exp(v) * exp(se3_right_Jacobian(v) * dv) and
+// log(exp(v) * exp(dv)) = v + se3_inverse_right_Jacobian(v) * dv
+// for small dv
+template <typename T>
+Eigen::Matrix<T, 6, 6> se3_right_Jacobian(const Eigen::Matrix<T, 6, 1> &v) {
+  return se3_left_Jacobian<T>(Eigen::Matrix<T, 6, 1>(-v));
+}
+
+template <typename T>
+Eigen::Matrix<T, 6, 6>
+se3_inverse_right_Jacobian(const Eigen::Matrix<T, 6, 1> &v) {
+  return se3_inverse_left_Jacobian<T>(Eigen::Matrix<T, 6, 1>(-v));
+}
+
 #include <boost/math/special_functions/bernoulli.hpp>
-#include <boost/math/special_functions/factorials.hpp>
 
 const int MAX_N = 20;
 
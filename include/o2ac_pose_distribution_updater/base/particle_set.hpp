@@ -0,0 +1,86 @@
+/*
+A set of weighted particles stored as structure of arrays
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_PARTICLE_SET_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_PARTICLE_SET_HEADER
+
+#include "o2ac_pose_distribution_updater/base/conversions.hpp"
+
+template <typename PoseScalar> class BasicParticleSet {
+  // Each quantity of the particles is stored in a column-major matrix, so the
+  // i-th particle is the i-th column. The columns are contiguous and aligned,
+  // which lets Eigen vectorize the loops over particles. Eigen::Isometry3d and
+  // fcl::Transform3f of a particle are not stored but built on demand from
+  // 'rotations' and 'translations'.
+  // The poses are stored as 'PoseScalar'. They are only inputs of the
+  // calculations of the likelihoods, so float is accurate enough for them and
+  // halves their memory and doubles the lanes of the batch exponential. The
+  // sampled vectors and the weights, from which the distributions are
+  // accumulated, are always double, and the accessors of the poses return
+  // double.
+
+public:
+  using Scalar = PoseScalar;
+  using TangentMatrix = Eigen::Matrix<double, 6, Eigen::Dynamic>;
+  using RotationMatrix = Eigen::Matrix<PoseScalar, 9, Eigen::Dynamic>;
+  using TranslationMatrix = Eigen::Matrix<PoseScalar, 3, Eigen::Dynamic>;
+
+  // Sampled vectors: RPY particles, or vectors of the Lie algebra for the
+  // Lie distribution
+  TangentMatrix tangents;
+  // Poses of the particles: column-major 3x3 rotation matrices and
+  // translations
+  RotationMatrix rotations;
+  TranslationMatrix translations;
+  // Weights of the particles, which are likelihoods before normalization
+  Eigen::VectorXd weights;
+
+  int size() const { return weights.size(); }
+
+  // The first particles are kept when the set grows
+  void resize(const int &number_of_particles) {
+    if (size() != number_of_particles) {
+      tangents.conservativeResize(Eigen::NoChange, number_of_particles);
+      rotations.conservativeResize(Eigen::NoChange, number_of_particles);
+      translations.conservativeResize(Eigen::NoChange, number_of_particles);
+      weights.conservativeResize(number_of_particles);
+    }
+  }
+
+  Eigen::Matrix3d rotation(const int &i) const {
+    return Eigen::Map<const Eigen::Matrix<PoseScalar, 3, 3>>(
+               rotations.col(i).data())
+        .template cast<double>();
+  }
+
+  Eigen::Vector3d translation(const int &i) const {
+    return translations.col(i).template cast<double>();
+  }
+
+  Eigen::Isometry3d transform(const int &i) const {
+    Eigen::Isometry3d t;
+    t.linear() = rotation(i);
+    t.translation() = translation(i);
+    t.makeAffine();
+    return t;
+  }
+
+  void set_transform(const int &i, const Eigen::Isometry3d &t) {
+    Eigen::Map<Eigen::Matrix<PoseScalar, 3, 3>>(rotations.col(i).data()) =
+        t.linear().template cast<PoseScalar>();
+    translations.col(i) = t.translation().template cast<PoseScalar>();
+  }
+};
+
+// The scalar of the poses of the particles of the estimator, which is float
+// if the package is compiled with O2AC_FLOAT_PARTICLE_POSES (the CMake option
+// USE_FLOAT_PARTICLE_POSES)
+#ifdef O2AC_FLOAT_PARTICLE_POSES
+using ParticlePoseScalar = float;
+#else
+using ParticlePoseScalar = double;
+#endif
+
+using ParticleSet = BasicParticleSet<ParticlePoseScalar>;
+
+#endif
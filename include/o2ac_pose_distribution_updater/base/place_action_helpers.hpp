@@ -4,17 +4,21 @@ Helper functions for the place action
 
 #include <Eigen/Geometry>
 
+#include "o2ac_pose_distribution_updater/base/action_workspace.hpp"
 #include "o2ac_pose_distribution_updater/base/conversions.hpp"
 #include "o2ac_pose_distribution_updater/base/operators_for_Lie_distribution.hpp"
 #include <unsupported/Eigen/AutoDiff>
 
-void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
-                       const Eigen::Vector3d &current_center_of_gravity,
-                       int &ground_touch_vertex_id_1,
-                       int &ground_touch_vertex_id_2,
-                       int &ground_touch_vertix_id_3,
-                       Eigen::Quaterniond &rotation, bool &stability,
-                       const bool balance_check = true);
+// Returns the balanced status if the rotation is not determined and
+// balance_check is true, and success_status otherwise
+action_status
+find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
+                  const Eigen::Vector3d &current_center_of_gravity,
+                  int &ground_touch_vertex_id_1, int &ground_touch_vertex_id_2,
+                  int &ground_touch_vertix_id_3, Eigen::Quaterniond &rotation,
+                  bool &stability, const bool balance_check = true,
+                  const bool stability_check = true,
+                  ActionWorkspace *workspace = nullptr);
 
 void place_update_distribution(const Particle &old_mean,
                                const CovarianceMatrix &old_covariance,
@@ -39,13 +43,29 @@ public:
       new_mean; // The gripper transform, the mean transform before placing, the
                 // mean transform after placing
 
+  place_calculator() {}
+
+  // constructor, which calculates new_mean and throws std::runtime_error if
+  // the object cannot be placed
   place_calculator(const Eigen::Isometry3d &old_mean,
                    const Eigen::Vector3d &center_of_gravity,
                    const std::vector<Eigen::Vector3d> &vertices,
                    const double &support_surface,
                    const Eigen::Isometry3d &gripper_transform,
                    const bool balance_check = true,
-                   const bool stability_check = true);
+                   const bool stability_check = true,
+                   ActionWorkspace *workspace = nullptr);
+
+  // calculates new_mean, and returns the reason of the failure instead of
+  // throwing it
+  action_status calculate(const Eigen::Isometry3d &old_mean,
+                          const Eigen::Vector3d &center_of_gravity,
+                          const std::vector<Eigen::Vector3d> &vertices,
+                          const double &support_surface,
+                          const Eigen::Isometry3d &gripper_transform,
+                          const bool balance_check = true,
+                          const bool stability_check = true,
+                          ActionWorkspace *workspace = nullptr);
 };
 
 void place_update_Lie_distribution(const Eigen::Isometry3d &old_mean,
@@ -56,3 +76,10 @@ void place_update_Lie_distribution(const Eigen::Isometry3d &old_mean,
                                    const Eigen::Isometry3d &gripper_transform,
                                    Eigen::Isometry3d &new_mean,
                                    CovarianceMatrix &new_covariance);
+
+// The derivative of the translation after placing by that before placing when
+// the rotation before placing is fixed. The x and y-coordinates of the center
+// of gravity in the gripper coordinates are kept, and the z-coordinate is
+// determined by the support surface.
+Eigen::Matrix3d
+place_translation_Jacobian(const Eigen::Isometry3d &gripper_transform);
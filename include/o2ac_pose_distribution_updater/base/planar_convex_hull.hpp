@@ -0,0 +1,34 @@
+/*
+Convex hulls of points in the plane for the per-particle calculations, which
+work in the buffers of the caller and decide the orientations exactly
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_PLANAR_CONVEX_HULL_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_PLANAR_CONVEX_HULL_HEADER
+
+#include <Eigen/Geometry>
+#include <vector>
+
+// The sign of the orientation of the triangle (a, b, c), which is 1 if it is
+// counterclockwise, -1 if it is clockwise and 0 if the points are collinear.
+// The determinant is calculated by doubles and recalculated exactly only if
+// its sign is not certain.
+int orientation_2d(const Eigen::Vector2d &a, const Eigen::Vector2d &b,
+                   const Eigen::Vector2d &c);
+
+// The vertices of the convex hull of the points, counterclockwise from the
+// lexicographically smallest one, by the monotone chain algorithm. The points
+// are sorted in place. The collinear points on the boundary are not included.
+void calculate_planar_convex_hull(std::vector<Eigen::Vector2d> &points,
+                                  std::vector<Eigen::Vector2d> &hull);
+
+// Whether the point is strictly inside the convex polygon, whose vertices are
+// counterclockwise as given by calculate_planar_convex_hull, in O(log n) time
+bool is_inside_convex_polygon(const Eigen::Vector2d &point,
+                              const std::vector<Eigen::Vector2d> &hull);
+
+// Whether the convex polygons intersect, including their boundaries. The
+// polygons may be a point or a segment.
+bool do_intersect_convex_polygons(const std::vector<Eigen::Vector2d> &hull_0,
+                                  const std::vector<Eigen::Vector2d> &hull_1);
+
+#endif
@@ -29,12 +29,11 @@ using GoalChecker =
 
 class Planner : public PoseEstimator {
 private:
-  std::shared_ptr<mesh_object> gripped_geometry;
+  // the center of gravity, the convex hull and the place candidates of the
+  // gripped object are prepared once by set_geometry
+  PreparedObjectPtr gripped_object;
   std::shared_ptr<std::vector<Eigen::Isometry3d>> grasp_points;
   double support_surface;
-  Eigen::Vector3d center_of_gravity;
-  std::vector<Eigen::Hyperplane<double, 3>> place_candidates;
-  std::vector<Eigen::Vector3d> convex_hull_vertices;
 
   std::shared_ptr<ValidityChecker> validity_checker =
       std::make_shared<ValidityChecker>(
@@ -53,17 +52,13 @@ private:
   std::shared_ptr<GoalChecker> goal_checker = std::make_shared<GoalChecker>(
       [](const bool &gripping, const Eigen::Isometry3d &pose) { return true; });
 
-  void apply_action(const Eigen::Isometry3d &old_mean,
-                    const CovarianceMatrix &old_covariance,
-                    const UpdateAction &action, Eigen::Isometry3d &new_mean,
-                    CovarianceMatrix &new_covariance);
-
+  // The random choices of the candidates are drawn from 'stream'
   void
   calculate_action_candidates(const Eigen::Isometry3d &current_gripper_pose,
                               const Eigen::Isometry3d &current_mean,
                               const CovarianceMatrix &current_covariance,
-                              const bool &gripping,
-                              std::vector<UpdateAction> &candidates);
+                              const bool &gripping, RandomStream &stream,
+                              std::vector<UpdateAction> &candidates) const;
 
 public:
   bool use_BFS = false;
@@ -86,6 +81,32 @@ public:
       const std::shared_ptr<std::vector<Eigen::Isometry3d>> &grasp_points,
       const double &support_surface);
 
+  // The object prepared by prepare_object can be shared with the estimator
+  void set_geometry(
+      const PreparedObjectPtr &gripped_object,
+      const std::shared_ptr<std::vector<Eigen::Isometry3d>> &grasp_points,
+      const double &support_surface);
+
+  // The planning functions taking a context keep all the state of the search
+  // in it, including the random choices of the candidates, so plans with
+  // different contexts run concurrently on one planner, and a plan with a new
+  // context gives the same result on any thread. The others use the default
+  // context.
+  void apply_action(EstimatorContext &context,
+                    const Eigen::Isometry3d &old_mean,
+                    const CovarianceMatrix &old_covariance,
+                    const UpdateAction &action, Eigen::Isometry3d &new_mean,
+                    CovarianceMatrix &new_covariance) const;
+
+  std::vector<UpdateAction>
+  calculate_plan(EstimatorContext &context,
+                 const Eigen::Isometry3d &current_gripper_pose,
+                 const bool &current_gripping,
+                 const Eigen::Isometry3d &current_mean,
+                 const CovarianceMatrix &current_covariance,
+                 const CovarianceMatrix &objective_coefficients,
+                 const double &objective_value) const;
+
   std::vector<UpdateAction>
   calculate_plan(const Eigen::Isometry3d &current_gripper_pose,
                  const bool &current_gripping,
@@ -94,6 +115,15 @@ public:
                  const CovarianceMatrix &objective_coefficients,
                  const double &objective_value);
 
+  std::vector<std::pair<double, std::vector<UpdateAction>>>
+  best_scores_for_each_costs(EstimatorContext &context,
+                             const Eigen::Isometry3d &current_gripper_pose,
+                             const bool &current_gripping,
+                             const Eigen::Isometry3d &current_mean,
+                             const CovarianceMatrix &current_covariance,
+                             const CovarianceMatrix &objective_coefficients,
+                             const int &max_cost) const;
+
   std::vector<std::pair<double, std::vector<UpdateAction>>>
   best_scores_for_each_costs(const Eigen::Isometry3d &current_gripper_pose,
                              const bool &current_gripping,
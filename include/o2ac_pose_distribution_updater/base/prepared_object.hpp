@@ -0,0 +1,114 @@
+/*
+The data derived from the mesh of an object, which are calculated once by
+prepare_object and shared by the steps of the estimator and the planner
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_PREPARED_OBJECT_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_PREPARED_OBJECT_HEADER
+
+#include <Eigen/Geometry>
+#include <boost/array.hpp>
+#include <fcl/BVH/BVH_model.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using object_geometry = fcl::BVHModel<fcl::OBBRSS>;
+using object_geometry_ptr = std::shared_ptr<object_geometry>;
+
+// The edges of the triangles of a mesh. The k-th half-edge of the t-th
+// triangle, whose index is 3 * t + k, goes from triangles[t][k] to
+// triangles[t][(k + 1) % 3].
+struct MeshConnectivity {
+  // the pairs of the vertices (a, b) of the edges with a < b
+  std::vector<std::pair<int, int>> edges;
+  // the index of the edge of each half-edge
+  std::vector<int> half_edges;
+};
+
+// The convex hull of the vertices of an object
+struct ConvexHull {
+  std::vector<Eigen::Vector3d> vertices;
+  // the index of each vertex of the hull in the vertices of the object
+  std::vector<int> vertex_indices;
+  // the triangles of the boundary, counterclockwise seen from the outside
+  std::vector<boost::array<int, 3>> faces;
+  // the sorted indices of the vertices joined to each vertex by an edge
+  std::vector<std::vector<int>> adjacency;
+  // The start vertices of find_support_vertex. The directions are divided by
+  // the faces of a cube and a grid on each face, and each cell has the vertex
+  // maximizing the inner product with the direction of its center.
+  std::vector<int> support_starts;
+};
+
+struct PreparedObject {
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  Eigen::Vector3d center_of_gravity;
+  // the model for the distance calculation of the touch action, which is not
+  // modified after the preparation
+  object_geometry_ptr geometry;
+  MeshConnectivity connectivity;
+  ConvexHull convex_hull;
+  // the planes of the convex hull on which the object can be placed stably
+  std::vector<Eigen::Hyperplane<double, 3>> place_candidates;
+};
+
+// The object is immutable once prepared, so it is shared by const pointers
+using PreparedObjectPtr = std::shared_ptr<const PreparedObject>;
+
+// The parts of an object used by the place, grasp and push steps of the
+// estimator, which refer to a prepared object or to a mesh. The center of
+// gravity of a mesh is calculated on construction. The grasp and push steps
+// truncate the object by its connectivity, which the caller calculates once
+// per step for a mesh.
+//
+// Only the vertices of the convex hull can touch the ground or the gripper
+// first, so the calculators scan hull_vertices instead of all the vertices.
+// They are the vertices of the convex hull of a prepared object, and all the
+// vertices of a mesh, whose hull is not calculated at each step.
+struct ObjectParts {
+  explicit ObjectParts(const PreparedObject &object);
+  ObjectParts(const std::vector<Eigen::Vector3d> &vertices,
+              const std::vector<boost::array<int, 3>> &triangles,
+              const MeshConnectivity *connectivity = nullptr);
+
+  const std::vector<Eigen::Vector3d> &vertices;
+  const std::vector<boost::array<int, 3>> &triangles;
+  const std::vector<Eigen::Vector3d> &hull_vertices;
+  // null for a mesh unless given
+  const MeshConnectivity *connectivity;
+  // null for a mesh
+  const ConvexHull *convex_hull;
+  Eigen::Vector3d center_of_gravity;
+};
+
+PreparedObjectPtr
+prepare_object(const std::vector<Eigen::Vector3d> &vertices,
+               const std::vector<boost::array<int, 3>> &triangles);
+
+void make_BVHModel(object_geometry_ptr &bvhmodel,
+                   const std::vector<Eigen::Vector3d> &vertices,
+                   const std::vector<boost::array<int, 3>> &triangles);
+
+void calculate_mesh_connectivity(
+    const std::vector<boost::array<int, 3>> &triangles,
+    MeshConnectivity &connectivity);
+
+void calculate_convex_hull(const std::vector<Eigen::Vector3d> &vertices,
+                           ConvexHull &hull);
+
+// The index of a vertex of the hull maximizing the inner product with the
+// direction. It climbs along the edges from the start vertex of the cell of
+// the direction, which is near the answer, to a vertex without a better
+// neighbor, which is a maximum since the hull is convex.
+int find_support_vertex(const ConvexHull &hull,
+                        const Eigen::Vector3d &direction);
+
+// The planes of the facets of the hull such that the projection of the center
+// of gravity is inside the facet. The facets with the same normal vector are
+// merged.
+void calculate_place_candidates(
+    const ConvexHull &hull, const Eigen::Vector3d &center_of_gravity,
+    std::vector<Eigen::Hyperplane<double, 3>> &candidates);
+
+#endif
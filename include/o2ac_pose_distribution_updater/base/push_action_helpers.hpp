@@ -4,16 +4,11 @@ Helper functions for the push action
 
 #include <Eigen/Geometry>
 
+#include "o2ac_pose_distribution_updater/base/action_workspace.hpp"
 #include "o2ac_pose_distribution_updater/base/conversions.hpp"
 #include "o2ac_pose_distribution_updater/base/operators_for_Lie_distribution.hpp"
 #include <unsupported/Eigen/AutoDiff>
 
-void cutting_object(const std::vector<Eigen::Vector3d> &vertices,
-                    const std::vector<boost::array<int, 3>> &triangles,
-                    const Eigen::Hyperplane<double, 3> &plane,
-                    std::vector<Eigen::Vector3d> &result_vertices,
-                    std::vector<boost::array<int, 3>> &result_triangles);
-
 class push_calculator {
 public:
   // data for calculating the pose
@@ -27,12 +22,26 @@ public:
   int first_direction;
   Eigen::Isometry3d rotated_gripper_transform, old_mean, new_mean;
 
-  // constructor, which calculates new_mean
+  push_calculator() {}
+
+  // constructor, which calculates new_mean and throws std::runtime_error if
+  // the object cannot be pushed
   push_calculator(const std::vector<Eigen::Vector3d> &vertices,
                   const Eigen::Isometry3d &gripper_transform,
                   const Eigen::Isometry3d &old_mean,
                   const Eigen::Vector3d &center_of_gravity,
-                  const double &gripper_width, const bool balance_check = true);
+                  const double &gripper_width, const bool balance_check = true,
+                  ActionWorkspace *workspace = nullptr);
+
+  // calculates new_mean, and returns the reason of the failure instead of
+  // throwing it
+  action_status calculate(const std::vector<Eigen::Vector3d> &vertices,
+                          const Eigen::Isometry3d &gripper_transform,
+                          const Eigen::Isometry3d &old_mean,
+                          const Eigen::Vector3d &center_of_gravity,
+                          const double &gripper_width,
+                          const bool balance_check = true,
+                          ActionWorkspace *workspace = nullptr);
 
   // provide function to calculate the pose after pushing given a initial pose
   // in the neighborhood of old_mean
@@ -49,3 +58,10 @@ void push_update_Lie_distribution(const Eigen::Isometry3d &old_mean,
                                   const double &gripper_width,
                                   Eigen::Isometry3d &new_mean,
                                   CovarianceMatrix &new_covariance);
+
+// The derivative of the translation after pushing by that before pushing when
+// the rotation before pushing is fixed. The x-coordinate of the object in the
+// rotated gripper coordinates is determined by the gripper, and the y and
+// z-coordinates are kept. The change of the truncated object is ignored.
+Eigen::Matrix3d
+push_translation_Jacobian(const Eigen::Isometry3d &gripper_transform);
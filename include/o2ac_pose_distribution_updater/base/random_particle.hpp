@@ -1,5 +1,91 @@
+/*
+Random number generators
+
+RandomStream is a counter-based generator (Philox4x32-10). Its output is
+determined only by (seed, step, stream_id), so particles can be sampled in any
+order and on any thread with the same results.
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_RANDOM_PARTICLE_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_RANDOM_PARTICLE_HEADER
+
 #include "o2ac_pose_distribution_updater/base/conversions.hpp"
+#include <array>
+#include <cstdint>
+
+class RandomStream {
+public:
+  // 'seed' selects the whole random sequence, 'step' is the id of the update
+  // step and 'stream_id' is the index of the particle in the step.
+  RandomStream(const std::uint64_t &seed, const std::uint64_t &step,
+               const std::uint32_t &stream_id);
+
+  // The next 128 random bits
+  std::array<std::uint32_t, 4> next_block();
+  std::uint32_t next_uint32();
+  std::uint64_t next_uint64();
+
+  // uniform distribution on the open interval (0, 1)
+  double uniform();
+  // uniform distribution on the integers in [0, range)
+  std::uint64_t uniform_int(const std::uint64_t &range);
+  // normal distribution with mean 0.0, variance 1.0
+  double normal();
+
+  template <int D> Eigen::Matrix<double, D, 1> normal_vector() {
+    Eigen::Matrix<double, D, 1> p;
+    for (int i = 0; i < D; i++) {
+      p(i) = normal();
+    }
+    return p;
+  }
+
+private:
+  std::array<std::uint32_t, 2> key;
+  std::array<std::uint32_t, 4> counter;
 
+  // unused words of the last block
+  std::array<std::uint32_t, 4> buffer;
+  int buffer_position;
+
+  // Box-Muller transform produces two values at once
+  bool has_spare_normal;
+  double spare_normal;
+};
+
+Particle get_UND_particle(RandomStream &stream);
+Eigen::Vector3d get_UND_Vector3d(RandomStream &stream);
+std::vector<int> get_random_array(int length, int range, RandomStream &stream);
+
+// The 'index'-th point of the 6-dimensional Sobol sequence, scrambled by the
+// nested uniform scrambling keyed by (seed, step) and mapped by the inverse of
+// the cumulative distribution function of the normal distribution. The points
+// of one step follow the multivariate normal distribution with mean 0 and
+// covariance the identity matrix, but cover the space more evenly than
+// independent samples, especially when the number of points is a power of 2.
+Particle get_QMC_UND_particle(const std::uint64_t &seed,
+                              const std::uint64_t &step,
+                              const std::uint32_t &index);
+
+// Indices of 'number_of_samples' particles drawn with the probabilities
+// proportional to 'weights', sorted in increasing order. The points
+// (u + k) / number_of_samples for a single uniform u select the particles, so
+// the i-th particle is drawn floor(n * w_i) or ceil(n * w_i) times where n is
+// the number of samples and w_i is the normalized weight.
+std::vector<int>
+get_systematic_resampling_indices(const Eigen::VectorXd &weights,
+                                  const int &number_of_samples,
+                                  RandomStream &stream);
+// The i-th particle is drawn floor(n * w_i) times first, and the remaining
+// samples are drawn systematically with the weights n * w_i - floor(n * w_i)
+std::vector<int>
+get_residual_resampling_indices(const Eigen::VectorXd &weights,
+                                const int &number_of_samples,
+                                RandomStream &stream);
+
+// The following functions draw from a process-wide sequence of streams. They
+// are thread-safe, but the results depend on the order of calls.
 Particle get_UND_particle();
 Eigen::Vector3d get_UND_Vector3d();
 std::vector<int> get_random_array(int length, int range);
+
+#endif
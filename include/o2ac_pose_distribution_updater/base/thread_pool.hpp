@@ -0,0 +1,104 @@
+/*
+A pool of worker threads which evaluates particles in parallel chunks
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_THREAD_POOL_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_THREAD_POOL_HEADER
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename Signature> class FunctionRef;
+
+template <typename R, typename... Args> class FunctionRef<R(Args...)> {
+  // A reference to a callable object. Unlike std::function, it neither copies
+  // the callable nor allocates memory, so the tasks of the thread pool and
+  // the evaluations of the particles are passed without heap allocations.
+  // The referenced callable must outlive the reference, which holds for the
+  // arguments of a function call.
+
+public:
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, FunctionRef>::value>::type>
+  FunctionRef(F &&f)
+      : object(const_cast<void *>(
+            static_cast<const void *>(std::addressof(f)))),
+        call(&invoke<typename std::remove_reference<F>::type>) {}
+
+  R operator()(Args... args) const {
+    return call(object, std::forward<Args>(args)...);
+  }
+
+private:
+  template <typename F> static R invoke(void *object, Args... args) {
+    return (*static_cast<F *>(object))(std::forward<Args>(args)...);
+  }
+
+  void *object;
+  R (*call)(void *, Args...);
+};
+
+class ThreadPool {
+  // The range [0, n) is split into chunks of a fixed size and the chunks are
+  // handed to the workers. Since the split does not depend on the number of
+  // threads, the results are the same for any number of threads as long as
+  // each chunk writes only to its own indices and the partial results are
+  // combined in the order of chunks.
+
+public:
+  // A task receives the range [begin, end) and the id of the worker executing
+  // it. The worker id is in [0, get_number_of_threads()) and can be used to
+  // select per-thread buffers.
+  using ChunkTask = FunctionRef<void(const int &begin, const int &end,
+                                      const int &worker_id)>;
+
+  explicit ThreadPool(const int &number_of_threads = 1);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  int get_number_of_threads() const { return workers.size() + 1; }
+
+  // Execute 'task' on all chunks of [0, n). If some chunks throw exceptions,
+  // the exception thrown by the chunk with the smallest index is rethrown
+  // after all chunks are finished.
+  // This can be called from several threads at once. If the workers are busy
+  // with the job of another thread, the calling thread executes all chunks by
+  // itself as the worker 0 instead of waiting, so the tasks of different
+  // threads must not share the buffers selected by the worker id.
+  void parallel_for(const int &n, const int &chunk_size, const ChunkTask &task);
+
+private:
+  std::vector<std::thread> workers; // the calling thread is the worker 0
+
+  std::mutex job_mutex; // held by the thread whose job the workers execute
+  std::mutex mutex;
+  std::condition_variable job_condition, finish_condition;
+
+  // The current job
+  const ChunkTask *task;
+  int n, chunk_size, number_of_chunks;
+  std::atomic<int> next_chunk;
+  unsigned long generation;
+  int running_workers;
+  bool stopping;
+
+  int failed_chunk;
+  std::exception_ptr failure;
+
+  void worker_loop(const int &worker_id);
+  void execute_chunks(const int &worker_id);
+};
+
+// The number of threads used when 0 is given as the number of threads
+int default_number_of_threads();
+
+#endif
@@ -0,0 +1,113 @@
+/*
+A single-pass accumulator of the weighted mean and covariance of vectors
+ */
+#ifndef O2AC_POSE_DISTRIBUTION_UPDATER_WEIGHTED_MOMENTS_HEADER
+#define O2AC_POSE_DISTRIBUTION_UPDATER_WEIGHTED_MOMENTS_HEADER
+
+#include <Eigen/Core>
+#include <cmath>
+#include <limits>
+
+template <int N> class WeightedMomentAccumulator {
+  // The weights are given by their logarithms. They are stored relative to
+  // the largest logarithm seen so far, so that the likelihoods of sharply
+  // peaked distributions, which underflow as doubles, are combined without
+  // loss. The mean and the sum of weighted squared deviations are updated by
+  // the weighted version of Welford's algorithm (West, "Updating mean and
+  // variance estimates: an improved method", 1979), and two accumulators are
+  // merged by the formula of Chan, Golub and LeVeque, so the moments of
+  // chunks evaluated in parallel are combined without a second pass.
+
+public:
+  using Vector = Eigen::Matrix<double, N, 1>;
+  using Matrix = Eigen::Matrix<double, N, N>;
+
+  WeightedMomentAccumulator()
+      : max_log_weight(-std::numeric_limits<double>::infinity()),
+        sum_of_weights(0.0), sum_of_squared_weights(0.0),
+        weighted_mean(Vector::Zero()),
+        sum_of_squared_deviations(Matrix::Zero()) {}
+
+  // Vectors of the weight 0, i.e. log_weight == -infinity, are ignored
+  void add(const Vector &x, const double &log_weight) {
+    if (!(log_weight > -std::numeric_limits<double>::infinity())) {
+      return;
+    }
+    rescale(log_weight);
+    double weight = std::exp(log_weight - max_log_weight);
+    sum_of_weights += weight;
+    sum_of_squared_weights += weight * weight;
+    Vector deviation = x - weighted_mean;
+    weighted_mean += (weight / sum_of_weights) * deviation;
+    sum_of_squared_deviations +=
+        (weight * (1.0 - weight / sum_of_weights)) * deviation *
+        deviation.transpose();
+  }
+
+  void merge(const WeightedMomentAccumulator &other) {
+    if (other.empty()) {
+      return;
+    }
+    rescale(other.max_log_weight);
+    double scale = std::exp(other.max_log_weight - max_log_weight);
+    double other_sum_of_weights = scale * other.sum_of_weights;
+    double total = sum_of_weights + other_sum_of_weights;
+    Vector deviation = other.weighted_mean - weighted_mean;
+    weighted_mean += (other_sum_of_weights / total) * deviation;
+    sum_of_squared_deviations +=
+        scale * other.sum_of_squared_deviations +
+        (sum_of_weights * other_sum_of_weights / total) * deviation *
+            deviation.transpose();
+    sum_of_weights = total;
+    sum_of_squared_weights += scale * scale * other.sum_of_squared_weights;
+  }
+
+  bool empty() const { return !(sum_of_weights > 0.0); }
+
+  // log of the sum of weights, -infinity if no vector has a positive weight
+  double log_sum_of_weights() const {
+    return empty() ? -std::numeric_limits<double>::infinity()
+                   : max_log_weight + std::log(sum_of_weights);
+  }
+
+  // (sum of weights)^2 / (sum of squared weights)
+  double effective_sample_size() const {
+    return empty() ? 0.0
+                   : sum_of_weights * sum_of_weights / sum_of_squared_weights;
+  }
+
+  const Vector &mean() const { return weighted_mean; }
+
+  // The unbiased covariance for the weights of reliability, i.e. with
+  // Bessel's correction 1 - (sum of squared weights) / (sum of weights)^2.
+  // It is not finite if the effective sample size is 1.
+  Matrix covariance() const {
+    return sum_of_squared_deviations /
+           (sum_of_weights - sum_of_squared_weights / sum_of_weights);
+  }
+
+private:
+  // Make 'max_log_weight' at least 'log_weight'
+  void rescale(const double &log_weight) {
+    if (log_weight <= max_log_weight) {
+      return;
+    }
+    if (!empty()) {
+      double scale = std::exp(max_log_weight - log_weight);
+      sum_of_weights *= scale;
+      sum_of_squared_weights *= scale * scale;
+      sum_of_squared_deviations *= scale;
+    }
+    max_log_weight = log_weight;
+  }
+
+  double max_log_weight;
+  // The sums of exp(log_weight - max_log_weight) and its square
+  double sum_of_weights, sum_of_squared_weights;
+  Vector weighted_mean;
+  // The sum of weight * (x - mean) * (x - mean)^T, in the same scale as
+  // sum_of_weights
+  Matrix sum_of_squared_deviations;
+};
+
+#endif
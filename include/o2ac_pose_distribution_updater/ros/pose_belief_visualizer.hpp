@@ -22,6 +22,10 @@ private:
 
   int number_of_particles;
 
+  // The particles of the i-th visualization are sampled from the streams
+  // (random_seed, i, particle index)
+  std::uint64_t random_seed, visualization_step;
+
   void make_marker_from_particle(
       const std_msgs::Header &header,
       const std::vector<geometry_msgs::Point> &triangle_list,
@@ -42,6 +46,9 @@ public:
     // initialize the object id
     object_namespace = "pose_belief";
     object_id = 0;
+
+    random_seed = 0;
+    visualization_step = 0;
   }
   // functions to set the parameters
   void set_scale(const double &x, const double &y, const double &z) {
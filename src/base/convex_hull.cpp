@@ -8,13 +8,18 @@ CGAL convex_hull_2 is used since boost::geometry convex_hull is not robust
 #include <CGAL/Boolean_set_operations_2.h>
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Polygon_2.h>
+#include <CGAL/Polyhedron_3.h>
 #include <CGAL/convex_hull_2.h>
+#include <CGAL/convex_hull_3.h>
 #include <algorithm>
 #include <boost/geometry/geometries/polygon.hpp>
+#include <map>
 
 using CGAL_Kernel = CGAL::Exact_predicates_inexact_constructions_kernel;
 using CGAL_Point_2 = CGAL_Kernel::Point_2;
 using CGAL_Polygon_2 = CGAL::Polygon_2<CGAL_Kernel>;
+using CGAL_Point_3 = CGAL_Kernel::Point_3;
+using CGAL_Polyhedron_3 = CGAL::Polyhedron_3<CGAL_Kernel>;
 
 CGAL_Point_2 point_2_Eigen_to_CGAL(const Eigen::Vector2d &point) {
   return CGAL_Point_2(point(0), point(1));
@@ -89,3 +94,41 @@ bool do_intersect_convex_hulls(const std::vector<Eigen::Vector2d> &points_0,
   convex_hull_to_boost(points_1, boost_hull_1);
   return boost::geometry::intersects(boost_hull_0, boost_hull_1);
 }
+
+void convex_hull_for_Eigen_Vector3d(
+    const std::vector<Eigen::Vector3d> &points,
+    std::vector<Eigen::Vector3d> &hull_vertices,
+    std::vector<boost::array<int, 3>> &hull_faces) {
+  // calculate the convex hull using CGAL
+  std::vector<CGAL_Point_3> CGAL_points;
+  std::transform(points.begin(), points.end(), std::back_inserter(CGAL_points),
+                 [](const Eigen::Vector3d &point) {
+                   return CGAL_Point_3(point(0), point(1), point(2));
+                 });
+  CGAL_Polyhedron_3 hull;
+  CGAL::convex_hull_3(CGAL_points.begin(), CGAL_points.end(), hull);
+
+  // number the vertices of the hull
+  hull_vertices.clear();
+  std::map<CGAL_Polyhedron_3::Vertex_const_handle, int> vertex_ids;
+  for (auto it = hull.vertices_begin(); it != hull.vertices_end(); it++) {
+    vertex_ids[it] = hull_vertices.size();
+    hull_vertices.push_back(Eigen::Vector3d(CGAL::to_double(it->point().x()),
+                                            CGAL::to_double(it->point().y()),
+                                            CGAL::to_double(it->point().z())));
+  }
+
+  // split each facet into the fan of triangles from its first vertex
+  hull_faces.clear();
+  for (auto it = hull.facets_begin(); it != hull.facets_end(); it++) {
+    auto halfedge = it->halfedge();
+    int first = vertex_ids[halfedge->vertex()];
+    halfedge = halfedge->next();
+    for (int k = 2; k < it->facet_degree(); k++) {
+      int second = vertex_ids[halfedge->vertex()];
+      halfedge = halfedge->next();
+      hull_faces.push_back(
+          boost::array<int, 3>{first, second, vertex_ids[halfedge->vertex()]});
+    }
+  }
+}
@@ -4,12 +4,31 @@ each action
  */
 
 #include "o2ac_pose_distribution_updater/base/estimator.hpp"
+#include "o2ac_pose_distribution_updater/base/batch_operators_for_Lie_distribution.hpp"
+#include <Eigen/Eigenvalues>
+#include <chrono>
 #include <numeric>
 #include <opencv2/core/eigen.hpp>
 #include <yaml-cpp/yaml.h>
 
 const double EPS = 1e-9;
 
+// The numbers of particles evaluated by a worker at once. Touch and look
+// likelihoods are expensive, so they are distributed one by one.
+const int PARTICLES_PER_CHUNK = 4, LIKELIHOODS_PER_CHUNK = 1;
+// The exponentials and logarithms of the particles are cheap and computed by
+// the batch operators, so each chunk has a multiple of the sizes of their
+// groups of particles
+const int TRANSFORMS_PER_CHUNK = 4 * SE3Batch<float>::size;
+// The weighted moments are cheap to accumulate, so each chunk has many
+// particles
+const int MOMENTS_PER_CHUNK = 256;
+
+// The names of the update methods in the config file and in the diagnostics
+const char *const UPDATE_METHOD_NAMES[number_of_update_methods] = {
+    "linear_approximation", "particles", "sigma_points", "rotation_particles",
+    "auto"};
+
 // Conversion functions associated with fcl types
 
 // Note that Particle is Eigen::Matrix<double, 6, 1> and CovarianceMatrix is
@@ -42,6 +61,15 @@ fcl::Transform3f eigen_to_fcl_transform(const Eigen::Isometry3d &t) {
                           fcl::Vec3f(v(0), v(1), v(2)));
 }
 
+fcl::Transform3f eigen_to_fcl_transform(const Eigen::Matrix3d &rotation,
+                                        const Eigen::Vector3d &translation) {
+  return fcl::Transform3f(
+      fcl::Matrix3f(rotation(0, 0), rotation(0, 1), rotation(0, 2),
+                    rotation(1, 0), rotation(1, 1), rotation(1, 2),
+                    rotation(2, 0), rotation(2, 1), rotation(2, 2)),
+      fcl::Vec3f(translation(0), translation(1), translation(2)));
+}
+
 Eigen::Vector3d calculate_center_of_gravity(
     const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles) {
@@ -152,6 +180,84 @@ void PoseEstimator::load_config_file(const std::string &file_path) {
   this->push_number_of_particles = config["push_number_of_particles"].as<int>();
   this->noise_variance = noise_variance;
 
+  // The minimum and maximum numbers of particles for adaptive sampling. If
+  // they are not given, the numbers of particles are fixed.
+  auto read_min_number_of_particles =
+      [&](const std::string &key, const int &nominal_number_of_particles) {
+        return (config[key] ? std::max(std::min(config[key].as<int>(),
+                                                nominal_number_of_particles),
+                                       1)
+                            : nominal_number_of_particles);
+      };
+  this->touch_min_number_of_particles = read_min_number_of_particles(
+      "touch_min_number_of_particles", touch_number_of_particles);
+  this->look_min_number_of_particles = read_min_number_of_particles(
+      "look_min_number_of_particles", look_number_of_particles);
+  this->place_min_number_of_particles = read_min_number_of_particles(
+      "place_min_number_of_particles", place_number_of_particles);
+  this->grasp_min_number_of_particles = read_min_number_of_particles(
+      "grasp_min_number_of_particles", grasp_number_of_particles);
+  this->push_min_number_of_particles = read_min_number_of_particles(
+      "push_min_number_of_particles", push_number_of_particles);
+  auto read_max_number_of_particles =
+      [&](const std::string &key, const int &nominal_number_of_particles) {
+        return (config[key] ? std::max(config[key].as<int>(),
+                                       nominal_number_of_particles)
+                            : nominal_number_of_particles);
+      };
+  this->touch_max_number_of_particles = read_max_number_of_particles(
+      "touch_max_number_of_particles", touch_number_of_particles);
+  this->look_max_number_of_particles = read_max_number_of_particles(
+      "look_max_number_of_particles", look_number_of_particles);
+  this->place_max_number_of_particles = read_max_number_of_particles(
+      "place_max_number_of_particles", place_number_of_particles);
+  this->grasp_max_number_of_particles = read_max_number_of_particles(
+      "grasp_max_number_of_particles", grasp_number_of_particles);
+  this->push_max_number_of_particles = read_max_number_of_particles(
+      "push_max_number_of_particles", push_number_of_particles);
+  auto read_sampling_method = [&](const std::string &key) {
+    if (!config[key]) {
+      return monte_carlo_sampling;
+    }
+    std::string name = config[key].as<std::string>();
+    if (name == "monte_carlo") {
+      return monte_carlo_sampling;
+    } else if (name == "quasi_monte_carlo") {
+      return quasi_monte_carlo_sampling;
+    }
+    throw std::runtime_error("Unknown sampling method: " + name);
+  };
+  this->touch_sampling_method = read_sampling_method("touch_sampling_method");
+  this->look_sampling_method = read_sampling_method("look_sampling_method");
+  this->place_sampling_method = read_sampling_method("place_sampling_method");
+  this->grasp_sampling_method = read_sampling_method("grasp_sampling_method");
+  this->push_sampling_method = read_sampling_method("push_sampling_method");
+  if (config["use_persistent_particles"]) {
+    resampling_method method = systematic_resampling;
+    if (config["resampling_method"]) {
+      std::string name = config["resampling_method"].as<std::string>();
+      if (name == "systematic") {
+        method = systematic_resampling;
+      } else if (name == "residual") {
+        method = residual_resampling;
+      } else {
+        throw std::runtime_error("Unknown resampling method: " + name);
+      }
+    }
+    set_persistent_particles(config["use_persistent_particles"].as<bool>(),
+                             method,
+                             (config["resampling_jitter"]
+                                  ? config["resampling_jitter"].as<double>()
+                                  : 0.0));
+  }
+  if (config["adaptive_sampling"]) {
+    set_adaptive_sampling(
+        config["adaptive_sampling"].as<bool>(),
+        (config["effective_sample_size_ratio"]
+             ? config["effective_sample_size_ratio"].as<double>()
+             : effective_sample_size_ratio));
+  }
+
   set_touch_parameters(touched_objects,
                        config["distance_threshold"].as<double>());
   set_look_parameters(
@@ -160,6 +266,34 @@ void PoseEstimator::load_config_file(const std::string &file_path) {
       config["camera_fy"].as<double>(), config["camera_cx"].as<double>(),
       config["camera_cy"].as<double>());
   set_use_linear_approximation(config["use_linear_approximation"].as<bool>());
+  // The update methods of each action override use_linear_approximation
+  auto read_update_method = [&](const std::string &key,
+                                const update_method &default_method) {
+    if (!config[key]) {
+      return default_method;
+    }
+    std::string name = config[key].as<std::string>();
+    for (int k = 0; k < number_of_update_methods; k++) {
+      if (name == UPDATE_METHOD_NAMES[k]) {
+        return (update_method)k;
+      }
+    }
+    throw std::runtime_error("Unknown update method: " + name);
+  };
+  this->place_update_method =
+      read_update_method("place_update_method", place_update_method);
+  this->grasp_update_method =
+      read_update_method("grasp_update_method", grasp_update_method);
+  this->push_update_method =
+      read_update_method("push_update_method", push_update_method);
+  if (config["automatic_linear_threshold"]) {
+    automatic_linear_threshold =
+        config["automatic_linear_threshold"].as<double>();
+  }
+  if (config["automatic_sigma_point_threshold"]) {
+    automatic_sigma_point_threshold =
+        config["automatic_sigma_point_threshold"].as<double>();
+  }
   set_grasp_parameters(config["gripper_height"].as<double>(),
                        config["gripper_width"].as<double>(),
                        config["gripper_thickness"].as<double>());
@@ -170,6 +304,12 @@ void PoseEstimator::load_config_file(const std::string &file_path) {
   set_look_image_parameter(config["image_height"].as<unsigned int>(),
                            config["image_width"].as<unsigned int>(),
                            looked_point);
+  if (config["number_of_threads"]) {
+    set_number_of_threads(config["number_of_threads"].as<int>());
+  }
+  if (config["random_seed"]) {
+    set_random_seed(config["random_seed"].as<std::uint64_t>());
+  }
 }
 
 void PoseEstimator::set_particle_parameters(const int &number_of_particles,
@@ -177,19 +317,13 @@ void PoseEstimator::set_particle_parameters(const int &number_of_particles,
   this->number_of_particles = number_of_particles;
   this->noise_variance = noise_variance;
 
-  particles = std::vector<Particle>(number_of_particles);
-  particle_transforms = std::vector<Eigen::Isometry3d>(number_of_particles);
-  fcl_particle_transforms = std::vector<fcl::Transform3f>(number_of_particles);
-  likelihoods = std::vector<double>(number_of_particles);
+  default_context.particle_set.resize(number_of_particles);
 }
 
 void PoseEstimator::reset_number_of_particles(const int &number_of_particles) {
   this->number_of_particles = number_of_particles;
 
-  particles = std::vector<Particle>(number_of_particles);
-  particle_transforms = std::vector<Eigen::Isometry3d>(number_of_particles);
-  fcl_particle_transforms = std::vector<fcl::Transform3f>(number_of_particles);
-  likelihoods = std::vector<double>(number_of_particles);
+  default_context.particle_set.resize(number_of_particles);
 }
 
 void PoseEstimator::set_touch_parameters(
@@ -229,7 +363,7 @@ void PoseEstimator::set_look_parameters(
                camera_matrix, camera_dist_coeffs, camera_r, camera_t);
 }
 
-Eigen::Isometry3d PoseEstimator::get_camera_pose() {
+Eigen::Isometry3d PoseEstimator::get_camera_pose() const {
   cv::Mat rotation_matrix;
   cv::Rodrigues(camera_r, rotation_matrix);
   Eigen::Matrix3d rotation;
@@ -268,129 +402,439 @@ CovarianceMatrix safe_XXT(const CovarianceMatrix &A) {
   return X;
 }
 
-void PoseEstimator::generate_particles(const Particle &old_mean,
-                                       const CovarianceMatrix &old_covariance) {
+void PoseEstimator::generate_particles(
+    EstimatorContext &context, const Particle &old_mean,
+    const CovarianceMatrix &old_covariance) const {
   // generate particles which distribution is the normal distribution with
   // mean 'old_mean' and covariance 'old_covariance'.
   // noises are also added
 
   CovarianceMatrix X = safe_XXT(old_covariance); // old_covariance == X * X^T
+  context.particle_set.resize(number_of_particles);
+  generate_particles(context, old_mean, X, context.random_step++, 0,
+                     number_of_particles, monte_carlo_sampling);
+}
+
+void PoseEstimator::generate_particles(EstimatorContext &context,
+                                       const Particle &old_mean,
+                                       const CovarianceMatrix &X,
+                                       const std::uint64_t &step,
+                                       const int &first, const int &last,
+                                       const sampling_method &method) const {
+  ParticleSet &particle_set = context.particle_set;
+  // generate the particles in [first, last) of the step 'step'. The covariance
+  // is given as X * X^T
+
+  thread_pool->parallel_for(
+      last - first, PARTICLES_PER_CHUNK,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        for (int i = first + begin; i < first + end; i++) {
+          // Each particle has its own random stream, so the result does not
+          // depend on the order of evaluation
+          RandomStream stream(random_seed, step, i);
+          // The return values of get_UND_particle() and
+          // get_QMC_UND_particle() follows multivariate normal distribution
+          // with mean: 0 and covariance: the identity matrix In general, when
+          // x follows multivariate normal distribution with mean m and
+          // covariance C, Ax + b follows multivariate normal distribution with
+          // mean Am + b and covariance A * C * A^T So the following value
+          // follows the wanted normal distribution
+          Particle deviation =
+              (method == quasi_monte_carlo_sampling
+                   ? get_QMC_UND_particle(random_seed, step, i)
+                   : get_UND_particle(stream));
+          particle_set.tangents.col(i) = old_mean + X * deviation;
+          // Add noise
+          particle_set.tangents.col(i) +=
+              noise_variance.cwiseProduct(get_UND_particle(stream));
+        }
+      });
+}
+
+void PoseEstimator::sample_particles(
+    EstimatorContext &context, const int &min_number_of_particles,
+    const int &nominal_number_of_particles,
+    const int &max_number_of_particles, const sampling_method &method,
+    const Particle &old_mean, const CovarianceMatrix &old_covariance,
+    const FunctionRef<void(const int &first, const int &last)>
+        &evaluate_particles) const {
+  ParticleSet &particle_set = context.particle_set;
+  // Generate particles and evaluate them by 'evaluate_particles', which sets
+  // the weights of the particles in [first, last).
+  // If adaptive sampling is enabled, sampling starts from
+  // min_number_of_particles particles, and the number of particles is doubled
+  // until the effective sample size is large enough for
+  // nominal_number_of_particles particles. Since the i-th particle is always
+  // drawn from the same random stream, the evaluated particles are kept as
+  // they are.
 
-  for (int i = 0; i < number_of_particles; i++) {
-    // The return values of get_UND_particle() follows multivariate normal
-    // distribution with mean: 0 and covariance: the identity matrix In general,
-    // when x follows multivariate normal distribution with mean m and
-    // covariance C, Ax + b follows multivariate normal distribution with mean
-    // Am + b and covariance A * C * A^T So the following value follows the
-    // wanted normal distribution
-    particles[i] = old_mean + X * get_UND_particle();
-    // Add noise
-    particles[i] += noise_variance.cwiseProduct(get_UND_particle());
+  CovarianceMatrix X = safe_XXT(old_covariance); // old_covariance == X * X^T
+  std::uint64_t step = context.random_step++;
+  int first = 0,
+      last = (use_adaptive_sampling
+                  ? std::min(min_number_of_particles,
+                             nominal_number_of_particles)
+                  : nominal_number_of_particles);
+  while (1) {
+    particle_set.resize(last);
+    generate_particles(context, old_mean, X, step, first, last, method);
+    evaluate_particles(first, last);
+    accumulate_particle_moments(context, first, last);
+    if (!use_adaptive_sampling || last >= max_number_of_particles ||
+        context.last_effective_sample_size >=
+            effective_sample_size_ratio * nominal_number_of_particles) {
+      break;
+    }
+    first = last;
+    last = std::min(2 * last, max_number_of_particles);
   }
 }
 
+// The stream id of the random stream which selects the resampled particles.
+// Particles never have this index.
+const std::uint32_t RESAMPLING_STREAM_ID = ~(std::uint32_t)0;
+// Relative tolerance to regard a distribution as that of the kept particles,
+// which allows the rounding errors of the conversions to and from messages
+const double BELIEF_TOLERANCE = 1e-6;
+
+bool EstimatorContext::matches_particle_belief(
+    const Eigen::Isometry3d &mean, const CovarianceMatrix &covariance) const {
+  return has_particle_belief &&
+         (mean.matrix() - belief_mean.matrix()).norm() <= BELIEF_TOLERANCE &&
+         (covariance - belief_covariance).norm() <=
+             BELIEF_TOLERANCE * belief_covariance.norm();
+}
+
+void PoseEstimator::sample_Lie_particles(
+    EstimatorContext &context, const int &min_number_of_particles,
+    const int &nominal_number_of_particles,
+    const int &max_number_of_particles, const sampling_method &method,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    const FunctionRef<void(const int &first, const int &last)>
+        &evaluate_particles) const {
+  ParticleSet &particle_set = context.particle_set;
+  if (!use_persistent_particles ||
+      !context.matches_particle_belief(old_mean, old_covariance)) {
+    sample_particles(context, min_number_of_particles,
+                     nominal_number_of_particles, max_number_of_particles,
+                     method, Particle::Zero(), old_covariance,
+                     [&](const int &first, const int &last) {
+                       set_Lie_particle_transforms(context, old_mean, first,
+                                                   last);
+                       evaluate_particles(first, last);
+                     });
+    return;
+  }
+
+  // Resample the kept particles. The tangents of the resampled particles are
+  // the jitters, which are drawn from the random stream of each particle as
+  // in generate_particles.
+  CovarianceMatrix X = resampling_jitter * safe_XXT(old_covariance);
+  std::uint64_t step = context.random_step++;
+  RandomStream stream(random_seed, step, RESAMPLING_STREAM_ID);
+  std::vector<int> indices =
+      (persistent_resampling_method == residual_resampling
+           ? get_residual_resampling_indices(context.belief_particles.weights,
+                                             nominal_number_of_particles,
+                                             stream)
+           : get_systematic_resampling_indices(context.belief_particles.weights,
+                                               nominal_number_of_particles,
+                                               stream));
+  particle_set.resize(nominal_number_of_particles);
+  thread_pool->parallel_for(
+      nominal_number_of_particles, TRANSFORMS_PER_CHUNK,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        for (int i = begin; i < end; i++) {
+          RandomStream particle_stream(random_seed, step, i);
+          particle_set.tangents.col(i) =
+              X * get_UND_particle(particle_stream) +
+              noise_variance.cwiseProduct(get_UND_particle(particle_stream));
+          particle_set.set_transform(
+              i, se3_exp<double>(particle_set.tangents.col(i)) *
+                     context.belief_particles.transform(indices[i]));
+        }
+      });
+  evaluate_particles(0, nominal_number_of_particles);
+}
+
+void PoseEstimator::set_Lie_particle_transforms(
+    EstimatorContext &context, const Eigen::Isometry3d &old_mean,
+    const int &first, const int &last) const {
+  ParticleSet &particle_set = context.particle_set;
+  thread_pool->parallel_for(
+      last - first, TRANSFORMS_PER_CHUNK,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        batch_se3_exp(particle_set, old_mean, first + begin, first + end);
+      });
+}
+
+void PoseEstimator::evaluate_particles(
+    EstimatorContext &context, const int &first, const int &last,
+    const FunctionRef<void(const int &i, const int &worker_id)>
+        &evaluate_particle) const {
+  thread_pool->parallel_for(
+      last - first, PARTICLES_PER_CHUNK,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        for (int i = first + begin; i < first + end; i++) {
+          evaluate_particle(i, worker_id);
+        }
+      });
+}
+
+const int number_of_sigma_points = 13; // 2 * 6 + 1
+
+bool PoseEstimator::propagate_sigma_points(
+    EstimatorContext &context, const Eigen::Isometry3d &old_mean,
+    const CovarianceMatrix &old_covariance,
+    const FunctionRef<void(const int &i, const int &worker_id)>
+        &evaluate_particle,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const {
+  ParticleSet &particle_set = context.particle_set;
+  // The unscented transform with alpha = 1, beta = 0 and kappa = 0.
+  // The sigma points are 0 and +-sqrt(6) * X.col(k) where
+  // old_covariance == X * X^T, and the weights are 0 for the center and 1/12
+  // for the others. The center is evaluated to check that the action succeeds
+  // at the mean.
+  // (beta = 2 gives a positive weight to the center in the covariance, which
+  // made the covariance worse since the actions are not smooth where the
+  // touching vertices change.)
+  // The sigma points cannot represent the distribution conditioned on the
+  // success of the action, so this fails if the action fails at any of them.
+
+  CovarianceMatrix X = safe_XXT(old_covariance);
+  particle_set.resize(number_of_sigma_points);
+  particle_set.tangents.col(0).setZero();
+  particle_set.tangents.middleCols<6>(1) = std::sqrt(6.0) * X;
+  particle_set.tangents.middleCols<6>(7) = -std::sqrt(6.0) * X;
+  set_Lie_particle_transforms(context, old_mean, 0, number_of_sigma_points);
+  evaluate_particles(context, 0, number_of_sigma_points, evaluate_particle);
+  if (particle_set.weights.minCoeff() <= 0.0) {
+    std::cerr << "The action fails at a sigma point\n";
+    return false;
+  }
+  particle_set.weights.setConstant(1.0 / (number_of_sigma_points - 1));
+  particle_set.weights(0) = 0.0;
+  calculate_weighted_Lie_distribution(context, new_mean, new_covariance);
+  return true;
+}
+
 void PoseEstimator::calculate_touch_likelihoods(
-    const unsigned char &touched_object_id,
+    EstimatorContext &context, const unsigned char &touched_object_id,
     const object_geometry_ptr &gripped_geometry,
-    const fcl::Transform3f &gripper_transform) {
-  for (int i = 0; i < number_of_particles; i++) {
-    double distance =
-        calculate_distance(touched_objects[touched_object_id], gripped_geometry,
-                           gripper_transform * fcl_particle_transforms[i]);
-    likelihoods[i] = (std::abs(distance) < distance_threshold ? 1.0 : 0.0);
+    const fcl::Transform3f &gripper_transform, const int &first,
+    const int &last) const {
+  ParticleSet &particle_set = context.particle_set;
+  thread_pool->parallel_for(
+      last - first, LIKELIHOODS_PER_CHUNK,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        for (int i = first + begin; i < first + end; i++) {
+          double distance = calculate_distance(
+              touched_objects[touched_object_id], gripped_geometry,
+              gripper_transform *
+                  eigen_to_fcl_transform(particle_set.rotation(i),
+                                         particle_set.translation(i)));
+          particle_set.weights(i) =
+              (std::abs(distance) < distance_threshold ? 1.0 : 0.0);
+        }
+      });
+}
+
+void PoseEstimator::accumulate_particle_moments(EstimatorContext &context,
+                                                const int &first,
+                                                const int &last) const {
+  // The weights are accumulated by their logarithms, so tiny likelihoods do
+  // not underflow. The moments of each chunk are merged in the order of
+  // chunks, so the result does not depend on the number of threads.
+  const ParticleSet &particle_set = context.particle_set;
+  const ParticleSet::TangentMatrix &particles = particle_set.tangents;
+  const Eigen::VectorXd &likelihoods = particle_set.weights;
+  if (first == 0) {
+    context.particle_moments = WeightedMomentAccumulator<6>();
+  }
+  context.chunk_moments.assign(
+      (last - first + MOMENTS_PER_CHUNK - 1) / MOMENTS_PER_CHUNK,
+      WeightedMomentAccumulator<6>());
+  thread_pool->parallel_for(
+      last - first, MOMENTS_PER_CHUNK,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        WeightedMomentAccumulator<6> &moments =
+            context.chunk_moments[begin / MOMENTS_PER_CHUNK];
+        for (int i = first + begin; i < first + end; i++) {
+          moments.add(particles.col(i), std::log(likelihoods(i)));
+        }
+      });
+  for (const auto &chunk : context.chunk_moments) {
+    context.particle_moments.merge(chunk);
   }
+  context.number_of_particles_in_moments = last;
+  context.last_effective_sample_size =
+      context.particle_moments.effective_sample_size();
 }
 
 void PoseEstimator::calculate_new_distribution(
-    Particle &new_mean, CovarianceMatrix &new_covariance) {
+    EstimatorContext &context, Particle &new_mean,
+    CovarianceMatrix &new_covariance) const {
   // calculate mean and covariance of particles with the weight likelihoods
-  // divided by its sum
-
-  double sum_of_likelihoods =
-      std::accumulate(likelihoods.begin(), likelihoods.end(), 0.0);
-  std::cerr << "The sum of likelihoods:" << sum_of_likelihoods << " / "
-            << number_of_particles << '\n';
-  if (sum_of_likelihoods <= EPS) {
-    throw std::runtime_error("The sum of likelihoods is 0");
-  }
-  new_mean.setZero();
-  new_covariance.setZero();
-  // Note that Cov[X, Y] = E[XY] - E[X]E[Y]
-  for (int i = 0; i < number_of_particles; i++) {
-    new_mean += likelihoods[i] / sum_of_likelihoods * particles[i];
-    new_covariance += likelihoods[i] / sum_of_likelihoods * particles[i] *
-                      particles[i].transpose();
+  // divided by its sum, in a single pass over the particles. The moments of
+  // the particles evaluated by sample_particles are already accumulated.
+  ParticleSet &particle_set = context.particle_set;
+  if (context.number_of_particles_in_moments != particle_set.size()) {
+    accumulate_particle_moments(context, 0, particle_set.size());
   }
-  new_covariance -= new_mean * new_mean.transpose();
-
-  // Bessel's correction
-  double sum_of_square_likelihoods = 0.0;
-  for (double &v : likelihoods) {
-    sum_of_square_likelihoods += v * v;
+  const WeightedMomentAccumulator<6> &moments = context.particle_moments;
+  // the weights may be changed by the next step
+  context.number_of_particles_in_moments = 0;
+
+  std::cerr << "The sum of likelihoods:"
+            << std::exp(moments.log_sum_of_weights()) << " / "
+            << particle_set.size() << ", the effective sample size:"
+            << context.last_effective_sample_size << '\n';
+  if (moments.empty()) {
+    throw std::runtime_error("The sum of likelihoods is 0");
   }
-  double factor =
-      1 - sum_of_square_likelihoods / (sum_of_likelihoods * sum_of_likelihoods);
-  if (factor <= EPS) {
+  // The factor of Bessel's correction is 1 - 1 / (effective sample size)
+  if (context.last_effective_sample_size <= 1.0 + EPS) {
     throw std::runtime_error("Only single particle has non-zero likelihood");
   }
-  new_covariance /= factor;
+  new_mean = moments.mean();
+  new_covariance = moments.covariance();
 }
 
 const int max_iteration = 10; // upperbound of the number of iterations to find
                               // the value of 'new_mean' by Newton method
 
 void PoseEstimator::calculate_new_Lie_distribution(
-    const Eigen::Isometry3d &old_mean, Eigen::Isometry3d &new_mean,
-    CovarianceMatrix &new_covariance) {
+    EstimatorContext &context, const Eigen::Isometry3d &old_mean,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const {
   // calculate mean and covariance of particles with the weight likelihoods
   // divided by its sum
 
-  double sum_of_likelihoods =
-      std::accumulate(likelihoods.begin(), likelihoods.end(), 0.0);
+  ParticleSet &particle_set = context.particle_set;
+  Eigen::VectorXd &likelihoods = particle_set.weights;
+  double sum_of_likelihoods = likelihoods.sum();
   std::cerr << "The sum of likelihoods:" << sum_of_likelihoods << " / "
-            << number_of_particles << '\n';
+            << particle_set.size() << '\n';
   if (sum_of_likelihoods <= EPS) {
     throw std::runtime_error("The sum of likelihoods is 0");
   }
-  for (double &value : likelihoods) {
-    value /= sum_of_likelihoods;
+  likelihoods /= sum_of_likelihoods;
+
+  calculate_weighted_Lie_distribution(context, new_mean, new_covariance);
+
+  // Bessel's correction
+  double sum_of_square_likelihoods = likelihoods.squaredNorm();
+  context.last_effective_sample_size = 1.0 / sum_of_square_likelihoods;
+  double factor = 1 - sum_of_square_likelihoods;
+  if (factor <= EPS) {
+    throw std::runtime_error("Only single particle has non-zero likelihood");
+  }
+  new_covariance /= factor;
+
+  if (use_persistent_particles) {
+    context.belief_particles = particle_set;
+    context.belief_mean = new_mean;
+    context.belief_covariance = new_covariance;
+    context.has_particle_belief = true;
+  }
+}
+
+Eigen::Isometry3d calculate_chordal_mean(const ParticleSet &particle_set,
+                                         const std::vector<int> &indices,
+                                         const Eigen::VectorXd &weights) {
+  // The weighted mean of the translations, and the rotation whose quaternion
+  // q maximizes the weighted sum of (q . q_i)^2, i.e. the eigenvector of the
+  // largest eigenvalue of the weighted sum of q_i * q_i^T. It is independent
+  // of the signs of q_i and close to the mean on SE(3) if the particles are
+  // concentrated.
+  Eigen::Matrix4d sum_of_qqT = Eigen::Matrix4d::Zero();
+  Eigen::Vector3d sum_of_translations = Eigen::Vector3d::Zero();
+  for (int k = 0; k < indices.size(); k++) {
+    Eigen::Vector4d q =
+        Eigen::Quaterniond(particle_set.rotation(indices[k])).coeffs();
+    sum_of_qqT += weights(k) * q * q.transpose();
+    sum_of_translations +=
+        weights(k) * particle_set.translation(indices[k]);
   }
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> solver(sum_of_qqT);
+  // the eigenvalues are sorted in increasing order
+  Eigen::Vector4d q = solver.eigenvectors().col(3);
+  Eigen::Isometry3d mean = Eigen::Isometry3d::Identity();
+  mean.linear() = Eigen::Quaterniond(q).normalized().toRotationMatrix();
+  mean.translation() = sum_of_translations;
+  return mean;
+}
 
-  // find a new_mean such that the weighted sum of log(particle_transforms[i] *
-  // new_mean^{-1}) is equals to zero by Newton method.
-  new_mean = old_mean;
+void PoseEstimator::calculate_weighted_Lie_distribution(
+    EstimatorContext &context, Eigen::Isometry3d &new_mean,
+    CovarianceMatrix &new_covariance) const {
+  // The particles with zero weights are removed first, and the vectors xi of
+  // the last iteration, which are those at new_mean, give the covariance.
+  // The vectors xi and the Jacobians are calculated in parallel. The
+  // Jacobians are summed up in each chunk and then in the order of chunks,
+  // so the result does not depend on the number of threads.
+
+  const ParticleSet &particle_set = context.particle_set;
+  ParticleSet::TangentMatrix &xis = context.xis;
+  auto &chunk_sums_of_xi_dash = context.chunk_sums_of_xi_dash;
+  std::vector<int> &indices = context.weighted_indices;
+  indices.clear();
+  for (int i = 0; i < particle_set.size(); i++) {
+    if (particle_set.weights(i) >= EPS) {
+      indices.push_back(i);
+    }
+  }
+  int number_of_indices = indices.size();
+  Eigen::VectorXd &weights = context.compact_weights;
+  weights.resize(number_of_indices);
+  for (int k = 0; k < number_of_indices; k++) {
+    weights(k) = particle_set.weights(indices[k]);
+  }
+  xis.resize(6, number_of_indices);
+  chunk_sums_of_xi_dash.resize((number_of_indices + PARTICLES_PER_CHUNK - 1) /
+                               PARTICLES_PER_CHUNK);
+
+  // find a new_mean such that the weighted sum of
+  // log(particle_set.transform(i) * new_mean^{-1}) is equals to zero by Newton
+  // method, starting from the chordal mean
+  new_mean = calculate_chordal_mean(particle_set, indices, weights);
   int iteration;
   for (iteration = 0; iteration < max_iteration; iteration++) {
+    Eigen::Isometry3d inverse_of_mean = new_mean.inverse();
+    thread_pool->parallel_for(
+        number_of_indices, TRANSFORMS_PER_CHUNK,
+        [&](const int &begin, const int &end, const int &worker_id) {
+          batch_se3_log(particle_set, indices, inverse_of_mean, begin, end,
+                        xis);
+        });
     // sum_of_xi is the vector which must be the zero vector
+    Particle sum_of_xi = xis * weights;
+    if (sum_of_xi.norm() < EPS) {
+      break;
+    }
     // new_mean is updated by new_mean := exp(hat_operator(-X)) * new_mean for
     // some vector X sum_of_xi_dash is the Jacobian of sum_of_xi with respect to
     // X
-    Particle sum_of_xi = Particle::Zero();
+    // Note that xi -> log(exp(xi) * exp(hat_operator(X))) when new_mean ->
+    // exp(hat_operator(-X)) * new_mean. Its Jacobian with respect to X is the
+    // inverse of the right Jacobian of SE(3) at xi
+    thread_pool->parallel_for(
+        number_of_indices, PARTICLES_PER_CHUNK,
+        [&](const int &begin, const int &end, const int &worker_id) {
+          CovarianceMatrix &sum =
+              chunk_sums_of_xi_dash[begin / PARTICLES_PER_CHUNK];
+          sum.setZero();
+          for (int k = begin; k < end; k++) {
+            sum += weights(k) * se3_inverse_right_Jacobian<double>(xis.col(k));
+          }
+        });
     CovarianceMatrix sum_of_xi_dash = CovarianceMatrix::Zero();
-    for (int i = 0; i < number_of_particles; i++) {
-      if (likelihoods[i] < EPS) {
-        continue;
-      }
-      Particle xi = check_operator<double>(
-          (particle_transforms[i] * new_mean.inverse()).matrix().log());
-      sum_of_xi += likelihoods[i] * xi;
-      // Note that xi -> log(exp(xi) * exp(hat_operator(X))) when new_mean ->
-      // exp(hat_operator(-X)) * new_mean By BCH formula, Jacobian of
-      // log(exp(xi) * exp(hat_operator(X))) with respect to X is calculated by
-      // Bernoulli_series
-      sum_of_xi_dash += likelihoods[i] * Bernoulli_series(adjoint(xi));
-    }
-    if (sum_of_xi.norm() < EPS) {
-      break;
+    for (const auto &sum : chunk_sums_of_xi_dash) {
+      sum_of_xi_dash += sum;
     }
     // update by new_mean := exp(hat_operator(-X)) * new_mean where X is
     // -sum_of_xi_dash^{-1} * sum_of_xi
-    new_mean = Eigen::Isometry3d(
-                   (Eigen::Matrix<double, 4, 4>)(hat_operator<double>(
-                                                     sum_of_xi_dash.inverse() *
-                                                     sum_of_xi)
-                                                     .exp())) *
-               new_mean;
+    new_mean =
+        se3_exp<double>(sum_of_xi_dash.inverse() * sum_of_xi) * new_mean;
   }
   // if the new_mean cannot be found by 'max_iteration' iterations, it is
   // regarded as a failure of calculation
@@ -398,87 +842,77 @@ void PoseEstimator::calculate_new_Lie_distribution(
     throw(std::runtime_error("the updated mean cannot be found"));
   }
   // calculate the covariance matrix of xi's
-  new_covariance.setZero();
   // Note that Cov[X, Y] = E[XY] - E[X]E[Y]
-  for (int i = 0; i < number_of_particles; i++) {
-    if (likelihoods[i] < EPS) {
-      continue;
-    }
-    Particle xi = check_operator<double>(
-        (particle_transforms[i] * new_mean.inverse()).matrix().log());
-    new_covariance += likelihoods[i] * xi * xi.transpose();
-  }
-
-  // Bessel's correction
-  double sum_of_square_likelihoods = 0.0;
-  for (double &v : likelihoods) {
-    sum_of_square_likelihoods += v * v;
-  }
-  double factor = 1 - sum_of_square_likelihoods;
-  if (factor <= EPS) {
-    throw std::runtime_error("Only single particle has non-zero likelihood");
-  }
-  new_covariance /= factor;
-}
-
-void make_BVHModel(object_geometry_ptr &bvhmodel,
-                   const std::vector<Eigen::Vector3d> &vertices,
-                   const std::vector<boost::array<int, 3>> &triangles) {
-  bvhmodel = object_geometry_ptr(new object_geometry());
-  std::vector<fcl::Vec3f> fcl_points(vertices.size());
-  for (int i = 0; i < vertices.size(); i++) {
-    fcl_points[i] = fcl::Vec3f(vertices[i][0], vertices[i][1], vertices[i][2]);
-  }
-  std::vector<fcl::Triangle> fcl_triangles(triangles.size());
-  for (int j = 0; j < triangles.size(); j++) {
-    fcl_triangles[j] =
-        fcl::Triangle(triangles[j][0], triangles[j][1], triangles[j][2]);
+  new_covariance.setZero();
+  for (int k = 0; k < number_of_indices; k++) {
+    new_covariance += weights(k) * xis.col(k) * xis.col(k).transpose();
   }
-  bvhmodel->beginModel(fcl_points.size(), fcl_triangles.size());
-  bvhmodel->addSubModel(fcl_points, fcl_triangles);
-  bvhmodel->endModel();
 }
 
 void PoseEstimator::touched_step(
-    const unsigned char &touched_object_id,
+    EstimatorContext &context, const unsigned char &touched_object_id,
     const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const fcl::Transform3f &gripper_transform, const Particle &old_mean,
     const CovarianceMatrix &old_covariance, Particle &new_mean,
-    CovarianceMatrix &new_covariance) {
-  reset_number_of_particles(touch_number_of_particles);
-  generate_particles(old_mean, old_covariance);
-  for (int i = 0; i < number_of_particles; i++) {
-    fcl_particle_transforms[i] = particle_to_transform(particles[i]);
-  }
-  object_geometry_ptr gripped_geometry;
-  make_BVHModel(gripped_geometry, vertices, triangles);
-  calculate_touch_likelihoods(touched_object_id, gripped_geometry,
-                              gripper_transform);
-  calculate_new_distribution(new_mean, new_covariance);
+    CovarianceMatrix &new_covariance) const {
+  PreparedObject object;
+  make_BVHModel(object.geometry, vertices, triangles);
+  touched_step(context, touched_object_id, object, gripper_transform, old_mean,
+               old_covariance, new_mean, new_covariance);
+}
+
+void PoseEstimator::touched_step(
+    EstimatorContext &context, const unsigned char &touched_object_id,
+    const PreparedObject &object, const fcl::Transform3f &gripper_transform,
+    const Particle &old_mean, const CovarianceMatrix &old_covariance,
+    Particle &new_mean, CovarianceMatrix &new_covariance) const {
+  ParticleSet &particle_set = context.particle_set;
+  sample_particles(
+      context, touch_min_number_of_particles, touch_number_of_particles,
+      touch_max_number_of_particles, touch_sampling_method, old_mean,
+      old_covariance,
+      [&](const int &first, const int &last) {
+        for (int i = first; i < last; i++) {
+          particle_set.set_transform(i, particle_to_eigen_transform(Particle(
+                                            particle_set.tangents.col(i))));
+        }
+        calculate_touch_likelihoods(context, touched_object_id,
+                                    object.geometry, gripper_transform, first,
+                                    last);
+      });
+  calculate_new_distribution(context, new_mean, new_covariance);
 }
 
 void PoseEstimator::touched_step_with_Lie_distribution(
-    const unsigned char &touched_object_id,
+    EstimatorContext &context, const unsigned char &touched_object_id,
     const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const fcl::Transform3f &gripper_transform,
     const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
-    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) {
-  reset_number_of_particles(touch_number_of_particles);
-  generate_particles(Particle::Zero(), old_covariance);
-  for (int i = 0; i < number_of_particles; i++) {
-    particle_transforms[i] =
-        Eigen::Isometry3d(
-            (Eigen::Matrix<double, 4, 4>)(hat_operator(particles[i]).exp())) *
-        old_mean;
-    fcl_particle_transforms[i] = eigen_to_fcl_transform(particle_transforms[i]);
-  }
-  object_geometry_ptr gripped_geometry;
-  make_BVHModel(gripped_geometry, vertices, triangles);
-  calculate_touch_likelihoods(touched_object_id, gripped_geometry,
-                              gripper_transform);
-  calculate_new_Lie_distribution(old_mean, new_mean, new_covariance);
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const {
+  PreparedObject object;
+  make_BVHModel(object.geometry, vertices, triangles);
+  touched_step_with_Lie_distribution(context, touched_object_id, object,
+                                     gripper_transform, old_mean,
+                                     old_covariance, new_mean, new_covariance);
+}
+
+void PoseEstimator::touched_step_with_Lie_distribution(
+    EstimatorContext &context, const unsigned char &touched_object_id,
+    const PreparedObject &object, const fcl::Transform3f &gripper_transform,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const {
+  sample_Lie_particles(
+      context, touch_min_number_of_particles, touch_number_of_particles,
+      touch_max_number_of_particles, touch_sampling_method, old_mean,
+      old_covariance,
+      [&](const int &first, const int &last) {
+        calculate_touch_likelihoods(context, touched_object_id,
+                                    object.geometry, gripper_transform, first,
+                                    last);
+      });
+  calculate_new_Lie_distribution(context, old_mean, new_mean, new_covariance);
 }
 
 void PoseEstimator::place_step(
@@ -486,21 +920,41 @@ void PoseEstimator::place_step(
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &gripper_transform, const double &support_surface,
     const Particle &old_mean, const CovarianceMatrix &old_covariance,
-    Particle &new_mean, CovarianceMatrix &new_covariance) {
-  reset_number_of_particles(place_number_of_particles);
-  // calculate the center of gravity
-  int number_of_vertices = vertices.size();
-  Eigen::Vector3d center_of_gravity_of_gripped =
-      calculate_center_of_gravity(vertices, triangles);
+    Particle &new_mean, CovarianceMatrix &new_covariance) const {
+  place_step(ObjectParts(vertices, triangles), gripper_transform,
+             support_surface, old_mean, old_covariance, new_mean,
+             new_covariance);
+}
+
+void PoseEstimator::place_step(const PreparedObject &object,
+                               const Eigen::Isometry3d &gripper_transform,
+                               const double &support_surface,
+                               const Particle &old_mean,
+                               const CovarianceMatrix &old_covariance,
+                               Particle &new_mean,
+                               CovarianceMatrix &new_covariance) const {
+  place_step(ObjectParts(object), gripper_transform, support_surface, old_mean,
+             old_covariance, new_mean, new_covariance);
+}
+
+void PoseEstimator::place_step(const ObjectParts &object,
+                               const Eigen::Isometry3d &gripper_transform,
+                               const double &support_surface,
+                               const Particle &old_mean,
+                               const CovarianceMatrix &old_covariance,
+                               Particle &new_mean,
+                               CovarianceMatrix &new_covariance) const {
+  const std::vector<Eigen::Vector3d> &vertices = object.hull_vertices;
+  const Eigen::Vector3d &center_of_gravity_of_gripped =
+      object.center_of_gravity;
   // calculate the coordinates of vertices of the object when the pose is the
   // given mean
   Eigen::Isometry3d mean_transform = particle_to_eigen_transform(old_mean);
   Eigen::Vector3d current_center_of_gravity =
       gripper_transform * mean_transform * center_of_gravity_of_gripped;
-  std::vector<Eigen::Vector3d> current_vertices(number_of_vertices);
-  for (int i = 0; i < number_of_vertices; i++) {
-    current_vertices[i] = gripper_transform * mean_transform * vertices[i];
-  }
+  std::vector<Eigen::Vector3d> current_vertices;
+  transform_points(gripper_transform * mean_transform, vertices,
+                   current_vertices);
 
   // calculate the three vertices of the object touching the ground
   int ground_touch_vertex_id_1, ground_touch_vertex_id_2,
@@ -508,13 +962,17 @@ void PoseEstimator::place_step(
                                 // the second and the third.
   Eigen::Quaterniond rotation;
   bool stability;
-  find_three_points(current_vertices, current_center_of_gravity,
-                    ground_touch_vertex_id_1, ground_touch_vertex_id_2,
-                    ground_touch_vertex_id_3, rotation, stability);
+  action_status status = find_three_points(
+      current_vertices, current_center_of_gravity, ground_touch_vertex_id_1,
+      ground_touch_vertex_id_2, ground_touch_vertex_id_3, rotation, stability);
+  if (status != success_status) {
+    throw std::runtime_error(action_status_message(status));
+  }
 
   // If the object is not stable after placing, throw exception
   if (!stability) {
-    throw std::runtime_error("Unstable after placing");
+    throw std::runtime_error(
+        action_status_message(unstable_after_placing_status));
   }
 
   // Update the distribution
@@ -525,192 +983,733 @@ void PoseEstimator::place_step(
       new_mean, new_covariance);
 }
 
+void set_action_result(ParticleSet &particle_set, const int &i,
+                       const action_status &status,
+                       const Eigen::Isometry3d &new_transform,
+                       ActionWorkspace &workspace, const bool validity_check) {
+  // Move the i-th particle to the pose after the action, or reject it if the
+  // action fails. The failure is thrown only if validity_check is true.
+  workspace.status_counts[status]++;
+  if (status == success_status) {
+    particle_set.set_transform(i, new_transform);
+    particle_set.weights(i) = 1.;
+  } else if (validity_check) {
+    throw std::runtime_error(action_status_message(status));
+  } else {
+    particle_set.weights(i) = 0.0;
+  }
+}
+
+void print_action_status_counts(const ActionStatusCounts &counts) {
+  // Print the reasons of the failures
+  for (int k = 0; k < number_of_action_statuses; k++) {
+    if (k != success_status && counts[k] > 0) {
+      std::cerr << action_status_message((action_status)k) << ": "
+                << counts[k] << '\n';
+    }
+  }
+}
+
+void report_action_status_counts(EstimatorContext &context) {
+  // Sum up the statuses of the particles evaluated by the workers
+  context.collect_action_status_counts();
+  print_action_status_counts(context.action_status_counts);
+}
+
+void PoseEstimator::propagate_rotation_particles(
+    EstimatorContext &context, const int &min_number_of_particles,
+    const int &nominal_number_of_particles,
+    const int &max_number_of_particles, const sampling_method &method,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    const Eigen::Matrix3d &translation_Jacobian,
+    const FunctionRef<void(const int &i, const int &worker_id)>
+        &evaluate_particle,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const {
+  ParticleSet &particle_set = context.particle_set;
+  // Split xi = (rho, omega) into omega and rho conditioned on omega, which
+  // follows the normal distribution with mean A * omega and covariance
+  // conditional_covariance. The pseudo-inverse of the covariance of omega
+  // allows the rotations which are not uncertain.
+  Eigen::Matrix3d rotation_covariance =
+      old_covariance.bottomRightCorner<3, 3>();
+  Eigen::Matrix3d cross_covariance = old_covariance.topRightCorner<3, 3>();
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(rotation_covariance);
+  Eigen::Vector3d eigenvalues = solver.eigenvalues();
+  Eigen::Vector3d inverse_eigenvalues;
+  for (int k = 0; k < 3; k++) {
+    inverse_eigenvalues(k) =
+        (eigenvalues(k) > EPS * eigenvalues(2) && eigenvalues(k) > 0.0
+             ? 1.0 / eigenvalues(k)
+             : 0.0);
+  }
+  Eigen::Matrix3d A = cross_covariance * solver.eigenvectors() *
+                      inverse_eigenvalues.asDiagonal() *
+                      solver.eigenvectors().transpose();
+  Eigen::Matrix3d conditional_covariance =
+      old_covariance.topLeftCorner<3, 3>() - A * cross_covariance.transpose();
+  conditional_covariance =
+      (conditional_covariance + conditional_covariance.transpose()) / 2.0;
+
+  // The covariance of (A * omega, omega), from which the particles are drawn
+  CovarianceMatrix marginal_covariance = old_covariance;
+  marginal_covariance.topLeftCorner<3, 3>() -= conditional_covariance;
+  sample_particles(context, min_number_of_particles,
+                   nominal_number_of_particles, max_number_of_particles,
+                   method, Particle::Zero(), marginal_covariance,
+                   [&](const int &first, const int &last) {
+                     set_Lie_particle_transforms(context, old_mean, first,
+                                                 last);
+                     evaluate_particles(context, first, last,
+                                        evaluate_particle);
+                   });
+  report_action_status_counts(context);
+  calculate_new_Lie_distribution(context, old_mean, new_mean, new_covariance);
+  // The particles do not represent the translations, so they are not kept
+  context.has_particle_belief = false;
+
+  // Add the mean of the conditional covariances after the action by the law of
+  // total covariance. The translation of exp(xi) * old_mean is
+  // J_l(omega) * rho + (a function of omega), where J_l is the left Jacobian
+  // of SO(3), and rho of the vector xi at new_mean is J_l(omega)^{-1} * (the
+  // translation) + (a function of the rotation), so the derivative of rho
+  // after the action by rho before the action is
+  // J_l(omega_after)^{-1} * translation_Jacobian * J_l(omega_before).
+  const std::vector<int> &indices = context.weighted_indices;
+  const Eigen::VectorXd &weights = context.compact_weights;
+  Eigen::Matrix3d propagated_covariance = Eigen::Matrix3d::Zero();
+  for (int k = 0; k < indices.size(); k++) {
+    Eigen::Matrix3d Jacobian =
+        SO3_inverse_left_Jacobian<double>(
+            Eigen::Vector3d(context.xis.col(k).tail<3>())) *
+        translation_Jacobian *
+        SO3_left_Jacobian<double>(
+            Eigen::Vector3d(particle_set.tangents.col(indices[k]).tail<3>()));
+    propagated_covariance +=
+        weights(k) * Jacobian * conditional_covariance * Jacobian.transpose();
+  }
+  new_covariance.topLeftCorner<3, 3>() += propagated_covariance;
+}
+
+void PoseEstimator::update_Lie_distribution_by_action(
+    EstimatorContext &context, const update_method &method,
+    const int &min_number_of_particles, const int &nominal_number_of_particles,
+    const int &max_number_of_particles,
+    const sampling_method &sampling, const Eigen::Isometry3d &old_mean,
+    const CovarianceMatrix &old_covariance,
+    const Eigen::Matrix3d &translation_Jacobian,
+    const FunctionRef<void(Eigen::Isometry3d &new_mean,
+                           CovarianceMatrix &new_covariance)> &linearize,
+    const FunctionRef<void(const int &i, const int &worker_id)>
+        &evaluate_particle,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance) const {
+  auto start_time = std::chrono::steady_clock::now();
+  update_method used_method = method;
+  context.last_nonlinearity = -1.0;
+  if (method == automatic_update) {
+    // Probe the nonlinearity of the action within the uncertainty by the
+    // linearization at the mean and the sigma points, whose covariances agree
+    // if the action is nearly linear. The particles are used if the action
+    // fails at any of them.
+    used_method = particle_update;
+    Eigen::Isometry3d linear_mean;
+    CovarianceMatrix linear_covariance;
+    bool linearized = true;
+    try {
+      linearize(linear_mean, linear_covariance);
+    } catch (std::runtime_error &e) {
+      linearized = false;
+    }
+    if (linearized && propagate_sigma_points(context, old_mean, old_covariance,
+                                             evaluate_particle, new_mean,
+                                             new_covariance)) {
+      report_action_status_counts(context);
+      context.last_nonlinearity = (new_covariance - linear_covariance).norm() /
+                                  std::max(new_covariance.norm(), EPS);
+      if (context.last_nonlinearity <= automatic_linear_threshold) {
+        new_mean = linear_mean;
+        new_covariance = linear_covariance;
+        used_method = linear_approximation_update;
+      } else if (context.last_nonlinearity <=
+                 automatic_sigma_point_threshold) {
+        used_method = sigma_point_update;
+      }
+    }
+  } else if (method == linear_approximation_update) {
+    linearize(new_mean, new_covariance);
+  } else if (method == rotation_particle_update) {
+    propagate_rotation_particles(context, min_number_of_particles,
+                                 nominal_number_of_particles,
+                                 max_number_of_particles, sampling, old_mean,
+                                 old_covariance, translation_Jacobian,
+                                 evaluate_particle, new_mean, new_covariance);
+  } else if (method == sigma_point_update &&
+             propagate_sigma_points(context, old_mean, old_covariance,
+                                    evaluate_particle, new_mean,
+                                    new_covariance)) {
+    report_action_status_counts(context);
+  } else {
+    used_method = particle_update;
+  }
+  if (used_method == particle_update) {
+    sample_Lie_particles(context, min_number_of_particles,
+                         nominal_number_of_particles,
+                         max_number_of_particles, sampling, old_mean,
+                         old_covariance,
+                         [&](const int &first, const int &last) {
+                           evaluate_particles(context, first, last,
+                                              evaluate_particle);
+                         });
+    report_action_status_counts(context);
+    calculate_new_Lie_distribution(context, old_mean, new_mean,
+                                   new_covariance);
+  }
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count();
+  context.last_update_method = used_method;
+  context.update_method_counts[used_method]++;
+  context.update_method_seconds[used_method] += seconds;
+  std::cerr << "The update method: " << UPDATE_METHOD_NAMES[used_method];
+  if (context.last_nonlinearity >= 0.0) {
+    std::cerr << ", the nonlinearity: " << context.last_nonlinearity;
+  }
+  std::cerr << ", " << 1e3 * seconds << " ms\n";
+}
+
 void PoseEstimator::place_step_with_Lie_distribution(
-    const std::vector<Eigen::Vector3d> &vertices,
+    EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &gripper_transform, const double &support_surface,
     const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
     Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
-    const bool validity_check) {
-  reset_number_of_particles(place_number_of_particles);
-  // calculate the center of gravity
-  Eigen::Vector3d center_of_gravity_of_gripped =
-      calculate_center_of_gravity(vertices, triangles);
-  // calculate the coordinates of vertices of the object when the pose is the
-  // given mean
-  if (use_linear_approximation) {
-    // Update the covariance
+    const bool validity_check) const {
+  place_step_with_Lie_distribution(
+      context, ObjectParts(vertices, triangles), gripper_transform,
+      support_surface, old_mean, old_covariance, new_mean, new_covariance,
+      validity_check);
+}
+
+void PoseEstimator::place_step_with_Lie_distribution(
+    EstimatorContext &context, const PreparedObject &object,
+    const Eigen::Isometry3d &gripper_transform, const double &support_surface,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+    const bool validity_check) const {
+  place_step_with_Lie_distribution(
+      context, ObjectParts(object), gripper_transform,
+      support_surface, old_mean, old_covariance, new_mean, new_covariance,
+      validity_check);
+}
+
+void PoseEstimator::place_step_with_Lie_distribution(
+    EstimatorContext &context, const ObjectParts &object,
+    const Eigen::Isometry3d &gripper_transform, const double &support_surface,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+    const bool validity_check) const {
+  ParticleSet &particle_set = context.particle_set;
+  const std::vector<Eigen::Vector3d> &vertices = object.hull_vertices;
+  context.reserve_workspaces(thread_pool->get_number_of_threads(),
+                             vertices.size());
+  context.clear_action_status_counts();
+  const Eigen::Vector3d &center_of_gravity_of_gripped =
+      object.center_of_gravity;
+  // linearize the action at the mean by auto diff
+  auto linearize = [&](Eigen::Isometry3d &new_mean,
+                       CovarianceMatrix &new_covariance) {
     place_update_Lie_distribution(
         old_mean, old_covariance, center_of_gravity_of_gripped, vertices,
         support_surface, gripper_transform, new_mean, new_covariance);
-  } else {
-    generate_particles(Particle::Zero(), old_covariance);
-    for (int i = 0; i < number_of_particles; i++) {
-      Eigen::Isometry3d input_transform =
-          Eigen::Isometry3d(
-              (Eigen::Matrix<double, 4, 4>)(hat_operator(particles[i]).exp())) *
-          old_mean;
-      try {
-        place_calculator calculator(
-            input_transform, center_of_gravity_of_gripped, vertices,
-            support_surface, gripper_transform, false, false);
-
-        particle_transforms[i] = calculator.new_mean;
-
-        likelihoods[i] = 1.;
-      } catch (std::runtime_error &e) {
-        if (validity_check) {
-          throw e;
-        }
-        likelihoods[i] = 0.0;
-      }
-    }
-    calculate_new_Lie_distribution(old_mean, new_mean, new_covariance);
-  }
+  };
+
+  // transform the i-th particle by the action
+  auto evaluate_particle = [&](const int &i, const int &worker_id) {
+    ActionWorkspace &workspace = context.workspaces[worker_id];
+    place_calculator calculator;
+    action_status status = calculator.calculate(
+        particle_set.transform(i), center_of_gravity_of_gripped, vertices,
+        support_surface, gripper_transform, false, false, &workspace);
+    set_action_result(particle_set, i, status, calculator.new_mean, workspace,
+                      validity_check);
+  };
+  update_Lie_distribution_by_action(
+      context, place_update_method, place_min_number_of_particles,
+      place_number_of_particles, place_max_number_of_particles,
+      place_sampling_method, old_mean, old_covariance,
+      place_translation_Jacobian(gripper_transform), linearize,
+      evaluate_particle, new_mean, new_covariance);
+}
+
+action_status PoseEstimator::truncate_grasped_object(
+    const Eigen::Isometry3d &object_pose, const ObjectParts &object,
+    ActionWorkspace &workspace) const {
+  std::vector<Eigen::Vector3d> &cut_vertices = workspace.cut_vertices;
+  cut_vertices.clear();
+  Eigen::Matrix3d object_pose_rotation = object_pose.rotation().matrix();
+  Eigen::Vector3d object_pose_translation = object_pose.translation();
+  // below the gripper height and between the fingers
+  ClippingPlanes planes = {
+      Eigen::Hyperplane<double, 3>(-object_pose_rotation.row(0).transpose(),
+                                   -object_pose_translation(0) +
+                                       gripper_height),
+      Eigen::Hyperplane<double, 3>(object_pose_rotation.row(2).transpose(),
+                                   object_pose_translation(2) +
+                                       gripper_width / 2.0),
+      Eigen::Hyperplane<double, 3>(-object_pose_rotation.row(2).transpose(),
+                                   -object_pose_translation(2) +
+                                       gripper_width / 2.0)};
+  clipping_object(object.vertices, object.triangles, *object.connectivity,
+                  planes, cut_vertices, &workspace);
+  return cut_vertices.size() == 0 ? cannot_be_grasped_status
+                                  : success_status;
 }
 
 void PoseEstimator::grasp_step_with_Lie_distribution(
-    const std::vector<Eigen::Vector3d> &vertices,
+    EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &gripper_transform,
     const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
     Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
-    const bool validity_check) {
-  reset_number_of_particles(grasp_number_of_particles);
-  // calculate the center of gravity
-  Eigen::Vector3d center_of_gravity_of_gripped =
-      calculate_center_of_gravity(vertices, triangles);
-
-  auto truncate_object = [&](const Eigen::Isometry3d &object_pose,
-                             std::vector<Eigen::Vector3d> &cut_vertices) {
-    std::vector<Eigen::Vector3d> temporal_vertices[2];
-    std::vector<boost::array<int, 3>> temporal_triangles[3];
-    Eigen::Matrix3d object_pose_rotation = object_pose.rotation().matrix();
-    Eigen::Vector3d object_pose_translation = object_pose.translation();
-    cutting_object(vertices, triangles,
-                   Eigen::Hyperplane<double, 3>(
-                       -object_pose_rotation.row(0).transpose(),
-                       -object_pose_translation(0) + gripper_height),
-                   temporal_vertices[0], temporal_triangles[0]);
-    cutting_object(temporal_vertices[0], temporal_triangles[0],
-                   Eigen::Hyperplane<double, 3>(
-                       object_pose_rotation.row(2).transpose(),
-                       object_pose_translation(2) + gripper_width / 2.0),
-                   temporal_vertices[1], temporal_triangles[1]);
-    cutting_object(temporal_vertices[1], temporal_triangles[1],
-                   Eigen::Hyperplane<double, 3>(
-                       -object_pose_rotation.row(2).transpose(),
-                       -object_pose_translation(2) + gripper_width / 2.0),
-                   cut_vertices, temporal_triangles[2]);
-    if (cut_vertices.size() == 0) {
-      throw(std::runtime_error("The object cannot be grasped"));
-    }
-  };
+    const bool validity_check) const {
+  MeshConnectivity connectivity;
+  calculate_mesh_connectivity(triangles, connectivity);
+  grasp_step_with_Lie_distribution(
+      context, ObjectParts(vertices, triangles, &connectivity),
+      gripper_transform, old_mean, old_covariance, new_mean, new_covariance,
+      validity_check);
+}
+
+void PoseEstimator::grasp_step_with_Lie_distribution(
+    EstimatorContext &context, const PreparedObject &object,
+    const Eigen::Isometry3d &gripper_transform,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+    const bool validity_check) const {
+  grasp_step_with_Lie_distribution(
+      context, ObjectParts(object), gripper_transform,
+      old_mean, old_covariance, new_mean, new_covariance, validity_check);
+}
 
-  if (use_linear_approximation) {
+void PoseEstimator::grasp_step_with_Lie_distribution(
+    EstimatorContext &context, const ObjectParts &object,
+    const Eigen::Isometry3d &gripper_transform,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+    const bool validity_check) const {
+  if (object.connectivity == nullptr) {
+    throw std::runtime_error("The connectivity of the object is not given");
+  }
+  ParticleSet &particle_set = context.particle_set;
+  const std::vector<Eigen::Vector3d> &vertices = object.hull_vertices;
+  context.reserve_workspaces(
+      thread_pool->get_number_of_threads(), object.vertices.size(),
+      max_number_of_clipped_vertices(object.vertices.size(),
+                                     object.triangles.size(),
+                                     *object.connectivity));
+  context.clear_action_status_counts();
+  const Eigen::Vector3d &center_of_gravity_of_gripped =
+      object.center_of_gravity;
+
+  auto linearize = [&](Eigen::Isometry3d &new_mean,
+                       CovarianceMatrix &new_covariance) {
     // calculate by auto diff
-    std::vector<Eigen::Vector3d> cut_vertices;
-    truncate_object(old_mean, cut_vertices);
-    grasp_update_Lie_distribution(old_mean, old_covariance, cut_vertices,
-                                  vertices, center_of_gravity_of_gripped,
+    action_status status =
+        truncate_grasped_object(old_mean, object, context.workspaces[0]);
+    if (status != success_status) {
+      throw std::runtime_error(action_status_message(status));
+    }
+    grasp_update_Lie_distribution(old_mean, old_covariance,
+                                  context.workspaces[0].cut_vertices, vertices,
+                                  center_of_gravity_of_gripped,
                                   gripper_transform, new_mean, new_covariance);
-  } else {
-    generate_particles(Particle::Zero(), old_covariance);
-    for (int i = 0; i < number_of_particles; i++) {
-      Eigen::Isometry3d input_transform =
-          Eigen::Isometry3d(
-              (Eigen::Matrix<double, 4, 4>)(hat_operator(particles[i]).exp())) *
-          old_mean;
-      try {
-        std::vector<Eigen::Vector3d> cut_vertices;
-        truncate_object(input_transform, cut_vertices);
-        grasp_calculator calculator(cut_vertices, vertices, gripper_transform,
-                                    input_transform,
-                                    center_of_gravity_of_gripped, false, false);
-        particle_transforms[i] = calculator.new_mean;
-        likelihoods[i] = 1.;
-      } catch (std::runtime_error &e) {
-        if (validity_check) {
-          throw e;
-        }
-        likelihoods[i] = 0.0;
-      }
+  };
+
+  // transform the i-th particle by the action
+  auto evaluate_particle = [&](const int &i, const int &worker_id) {
+    Eigen::Isometry3d input_transform = particle_set.transform(i);
+    ActionWorkspace &workspace = context.workspaces[worker_id];
+    grasp_calculator calculator;
+    action_status status =
+        truncate_grasped_object(input_transform, object, workspace);
+    if (status == success_status) {
+      status = calculator.calculate(workspace.cut_vertices, vertices,
+                                    gripper_transform, input_transform,
+                                    center_of_gravity_of_gripped, false, false,
+                                    &workspace, object.convex_hull);
     }
-    calculate_new_Lie_distribution(old_mean, new_mean, new_covariance);
+    set_action_result(particle_set, i, status, calculator.new_mean, workspace,
+                      validity_check);
+  };
+  update_Lie_distribution_by_action(
+      context, grasp_update_method, grasp_min_number_of_particles,
+      grasp_number_of_particles, grasp_max_number_of_particles,
+      grasp_sampling_method, old_mean, old_covariance,
+      grasp_translation_Jacobian(gripper_transform), linearize,
+      evaluate_particle, new_mean, new_covariance);
+}
+
+action_status PoseEstimator::truncate_pushed_object(
+    const Eigen::Isometry3d &object_pose, const ObjectParts &object,
+    ActionWorkspace &workspace) const {
+  std::vector<Eigen::Vector3d> &cut_vertices = workspace.cut_vertices;
+  cut_vertices.clear();
+  Eigen::Matrix3d object_pose_rotation = object_pose.rotation().matrix();
+  Eigen::Vector3d object_pose_translation = object_pose.translation();
+  // below the gripper height and within the thickness of the gripper
+  ClippingPlanes planes = {
+      Eigen::Hyperplane<double, 3>(-object_pose_rotation.row(0).transpose(),
+                                   -object_pose_translation(0) +
+                                       gripper_height),
+      Eigen::Hyperplane<double, 3>(-object_pose_rotation.row(1).transpose(),
+                                   -object_pose_translation(1) +
+                                       gripper_thickness),
+      Eigen::Hyperplane<double, 3>(object_pose_rotation.row(1).transpose(),
+                                   object_pose_translation(1) +
+                                       gripper_thickness)};
+  clipping_object(object.vertices, object.triangles, *object.connectivity,
+                  planes, cut_vertices, &workspace);
+  double center_y = (object_pose * object.center_of_gravity)(1);
+  if (cut_vertices.size() == 0 || center_y < -gripper_thickness ||
+      center_y > gripper_thickness) {
+    return cannot_be_pushed_status;
   }
+  return success_status;
 }
 
 void PoseEstimator::push_step_with_Lie_distribution(
-    const std::vector<Eigen::Vector3d> &vertices,
+    EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &gripper_transform,
     const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
     Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
-    const bool validity_check) {
-  reset_number_of_particles(push_number_of_particles);
-  // calculate the center of gravity
-  Eigen::Vector3d center_of_gravity_of_gripped =
-      calculate_center_of_gravity(vertices, triangles);
-  auto truncate_object = [&](const Eigen::Isometry3d &object_pose,
-                             std::vector<Eigen::Vector3d> &cut_vertices) {
-    std::vector<Eigen::Vector3d> temporal_vertices[2];
-    std::vector<boost::array<int, 3>> temporal_triangles[3];
-    Eigen::Matrix3d object_pose_rotation = object_pose.rotation().matrix();
-    Eigen::Vector3d object_pose_translation = object_pose.translation();
-    cutting_object(vertices, triangles,
-                   Eigen::Hyperplane<double, 3>(
-                       -object_pose_rotation.row(0).transpose(),
-                       -object_pose_translation(0) + gripper_height),
-                   temporal_vertices[0], temporal_triangles[0]);
-    cutting_object(temporal_vertices[0], temporal_triangles[0],
-                   Eigen::Hyperplane<double, 3>(
-                       -object_pose_rotation.row(1).transpose(),
-                       -object_pose_translation(1) + gripper_thickness),
-                   temporal_vertices[1], temporal_triangles[1]);
-    cutting_object(temporal_vertices[1], temporal_triangles[1],
-                   Eigen::Hyperplane<double, 3>(
-                       object_pose_rotation.row(1).transpose(),
-                       object_pose_translation(1) + gripper_thickness),
-                   cut_vertices, temporal_triangles[2]);
-    double center_y = (object_pose * center_of_gravity_of_gripped)(1);
-    if (cut_vertices.size() == 0 || center_y < -gripper_thickness ||
-        center_y > gripper_thickness) {
-      throw(std::runtime_error("The object cannot be pushed, center_y: " +
-                               std::to_string(center_y)));
+    const bool validity_check) const {
+  MeshConnectivity connectivity;
+  calculate_mesh_connectivity(triangles, connectivity);
+  push_step_with_Lie_distribution(
+      context, ObjectParts(vertices, triangles, &connectivity),
+      gripper_transform, old_mean, old_covariance, new_mean, new_covariance,
+      validity_check);
+}
+
+void PoseEstimator::push_step_with_Lie_distribution(
+    EstimatorContext &context, const PreparedObject &object,
+    const Eigen::Isometry3d &gripper_transform,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+    const bool validity_check) const {
+  push_step_with_Lie_distribution(
+      context, ObjectParts(object), gripper_transform,
+      old_mean, old_covariance, new_mean, new_covariance, validity_check);
+}
+
+void PoseEstimator::push_step_with_Lie_distribution(
+    EstimatorContext &context, const ObjectParts &object,
+    const Eigen::Isometry3d &gripper_transform,
+    const Eigen::Isometry3d &old_mean, const CovarianceMatrix &old_covariance,
+    Eigen::Isometry3d &new_mean, CovarianceMatrix &new_covariance,
+    const bool validity_check) const {
+  if (object.connectivity == nullptr) {
+    throw std::runtime_error("The connectivity of the object is not given");
+  }
+  ParticleSet &particle_set = context.particle_set;
+  context.reserve_workspaces(
+      thread_pool->get_number_of_threads(), object.vertices.size(),
+      max_number_of_clipped_vertices(object.vertices.size(),
+                                     object.triangles.size(),
+                                     *object.connectivity));
+  context.clear_action_status_counts();
+  const Eigen::Vector3d &center_of_gravity_of_gripped =
+      object.center_of_gravity;
+
+  auto linearize = [&](Eigen::Isometry3d &new_mean,
+                       CovarianceMatrix &new_covariance) {
+    // calculate by auto diff
+    action_status status =
+        truncate_pushed_object(old_mean, object, context.workspaces[0]);
+    if (status != success_status) {
+      throw std::runtime_error(action_status_message(status));
     }
+    push_update_Lie_distribution(old_mean, old_covariance,
+                                 context.workspaces[0].cut_vertices,
+                                 center_of_gravity_of_gripped,
+                                 gripper_transform, gripper_width, new_mean,
+                                 new_covariance);
   };
 
-  if (use_linear_approximation) {
-    // calculate by auto diff
-    std::vector<Eigen::Vector3d> cut_vertices;
-    truncate_object(old_mean, cut_vertices);
-    push_update_Lie_distribution(
-        old_mean, old_covariance, cut_vertices, center_of_gravity_of_gripped,
-        gripper_transform, gripper_width, new_mean, new_covariance);
-  } else {
-    generate_particles(Particle::Zero(), old_covariance);
-    for (int i = 0; i < number_of_particles; i++) {
-      Eigen::Isometry3d input_transform =
-          Eigen::Isometry3d(
-              (Eigen::Matrix<double, 4, 4>)(hat_operator(particles[i]).exp())) *
-          old_mean;
-      try {
-        std::vector<Eigen::Vector3d> cut_vertices;
-        truncate_object(input_transform, cut_vertices);
-        push_calculator calculator(
-            cut_vertices, gripper_transform, input_transform,
-            center_of_gravity_of_gripped, gripper_width, false);
-        particle_transforms[i] = calculator.new_mean;
-        likelihoods[i] = 1.;
-      } catch (std::runtime_error &e) {
-        if (validity_check) {
-          throw e;
+  // transform the i-th particle by the action
+  auto evaluate_particle = [&](const int &i, const int &worker_id) {
+    Eigen::Isometry3d input_transform = particle_set.transform(i);
+    ActionWorkspace &workspace = context.workspaces[worker_id];
+    push_calculator calculator;
+    action_status status =
+        truncate_pushed_object(input_transform, object, workspace);
+    if (status == success_status) {
+      status = calculator.calculate(workspace.cut_vertices, gripper_transform,
+                                    input_transform,
+                                    center_of_gravity_of_gripped,
+                                    gripper_width, false, &workspace);
+    }
+    set_action_result(particle_set, i, status, calculator.new_mean, workspace,
+                      validity_check);
+  };
+  update_Lie_distribution_by_action(
+      context, push_update_method, push_min_number_of_particles,
+      push_number_of_particles, push_max_number_of_particles,
+      push_sampling_method, old_mean, old_covariance,
+      push_translation_Jacobian(gripper_transform), linearize,
+      evaluate_particle, new_mean, new_covariance);
+}
+
+void prepare_batch(EstimatorContexts &contexts,
+                   const std::vector<PreparedObjectPtr> &objects,
+                   const BatchedBeliefs &beliefs) {
+  // Add the contexts of the beliefs and check their objects
+  if (contexts.size() < beliefs.size()) {
+    contexts.resize(beliefs.size());
+  }
+  for (const auto &belief : beliefs) {
+    if (belief.object < 0 || belief.object >= objects.size() ||
+        !objects[belief.object]) {
+      throw std::runtime_error("The object of a belief is not in the batch");
+    }
+  }
+}
+
+void update_beliefs_one_by_one(
+    EstimatorContexts &contexts, BatchedBeliefs &beliefs,
+    const FunctionRef<void(EstimatorContext &context, BatchedBelief &belief)>
+        &step) {
+  for (int b = 0; b < beliefs.size(); b++) {
+    try {
+      step(contexts[b], beliefs[b]);
+      beliefs[b].success = true;
+      beliefs[b].error_message.clear();
+    } catch (std::runtime_error &e) {
+      beliefs[b].success = false;
+      beliefs[b].error_message = e.what();
+    }
+  }
+}
+
+void PoseEstimator::update_Lie_distributions_by_particles(
+    EstimatorContexts &contexts, const std::vector<PreparedObjectPtr> &objects,
+    BatchedBeliefs &beliefs, const int &number_of_particles,
+    const sampling_method &method, const bool &truncates_object,
+    const FunctionRef<action_status(
+        const int &belief, const Eigen::Isometry3d &object_pose,
+        ActionWorkspace &workspace, Eigen::Isometry3d &new_transform)> &act)
+    const {
+  // The particles of each belief are drawn from the random streams of its
+  // context as in sample_particles, so each belief gets the result of the
+  // step with its context. Then the particles of all beliefs are evaluated by
+  // one parallel loop, whose workers share the workspaces of contexts[0].
+  auto start_time = std::chrono::steady_clock::now();
+  int number_of_beliefs = beliefs.size();
+  if (number_of_beliefs == 0) {
+    return;
+  }
+  int max_number_of_vertices = 0, max_number_of_clipped = 0;
+  for (const auto &object : objects) {
+    if (object) {
+      max_number_of_vertices =
+          std::max(max_number_of_vertices, (int)object->vertices.size());
+      if (truncates_object) {
+        max_number_of_clipped = std::max(
+            max_number_of_clipped,
+            max_number_of_clipped_vertices(object->vertices.size(),
+                                           object->triangles.size(),
+                                           object->connectivity));
+      }
+    }
+  }
+  EstimatorContext &shared_context = contexts[0];
+  shared_context.reserve_workspaces(thread_pool->get_number_of_threads(),
+                                    max_number_of_vertices,
+                                    max_number_of_clipped);
+
+  for (int b = 0; b < number_of_beliefs; b++) {
+    EstimatorContext &context = contexts[b];
+    context.particle_set.resize(number_of_particles);
+    generate_particles(context, Particle::Zero(),
+                       safe_XXT(beliefs[b].old_covariance),
+                       context.random_step++, 0, number_of_particles, method);
+    set_Lie_particle_transforms(context, beliefs[b].old_mean, 0,
+                                number_of_particles);
+  }
+  // Each chunk has the particles of one belief, and the statuses counted by
+  // the chunks of a belief are summed up in the order of the chunks
+  int chunks_per_belief =
+      (number_of_particles + PARTICLES_PER_CHUNK - 1) / PARTICLES_PER_CHUNK;
+  shared_context.chunk_status_counts.resize(number_of_beliefs *
+                                            chunks_per_belief);
+  thread_pool->parallel_for(
+      number_of_beliefs * chunks_per_belief, 1,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        ActionWorkspace &workspace = shared_context.workspaces[worker_id];
+        for (int chunk = begin; chunk < end; chunk++) {
+          int b = chunk / chunks_per_belief,
+              first = (chunk % chunks_per_belief) * PARTICLES_PER_CHUNK,
+              last = std::min(first + PARTICLES_PER_CHUNK, number_of_particles);
+          ParticleSet &particle_set = contexts[b].particle_set;
+          workspace.status_counts.fill(0);
+          for (int i = first; i < last; i++) {
+            Eigen::Isometry3d new_transform;
+            action_status status =
+                act(b, particle_set.transform(i), workspace, new_transform);
+            set_action_result(particle_set, i, status, new_transform,
+                              workspace, false);
+          }
+          shared_context.chunk_status_counts[chunk] = workspace.status_counts;
         }
-        likelihoods[i] = 0.0;
+      });
+  for (int b = 0; b < number_of_beliefs; b++) {
+    ActionStatusCounts &counts = contexts[b].action_status_counts;
+    counts.fill(0);
+    for (int chunk = b * chunks_per_belief;
+         chunk < (b + 1) * chunks_per_belief; chunk++) {
+      for (int k = 0; k < number_of_action_statuses; k++) {
+        counts[k] += shared_context.chunk_status_counts[chunk][k];
       }
     }
-    calculate_new_Lie_distribution(old_mean, new_mean, new_covariance);
+    print_action_status_counts(counts);
+  }
+
+  for (int b = 0; b < number_of_beliefs; b++) {
+    BatchedBelief &belief = beliefs[b];
+    try {
+      calculate_new_Lie_distribution(contexts[b], belief.old_mean,
+                                     belief.new_mean, belief.new_covariance);
+      belief.success = true;
+      belief.error_message.clear();
+    } catch (std::runtime_error &e) {
+      belief.success = false;
+      belief.error_message = e.what();
+    }
+  }
+
+  // The time of the batch is shared by the beliefs. As by the single steps,
+  // the update method is not recorded if the update fails.
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start_time)
+                       .count() /
+                   number_of_beliefs;
+  for (int b = 0; b < number_of_beliefs; b++) {
+    if (!beliefs[b].success) {
+      continue;
+    }
+    EstimatorContext &context = contexts[b];
+    context.last_update_method = particle_update;
+    context.last_nonlinearity = -1.0;
+    context.update_method_counts[particle_update]++;
+    context.update_method_seconds[particle_update] += seconds;
+  }
+}
+
+void PoseEstimator::place_steps_with_Lie_distribution(
+    EstimatorContexts &contexts, const std::vector<PreparedObjectPtr> &objects,
+    BatchedBeliefs &beliefs) const {
+  prepare_batch(contexts, objects, beliefs);
+  if (place_update_method != particle_update || use_adaptive_sampling ||
+      use_persistent_particles) {
+    update_beliefs_one_by_one(
+        contexts, beliefs,
+        [&](EstimatorContext &context, BatchedBelief &belief) {
+          place_step_with_Lie_distribution(
+              context, *objects[belief.object], belief.gripper_transform,
+              belief.support_surface, belief.old_mean, belief.old_covariance,
+              belief.new_mean, belief.new_covariance);
+        });
+    return;
   }
+  update_Lie_distributions_by_particles(
+      contexts, objects, beliefs, place_number_of_particles,
+      place_sampling_method, false,
+      [&](const int &b, const Eigen::Isometry3d &object_pose,
+          ActionWorkspace &workspace, Eigen::Isometry3d &new_transform) {
+        const BatchedBelief &belief = beliefs[b];
+        const ObjectParts object(*objects[belief.object]);
+        place_calculator calculator;
+        action_status status = calculator.calculate(
+            object_pose, object.center_of_gravity, object.hull_vertices,
+            belief.support_surface, belief.gripper_transform, false, false,
+            &workspace);
+        new_transform = calculator.new_mean;
+        return status;
+      });
+}
+
+void PoseEstimator::grasp_steps_with_Lie_distribution(
+    EstimatorContexts &contexts, const std::vector<PreparedObjectPtr> &objects,
+    BatchedBeliefs &beliefs) const {
+  prepare_batch(contexts, objects, beliefs);
+  if (grasp_update_method != particle_update || use_adaptive_sampling ||
+      use_persistent_particles) {
+    update_beliefs_one_by_one(
+        contexts, beliefs,
+        [&](EstimatorContext &context, BatchedBelief &belief) {
+          grasp_step_with_Lie_distribution(
+              context, *objects[belief.object], belief.gripper_transform,
+              belief.old_mean, belief.old_covariance, belief.new_mean,
+              belief.new_covariance);
+        });
+    return;
+  }
+  update_Lie_distributions_by_particles(
+      contexts, objects, beliefs, grasp_number_of_particles,
+      grasp_sampling_method, true,
+      [&](const int &b, const Eigen::Isometry3d &object_pose,
+          ActionWorkspace &workspace, Eigen::Isometry3d &new_transform) {
+        const BatchedBelief &belief = beliefs[b];
+        const ObjectParts object(*objects[belief.object]);
+        grasp_calculator calculator;
+        action_status status =
+            truncate_grasped_object(object_pose, object, workspace);
+        if (status == success_status) {
+          status = calculator.calculate(
+              workspace.cut_vertices, object.hull_vertices,
+              belief.gripper_transform, object_pose, object.center_of_gravity,
+              false, false, &workspace, object.convex_hull);
+        }
+        new_transform = calculator.new_mean;
+        return status;
+      });
+}
+
+void PoseEstimator::push_steps_with_Lie_distribution(
+    EstimatorContexts &contexts, const std::vector<PreparedObjectPtr> &objects,
+    BatchedBeliefs &beliefs) const {
+  prepare_batch(contexts, objects, beliefs);
+  if (push_update_method != particle_update || use_adaptive_sampling ||
+      use_persistent_particles) {
+    update_beliefs_one_by_one(
+        contexts, beliefs,
+        [&](EstimatorContext &context, BatchedBelief &belief) {
+          push_step_with_Lie_distribution(
+              context, *objects[belief.object], belief.gripper_transform,
+              belief.old_mean, belief.old_covariance, belief.new_mean,
+              belief.new_covariance);
+        });
+    return;
+  }
+  update_Lie_distributions_by_particles(
+      contexts, objects, beliefs, push_number_of_particles,
+      push_sampling_method, true,
+      [&](const int &b, const Eigen::Isometry3d &object_pose,
+          ActionWorkspace &workspace, Eigen::Isometry3d &new_transform) {
+        const BatchedBelief &belief = beliefs[b];
+        const ObjectParts object(*objects[belief.object]);
+        push_calculator calculator;
+        action_status status =
+            truncate_pushed_object(object_pose, object, workspace);
+        if (status == success_status) {
+          status = calculator.calculate(
+              workspace.cut_vertices, belief.gripper_transform, object_pose,
+              object.center_of_gravity, gripper_width, false, &workspace);
+        }
+        new_transform = calculator.new_mean;
+        return status;
+      });
 }
 
 cv::Point3d to_cv_point(const Eigen::Vector3d &p) {
@@ -721,17 +1720,18 @@ void PoseEstimator::generate_image(
     cv::Mat &image, const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &transform,
-    const boost::array<unsigned int, 4> &ROI) {
+    const boost::array<unsigned int, 4> &ROI) const {
   // generated the estimated binary image seen from the camera when the pose
   // of the gripped object in the world is represented by 'transform'
 
   // Transform the coordinates of the gripped object and convert to
   // cv::Point3d
   int number_of_vertices = vertices.size();
+  std::vector<Eigen::Vector3d> current_vertices;
+  transform_points(transform, vertices, current_vertices);
   std::vector<cv::Point3d> object_points(number_of_vertices);
   for (int i = 0; i < number_of_vertices; i++) {
-    Eigen::Vector3d current_ver = transform * vertices[i];
-    object_points[i] = to_cv_point(current_ver);
+    object_points[i] = to_cv_point(current_vertices[i]);
   }
 
   // Calculate the points projected to the image
@@ -753,8 +1753,9 @@ void PoseEstimator::generate_image(
   }
 }
 
-double PoseEstimator::similarity_of_images(const cv::Mat &estimated_image,
-                                           const cv::Mat &binary_looked_image) {
+double
+PoseEstimator::similarity_of_images(const cv::Mat &estimated_image,
+                                    const cv::Mat &binary_looked_image) const {
   // Calculate the similarity of two binary images
   // The similarity is defined as the number pixels on which both images are 1
   // divided by the number of pixels on which at least one image is 1 in the
@@ -771,21 +1772,28 @@ double PoseEstimator::similarity_of_images(const cv::Mat &estimated_image,
 }
 
 void PoseEstimator::calculate_look_likelihoods(
-    const std::vector<Eigen::Vector3d> &vertices,
+    EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &gripper_transform,
     const cv::Mat &binary_looked_image,
-    const boost::array<unsigned int, 4> &ROI) {
-  for (int i = 0; i < number_of_particles; i++) {
-    cv::Mat estimated_image;
-    generate_image(estimated_image, vertices, triangles,
-                   gripper_transform * particle_transforms[i], ROI);
-    likelihoods[i] = similarity_of_images(estimated_image, binary_looked_image);
-  }
+    const boost::array<unsigned int, 4> &ROI, const int &first,
+    const int &last) const {
+  ParticleSet &particle_set = context.particle_set;
+  thread_pool->parallel_for(
+      last - first, LIKELIHOODS_PER_CHUNK,
+      [&](const int &begin, const int &end, const int &worker_id) {
+        for (int i = first + begin; i < first + end; i++) {
+          cv::Mat estimated_image;
+          generate_image(estimated_image, vertices, triangles,
+                         gripper_transform * particle_set.transform(i), ROI);
+          particle_set.weights(i) =
+              similarity_of_images(estimated_image, binary_looked_image);
+        }
+      });
 }
 
 void PoseEstimator::to_binary_image(const cv::Mat &bgr_image,
-                                    cv::Mat &binary_image) {
+                                    cv::Mat &binary_image) const {
   // convert 'bgr_image', a BGR8 image, to the binary image 'binary_image'
 
   // First, convert it to grayscale image
@@ -797,34 +1805,40 @@ void PoseEstimator::to_binary_image(const cv::Mat &bgr_image,
 }
 
 void PoseEstimator::look_step(
-    const std::vector<Eigen::Vector3d> &vertices,
+    EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &gripper_transform, const cv::Mat &looked_image,
     const boost::array<unsigned int, 4> &ROI, const Particle &old_mean,
     const CovarianceMatrix &old_covariance, Particle &new_mean,
-    CovarianceMatrix &new_covariance) {
-  reset_number_of_particles(look_number_of_particles);
+    CovarianceMatrix &new_covariance) const {
+  ParticleSet &particle_set = context.particle_set;
   cv::Mat looked_image_ROI =
       looked_image(cv::Rect(ROI[2], ROI[0], ROI[3] - ROI[2], ROI[1] - ROI[0]));
   cv::Mat binary_looked_image;
   to_binary_image(looked_image_ROI, binary_looked_image);
-  generate_particles(old_mean, old_covariance);
-  for (int i = 0; i < number_of_particles; i++) {
-    particle_transforms[i] = particle_to_eigen_transform(particles[i]);
-  }
-  calculate_look_likelihoods(vertices, triangles, gripper_transform,
-                             binary_looked_image, ROI);
-  calculate_new_distribution(new_mean, new_covariance);
+  sample_particles(
+      context, look_min_number_of_particles, look_number_of_particles,
+      look_max_number_of_particles, look_sampling_method, old_mean,
+      old_covariance,
+      [&](const int &first, const int &last) {
+        for (int i = first; i < last; i++) {
+          particle_set.set_transform(i, particle_to_eigen_transform(Particle(
+                                            particle_set.tangents.col(i))));
+        }
+        calculate_look_likelihoods(context, vertices, triangles,
+                                   gripper_transform, binary_looked_image, ROI,
+                                   first, last);
+      });
+  calculate_new_distribution(context, new_mean, new_covariance);
 }
 
 void PoseEstimator::look_step_with_Lie_distribution(
-    const std::vector<Eigen::Vector3d> &vertices,
+    EstimatorContext &context, const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<boost::array<int, 3>> &triangles,
     const Eigen::Isometry3d &gripper_transform, const cv::Mat &looked_image,
     const boost::array<unsigned int, 4> &ROI, const Eigen::Isometry3d &old_mean,
     const CovarianceMatrix &old_covariance, Eigen::Isometry3d &new_mean,
-    CovarianceMatrix &new_covariance, const bool already_binary) {
-  reset_number_of_particles(look_number_of_particles);
+    CovarianceMatrix &new_covariance, const bool already_binary) const {
   cv::Mat binary_looked_image;
   if (!already_binary) {
     cv::Mat looked_image_ROI = looked_image(
@@ -833,14 +1847,14 @@ void PoseEstimator::look_step_with_Lie_distribution(
   } else {
     binary_looked_image = looked_image;
   }
-  generate_particles(Particle::Zero(), old_covariance);
-  for (int i = 0; i < number_of_particles; i++) {
-    particle_transforms[i] =
-        Eigen::Isometry3d(
-            (Eigen::Matrix<double, 4, 4>)(hat_operator(particles[i]).exp())) *
-        old_mean;
-  }
-  calculate_look_likelihoods(vertices, triangles, gripper_transform,
-                             binary_looked_image, ROI);
-  calculate_new_Lie_distribution(old_mean, new_mean, new_covariance);
+  sample_Lie_particles(
+      context, look_min_number_of_particles, look_number_of_particles,
+      look_max_number_of_particles, look_sampling_method, old_mean,
+      old_covariance,
+      [&](const int &first, const int &last) {
+        calculate_look_likelihoods(context, vertices, triangles,
+                                   gripper_transform, binary_looked_image, ROI,
+                                   first, last);
+      });
+  calculate_new_Lie_distribution(context, old_mean, new_mean, new_covariance);
 }
@@ -1,5 +1,8 @@
 #include "o2ac_pose_distribution_updater/base/grasp_action_helpers.hpp"
-#include "o2ac_pose_distribution_updater/base/convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/batch_operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/planar_convex_hull.hpp"
+#include <algorithm>
+#include <climits>
 
 namespace {
 const double INF = 1e9, EPS = 1e-9, LARGE_EPS = 1e-3;
@@ -12,44 +15,18 @@ const double INF = 1e9, EPS = 1e-9, LARGE_EPS = 1e-3;
 // 2. provide function to calculate the pose after grasping given a initial pose
 // in the neighborhood of old_mean
 
-void cutting_object(const std::vector<Eigen::Vector3d> &vertices,
-                    const std::vector<boost::array<int, 3>> &triangles,
-                    const Eigen::Hyperplane<double, 3> &plane,
-                    std::vector<Eigen::Vector3d> &result_vertices,
-                    std::vector<boost::array<int, 3>> &result_triangles) {
-  // cut object by plane and take the positive distance side
-  // result is stored in result_vertices and result_triangles
-  // Faces of cut object on the cut plane is ignored, so the result mesh is
-  // imcomplete. but it is not a problem
-
-  std::vector<int> new_index(vertices.size());
-  for (int i = 0; i < vertices.size(); i++) {
-    if (plane.signedDistance(vertices[i]) >= 0.0) {
-      new_index[i] = result_vertices.size();
-      result_vertices.push_back(vertices[i]);
-    } else {
-      new_index[i] = -1;
-    }
-  }
-  std::map<std::pair<int, int>, int> edge_vertex_id;
-  for (auto &triangle : triangles) {
-    for (int k = 0; k < 3; k++) {
-      int a = triangle[k], b = triangle[(k + 1) % 3];
-      if (a < b) {
-        std::pair<int, int> edge(a, b);
-        double distance_0 = plane.signedDistance(vertices[a]),
-               distance_1 = plane.signedDistance(vertices[b]);
-        if (distance_0 * distance_1 < 0.0) {
-          Eigen::Vector3d intersection =
-              (distance_1 * vertices[a] - distance_0 * vertices[b]) /
-              (distance_1 - distance_0);
-          edge_vertex_id[edge] = result_vertices.size();
-          result_vertices.push_back(intersection);
-        }
-      }
-    }
-  }
-  for (auto &triangle : triangles) {
+namespace {
+template <typename EdgeVertexId>
+void cut_triangles(const std::vector<boost::array<int, 3>> &triangles,
+                   const std::vector<int> &new_index,
+                   const EdgeVertexId &edge_vertex_id,
+                   std::vector<boost::array<int, 3>> &result_triangles) {
+  // add the parts of the triangles on the positive side of the plane, where
+  // new_index is the index of each remaining vertex in the result or -1, and
+  // edge_vertex_id(t, a, b) is that of the intersection of the edge (a, b) of
+  // the t-th triangle
+  for (int t = 0; t < triangles.size(); t++) {
+    auto &triangle = triangles[t];
     int number_of_remain = 0;
     for (int k = 0; k < 3; k++) {
       if (new_index[triangle[k]] != -1) {
@@ -63,12 +40,8 @@ void cutting_object(const std::vector<Eigen::Vector3d> &vertices,
       int v1 = (v0 + 1) % 3, v2 = (v0 + 2) % 3;
       boost::array<int, 3> new_triangle;
       new_triangle[v0] = new_index[triangle[v0]];
-      new_triangle[v1] =
-          edge_vertex_id[std::make_pair(std::min(triangle[v0], triangle[v1]),
-                                        std::max(triangle[v0], triangle[v1]))];
-      new_triangle[v2] =
-          edge_vertex_id[std::make_pair(std::min(triangle[v0], triangle[v2]),
-                                        std::max(triangle[v0], triangle[v2]))];
+      new_triangle[v1] = edge_vertex_id(t, v0, v1);
+      new_triangle[v2] = edge_vertex_id(t, v2, v0);
       result_triangles.push_back(new_triangle);
     } else if (number_of_remain == 2) {
       int v0 = 0;
@@ -76,15 +49,11 @@ void cutting_object(const std::vector<Eigen::Vector3d> &vertices,
         v0++; // triangle[v0] is the only vertices not to remain
       int v1 = (v0 + 1) % 3, v2 = (v0 + 2) % 3;
       boost::array<int, 3> new_triangle_0, new_triangle_1;
-      new_triangle_0[v0] =
-          edge_vertex_id[std::make_pair(std::min(triangle[v0], triangle[v1]),
-                                        std::max(triangle[v0], triangle[v1]))];
+      new_triangle_0[v0] = edge_vertex_id(t, v0, v1);
       new_triangle_0[v1] = new_index[triangle[v1]];
       new_triangle_0[v2] = new_index[triangle[v2]];
       result_triangles.push_back(new_triangle_0);
-      new_triangle_1[v0] =
-          edge_vertex_id[std::make_pair(std::min(triangle[v0], triangle[v2]),
-                                        std::max(triangle[v0], triangle[v2]))];
+      new_triangle_1[v0] = edge_vertex_id(t, v2, v0);
       new_triangle_1[v1] = new_triangle_0[v0];
       new_triangle_1[v2] = new_triangle_0[v2];
       result_triangles.push_back(new_triangle_1);
@@ -98,18 +67,211 @@ void cutting_object(const std::vector<Eigen::Vector3d> &vertices,
   }
 }
 
+void cut_vertices(const std::vector<Eigen::Vector3d> &vertices,
+                  const Eigen::Hyperplane<double, 3> &plane,
+                  std::vector<Eigen::Vector3d> &result_vertices,
+                  std::vector<int> &new_index) {
+  // add the vertices on the positive side of the plane
+  new_index.resize(vertices.size());
+  for (int i = 0; i < vertices.size(); i++) {
+    if (plane.signedDistance(vertices[i]) >= 0.0) {
+      new_index[i] = result_vertices.size();
+      result_vertices.push_back(vertices[i]);
+    } else {
+      new_index[i] = -1;
+    }
+  }
+}
+
+bool calculate_intersection(const std::vector<Eigen::Vector3d> &vertices,
+                            const Eigen::Hyperplane<double, 3> &plane,
+                            const int &a, const int &b,
+                            Eigen::Vector3d &intersection) {
+  // the intersection of the edge (a, b) and the plane, if the edge crosses it
+  double distance_0 = plane.signedDistance(vertices[a]),
+         distance_1 = plane.signedDistance(vertices[b]);
+  if (distance_0 * distance_1 < 0.0) {
+    intersection = (distance_1 * vertices[a] - distance_0 * vertices[b]) /
+                   (distance_1 - distance_0);
+    return true;
+  }
+  return false;
+}
+} // namespace
+
+void cutting_object(const std::vector<Eigen::Vector3d> &vertices,
+                    const std::vector<boost::array<int, 3>> &triangles,
+                    const Eigen::Hyperplane<double, 3> &plane,
+                    std::vector<Eigen::Vector3d> &result_vertices,
+                    std::vector<boost::array<int, 3>> &result_triangles) {
+  // cut object by plane and take the positive distance side
+  // result is stored in result_vertices and result_triangles
+  // Faces of cut object on the cut plane is ignored, so the result mesh is
+  // imcomplete. but it is not a problem
+
+  std::vector<int> new_index;
+  cut_vertices(vertices, plane, result_vertices, new_index);
+  // the pairs of an edge (a, b) with a < b and the index of its intersection
+  // with the plane
+  std::vector<std::pair<std::pair<int, int>, int>> edge_vertex_ids;
+  for (auto &triangle : triangles) {
+    for (int k = 0; k < 3; k++) {
+      int a = triangle[k], b = triangle[(k + 1) % 3];
+      Eigen::Vector3d intersection;
+      if (a < b &&
+          calculate_intersection(vertices, plane, a, b, intersection)) {
+        edge_vertex_ids.push_back(
+            std::make_pair(std::make_pair(a, b), (int)result_vertices.size()));
+        result_vertices.push_back(intersection);
+      }
+    }
+  }
+  // find the intersection of the edge (a, b) by binary search. If an edge is
+  // added twice, the last one is used. 0 if the edge does not cross the plane
+  std::sort(edge_vertex_ids.begin(), edge_vertex_ids.end());
+  cut_triangles(triangles, new_index,
+                [&](const int &t, const int &k0, const int &k1) {
+                  int a = triangles[t][k0], b = triangles[t][k1];
+                  std::pair<int, int> edge(std::min(a, b), std::max(a, b));
+                  auto next = std::upper_bound(edge_vertex_ids.begin(),
+                                               edge_vertex_ids.end(),
+                                               std::make_pair(edge, INT_MAX));
+                  return (next != edge_vertex_ids.begin() &&
+                                  (next - 1)->first == edge
+                              ? (next - 1)->second
+                              : 0);
+                },
+                result_triangles);
+}
+
+void clipping_object(const std::vector<Eigen::Vector3d> &vertices,
+                     const std::vector<boost::array<int, 3>> &triangles,
+                     const MeshConnectivity &connectivity,
+                     const ClippingPlanes &planes,
+                     std::vector<Eigen::Vector3d> &result_vertices,
+                     ActionWorkspace *workspace) {
+  // The vertices of the clipped surface are the vertices of the object, the
+  // intersections of the edges of the object with a plane and the
+  // intersections of the triangles with the line shared by two planes, which
+  // are on the positive sides of the other planes. They are found in a pass
+  // over each of them, with the distances of the vertices to the planes
+  // calculated once.
+
+  ActionWorkspace temporary_workspace;
+  ActionWorkspace &buffers =
+      (workspace != nullptr ? *workspace : temporary_workspace);
+  const int number_of_planes = planes.size();
+
+  std::vector<Eigen::Vector3d> &distances = buffers.plane_distances;
+  distances.resize(vertices.size());
+  for (int i = 0; i < vertices.size(); i++) {
+    for (int p = 0; p < number_of_planes; p++) {
+      distances[i](p) = planes[p].signedDistance(vertices[i]);
+    }
+    if (distances[i].minCoeff() >= 0.0) {
+      result_vertices.push_back(vertices[i]);
+    }
+  }
+
+  // the point where the edge (a, b) crosses the p-th plane, and its distances
+  // to the planes, if the edge crosses it
+  auto cross_plane = [&](const int &a, const int &b, const int &p,
+                         Eigen::Vector3d &point, Eigen::Vector3d &distance) {
+    double distance_a = distances[a](p), distance_b = distances[b](p);
+    if (distance_a * distance_b >= 0.0) {
+      return false;
+    }
+    double ratio = distance_a / (distance_a - distance_b);
+    point = (distance_b * vertices[a] - distance_a * vertices[b]) /
+            (distance_b - distance_a);
+    distance = (1.0 - ratio) * distances[a] + ratio * distances[b];
+    distance(p) = 0.0;
+    return true;
+  };
+
+  for (const auto &edge : connectivity.edges) {
+    for (int p = 0; p < number_of_planes; p++) {
+      Eigen::Vector3d point, distance;
+      if (cross_plane(edge.first, edge.second, p, point, distance) &&
+          distance.minCoeff() >= 0.0) {
+        result_vertices.push_back(point);
+      }
+    }
+  }
+
+  for (const auto &triangle : triangles) {
+    for (int p = 0; p < number_of_planes; p++) {
+      // the segment of the triangle on the p-th plane, whose ends are on the
+      // edges crossing the plane
+      Eigen::Vector3d ends[2], end_distances[2];
+      int number_of_ends = 0;
+      for (int k = 0; k < 3 && number_of_ends < 2; k++) {
+        if (cross_plane(triangle[k], triangle[(k + 1) % 3], p,
+                        ends[number_of_ends], end_distances[number_of_ends])) {
+          number_of_ends++;
+        }
+      }
+      if (number_of_ends < 2) {
+        continue;
+      }
+      for (int q = p + 1; q < number_of_planes; q++) {
+        double distance_0 = end_distances[0](q),
+               distance_1 = end_distances[1](q);
+        if (distance_0 * distance_1 >= 0.0) {
+          continue;
+        }
+        double ratio = distance_0 / (distance_0 - distance_1);
+        Eigen::Vector3d distance =
+            (1.0 - ratio) * end_distances[0] + ratio * end_distances[1];
+        distance(q) = 0.0;
+        if (distance.minCoeff() >= 0.0) {
+          result_vertices.push_back(
+              (distance_1 * ends[0] - distance_0 * ends[1]) /
+              (distance_1 - distance_0));
+        }
+      }
+    }
+  }
+}
+
+int max_number_of_clipped_vertices(const int &number_of_vertices,
+                                   const int &number_of_triangles,
+                                   const MeshConnectivity &connectivity) {
+  const int number_of_planes = std::tuple_size<ClippingPlanes>::value;
+  const int number_of_plane_pairs =
+      number_of_planes * (number_of_planes - 1) / 2;
+  return number_of_vertices + number_of_planes * connectivity.edges.size() +
+         number_of_plane_pairs * number_of_triangles;
+}
+
 grasp_calculator::grasp_calculator(
     const std::vector<Eigen::Vector3d> &vertices,
     const std::vector<Eigen::Vector3d> &all_vertices,
     const Eigen::Isometry3d &gripper_transform,
     const Eigen::Isometry3d &old_mean, const Eigen::Vector3d &center_of_gravity,
-    const bool balance_check, const bool stability_check) {
+    const bool balance_check, const bool stability_check,
+    ActionWorkspace *workspace) {
+  action_status status =
+      calculate(vertices, all_vertices, gripper_transform, old_mean,
+                center_of_gravity, balance_check, stability_check, workspace);
+  if (status != success_status) {
+    throw std::runtime_error(action_status_message(status));
+  }
+}
+
+action_status grasp_calculator::calculate(
+    const std::vector<Eigen::Vector3d> &vertices,
+    const std::vector<Eigen::Vector3d> &all_vertices,
+    const Eigen::Isometry3d &gripper_transform,
+    const Eigen::Isometry3d &old_mean, const Eigen::Vector3d &center_of_gravity,
+    const bool balance_check, const bool stability_check,
+    ActionWorkspace *workspace, const ConvexHull *convex_hull) {
 
   // rotate the world coordinates to make the direction of the gripper x-axis
   Eigen::Vector3d gripping_direction =
       gripper_transform.rotation() * Eigen::Vector3d::UnitY();
   if (abs(gripping_direction(2)) > LARGE_EPS) {
-    throw(std::runtime_error("Invalid gripper transform"));
+    return invalid_gripper_transform_status;
   }
   Eigen::AngleAxisd initial_rotation(
       -std::atan2(gripping_direction(1), gripping_direction(0)),
@@ -119,36 +281,49 @@ grasp_calculator::grasp_calculator(
   this->old_mean = old_mean;
   this->center_of_gravity = center_of_gravity;
 
+  ActionWorkspace temporary_workspace;
+  ActionWorkspace &buffers =
+      (workspace != nullptr ? *workspace : temporary_workspace);
+
   Eigen::Isometry3d current_transform = rotated_gripper_transform * old_mean;
-  std::vector<Eigen::Vector3d> current_vertices(vertices.size());
-  for (int i = 0; i < vertices.size(); i++) {
-    current_vertices[i] = current_transform * vertices[i];
-  }
+  std::vector<Eigen::Vector3d> &current_vertices = buffers.current_vertices;
+  transform_points(current_transform, vertices, current_vertices);
 
   // find the ground touching vertex before grasping
 
-  std::vector<Eigen::Vector3d> current_all_vertices(all_vertices.size());
-  for (int i = 0; i < all_vertices.size(); i++) {
-    current_all_vertices[i] = current_transform * all_vertices[i];
-  }
+  std::vector<Eigen::Vector3d> &current_all_vertices =
+      buffers.current_all_vertices;
   int ground_touch_vertex_id_1 = 0;
-  for (int i = 1; i < current_all_vertices.size(); i++) {
-    if (current_all_vertices[i](2) <
-        current_all_vertices[ground_touch_vertex_id_1](2) - EPS) {
-      ground_touch_vertex_id_1 = i;
+  double ground_z_before;
+  if (convex_hull != nullptr) {
+    ground_touch_vertex_id_1 = find_support_vertex(
+        *convex_hull, -current_transform.linear().row(2).transpose());
+    ground_z_before =
+        (current_transform * all_vertices[ground_touch_vertex_id_1])(2);
+  } else {
+    transform_points(current_transform, all_vertices, current_all_vertices);
+    for (int i = 1; i < current_all_vertices.size(); i++) {
+      if (current_all_vertices[i](2) <
+          current_all_vertices[ground_touch_vertex_id_1](2) - EPS) {
+        ground_touch_vertex_id_1 = i;
+      }
     }
+    ground_z_before = current_all_vertices[ground_touch_vertex_id_1](2);
   }
 
   // calculate the convex hull of the vertices projected along the z-axis
 
   namespace bg = boost::geometry;
-  std::vector<Eigen::Vector2d> projected_points(current_vertices.size()), hull;
+  std::vector<Eigen::Vector2d> &projected_points = buffers.projected_points,
+                               &hull = buffers.hull;
+  projected_points.resize(current_vertices.size());
+  hull.clear();
 
   for (int i = 0; i < current_vertices.size(); i++) {
     projected_points[i] = current_vertices[i].head<2>();
   }
 
-  convex_hull_for_Eigen_Vector2d(projected_points, hull);
+  calculate_planar_convex_hull(projected_points, hull);
 
   // find the left-most and right-most vertices of the hull
 
@@ -228,12 +403,12 @@ grasp_calculator::grasp_calculator(
   }
   if (balance_check && std::abs(first_rotation_value) < EPS &&
       rotation_angle > EPS) {
-    throw(std::runtime_error("Balanced at the first rotation"));
+    return balanced_at_first_rotation_status;
   }
 
   // find the vertices of the object corresponding the vertices of the hull
   int gripper_touch_vertex_id_1, gripper_touch_vertex_id_2,
-      gripper_touch_vertex_id_3, gripper_touch_vertex_id_4;
+      gripper_touch_vertex_id_3, gripper_touch_vertex_id_4 = -1;
   // define the function to find the vertices of the object corresponding the
   // vertices of hull
   auto search_vertex = [&](int j) {
@@ -242,6 +417,7 @@ grasp_calculator::grasp_calculator(
         return i;
       }
     }
+    return -1;
   };
   // gripper_touch_vertex_1 and gripper_touch_vertex_2 are on the same side,
   // which double_vertex_side means gripper_touch_vertex_3 is on the other side
@@ -254,11 +430,16 @@ grasp_calculator::grasp_calculator(
     gripper_touch_vertex_id_2 = search_vertex(next_vertex_id);
     gripper_touch_vertex_id_3 = search_vertex(left_vertex_id);
   }
+  if (gripper_touch_vertex_id_1 == -1 || gripper_touch_vertex_id_2 == -1 ||
+      gripper_touch_vertex_id_3 == -1) {
+    return vertex_not_found_status;
+  }
 
   // rotated vertices
   Eigen::AngleAxisd first_rotation(first_direction * rotation_angle,
                                    Eigen::Vector3d::UnitZ());
-  std::vector<Eigen::Vector3d> rotated_vertices(current_vertices.size());
+  std::vector<Eigen::Vector3d> &rotated_vertices = buffers.rotated_vertices;
+  rotated_vertices.resize(current_vertices.size());
   for (int i = 0; i < current_vertices.size(); i++) {
     rotated_vertices[i] = first_rotation * current_vertices[i];
   }
@@ -347,27 +528,47 @@ grasp_calculator::grasp_calculator(
   }
   if (balance_check && std::abs(second_direction_value) < EPS &&
       second_angle > EPS) {
-    throw std::runtime_error("Balanced at the second rotation");
+    return balanced_at_second_rotation_status;
+  }
+  // If all the other vertices are on the axis, the second rotation is not
+  // determined
+  if (gripper_touch_vertex_id_4 == -1) {
+    return cannot_be_grasped_status;
   }
   // rotates the vertices
   Eigen::AngleAxisd second_rotation(second_angle, second_axis);
-  std::vector<Eigen::Vector3d> final_vertices(rotated_vertices.size());
+  std::vector<Eigen::Vector3d> &final_vertices = buffers.final_vertices;
+  final_vertices.resize(rotated_vertices.size());
   for (int i = 0; i < rotated_vertices.size(); i++) {
     final_vertices[i] = second_rotation * rotated_vertices[i];
   }
   Eigen::Matrix3d total_rotation = (second_rotation * first_rotation).matrix();
-  std::vector<Eigen::Vector3d> final_all_vertices(current_all_vertices.size());
-  for (int i = 0; i < current_all_vertices.size(); i++) {
-    final_all_vertices[i] = total_rotation * current_all_vertices[i];
-  }
 
   // find the ground touching vertex after grasping
   int ground_touch_vertex_id_2 = 0;
-  for (int i = 1; i < final_all_vertices.size(); i++) {
-    if (final_all_vertices[i](2) <
-        final_all_vertices[ground_touch_vertex_id_2](2) - EPS) {
-      ground_touch_vertex_id_2 = i;
+  double ground_z_after;
+  if (convex_hull != nullptr) {
+    Eigen::Matrix3d final_rotation =
+        total_rotation * current_transform.linear();
+    ground_touch_vertex_id_2 =
+        find_support_vertex(*convex_hull, -final_rotation.row(2).transpose());
+    ground_z_after = (total_rotation *
+                      (current_transform *
+                       all_vertices[ground_touch_vertex_id_2]))(2);
+  } else {
+    std::vector<Eigen::Vector3d> &final_all_vertices =
+        buffers.final_all_vertices;
+    final_all_vertices.resize(current_all_vertices.size());
+    for (int i = 0; i < current_all_vertices.size(); i++) {
+      final_all_vertices[i] = total_rotation * current_all_vertices[i];
     }
+    for (int i = 1; i < final_all_vertices.size(); i++) {
+      if (final_all_vertices[i](2) <
+          final_all_vertices[ground_touch_vertex_id_2](2) - EPS) {
+        ground_touch_vertex_id_2 = i;
+      }
+    }
+    ground_z_after = final_all_vertices[ground_touch_vertex_id_2](2);
   }
 
   gripper_touch_vertex_1 = vertices[gripper_touch_vertex_id_1];
@@ -404,8 +605,12 @@ grasp_calculator::grasp_calculator(
       left_x = final_vertices[gripper_touch_vertex_id_3](0);
       right_x = final_vertices[gripper_touch_vertex_id_1](0);
     }
-    std::vector<Eigen::Vector2d> points_on_left_gripper,
-        points_on_right_gripper;
+    std::vector<Eigen::Vector2d> &points_on_left_gripper =
+                                     buffers.points_on_left_gripper,
+                                 &points_on_right_gripper =
+                                     buffers.points_on_right_gripper;
+    points_on_left_gripper.clear();
+    points_on_right_gripper.clear();
 
     for (auto &vertex : final_vertices) {
       if (vertex(0) <= left_x + LARGE_EPS) {
@@ -415,9 +620,10 @@ grasp_calculator::grasp_calculator(
         points_on_right_gripper.push_back(vertex.tail<2>());
       }
     }
-    if (!do_intersect_convex_hulls(points_on_left_gripper,
-                                   points_on_right_gripper)) {
-      throw(std::runtime_error("Unstable after gripping"));
+    calculate_planar_convex_hull(points_on_left_gripper, buffers.left_hull);
+    calculate_planar_convex_hull(points_on_right_gripper, buffers.right_hull);
+    if (!do_intersect_convex_polygons(buffers.left_hull, buffers.right_hull)) {
+      return unstable_after_gripping_status;
     }
   }
 
@@ -438,15 +644,15 @@ grasp_calculator::grasp_calculator(
                               // center of the gripper
       current_center(1) - final_center(1), // the y-coordinate of the center of
                                            // gravity should be not changed
-      current_all_vertices[ground_touch_vertex_id_1](2) -
-          final_all_vertices[ground_touch_vertex_id_2](
-              2); // the z-coordinate of the bottom point of the
-                  // object should be not changed
+      ground_z_before - ground_z_after; // the z-coordinate of the bottom
+                                        // point of the object should be not
+                                        // changed
 
   // calculate the pose after grasping
   new_mean = rotated_gripper_transform.inverse() *
              Eigen::Translation3d(total_translation) * second_rotation *
              first_rotation * current_transform;
+  return success_status;
 }
 
 template <typename T>
@@ -597,3 +803,19 @@ void grasp_update_Lie_distribution(
   // argument and Jacobian.
   new_covariance = Jacobian * old_covariance * Jacobian.transpose();
 }
+
+Eigen::Matrix3d
+grasp_translation_Jacobian(const Eigen::Isometry3d &gripper_transform) {
+  // The center of gravity in the world coordinates moves by the change of the
+  // translation, and its y and z-coordinates in the rotated gripper
+  // coordinates are kept by the action
+  Eigen::Vector3d gripping_direction =
+      gripper_transform.rotation() * Eigen::Vector3d::UnitY();
+  Eigen::Matrix3d rotation =
+      Eigen::AngleAxisd(-std::atan2(gripping_direction(1),
+                                    gripping_direction(0)),
+                        Eigen::Vector3d::UnitZ()) *
+      gripper_transform.rotation();
+  return rotation.transpose() * Eigen::Vector3d(0.0, 1.0, 1.0).asDiagonal() *
+         rotation;
+}
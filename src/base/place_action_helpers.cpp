@@ -3,7 +3,8 @@ Helper functions for the place action
  */
 
 #include "o2ac_pose_distribution_updater/base/place_action_helpers.hpp"
-#include "o2ac_pose_distribution_updater/base/convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/batch_operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/planar_convex_hull.hpp"
 const double EPS = 1e-9, LARGE_EPS = 1e-3;
 
 int argmin(const std::vector<double> &vec) {
@@ -18,25 +19,31 @@ int argmin(const std::vector<double> &vec) {
   return min_id;
 }
 
-void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
-                       const Eigen::Vector3d &current_center_of_gravity,
-                       int &ground_touch_vertex_id_1,
-                       int &ground_touch_vertex_id_2,
-                       int &ground_touch_vertex_id_3,
-                       Eigen::Quaterniond &rotation, bool &stability,
-                       const bool balance_check) {
+action_status
+find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
+                  const Eigen::Vector3d &current_center_of_gravity,
+                  int &ground_touch_vertex_id_1, int &ground_touch_vertex_id_2,
+                  int &ground_touch_vertex_id_3, Eigen::Quaterniond &rotation,
+                  bool &stability, const bool balance_check,
+                  const bool stability_check, ActionWorkspace *workspace) {
   // Given the coordinates of vertices and center of gravity, find the three
   // points touching the ground after placing The object rotation occured by
   // placing is stored to 'rotation' Stabliity after placing is checked and
-  // stored to 'stability'
+  // stored to 'stability' if stability_check is true, and 'stability' is true
+  // otherwise
 
   const double INF = 1e9;
 
+  ActionWorkspace temporary_workspace;
+  ActionWorkspace &buffers =
+      (workspace != nullptr ? *workspace : temporary_workspace);
+
   int number_of_vertices = current_vertices.size();
 
   // The first point touching the ground is the vertice with the minimum z
   // coordinate
-  std::vector<double> current_vertices_z(number_of_vertices);
+  std::vector<double> &current_vertices_z = buffers.vertex_values;
+  current_vertices_z.resize(number_of_vertices);
   for (int i = 0; i < number_of_vertices; i++) {
     current_vertices_z[i] = current_vertices[i](2);
   }
@@ -50,13 +57,13 @@ void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
       (current_vertices[ground_touch_vertex_id_1] - current_center_of_gravity)
           .cross(Eigen::Vector3d::UnitZ());
   if (balance_check && first_axis.norm() < EPS) {
-    throw std::runtime_error("Balanced at the first rotation");
+    return balanced_at_first_rotation_status;
   }
   first_axis = first_axis.normalized();
   // When another point touches the ground, the rotation stops
   // So the second touching point is the vertices with the minimum rotation
   // angle to touch the ground
-  std::vector<double> first_angles(number_of_vertices);
+  std::vector<double> &first_angles = buffers.vertex_values;
   for (int i = 0; i < number_of_vertices; i++) {
     Eigen::Vector3d v1v2 =
         current_vertices[i] - current_vertices[ground_touch_vertex_id_1];
@@ -74,7 +81,8 @@ void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
                                    first_axis);
   Eigen::Vector3d rotated_center_of_gravity =
       first_rotation * current_center_of_gravity;
-  std::vector<Eigen::Vector3d> rotated_vertices(number_of_vertices);
+  std::vector<Eigen::Vector3d> &rotated_vertices = buffers.rotated_vertices;
+  rotated_vertices.resize(number_of_vertices);
   for (int i = 0; i < number_of_vertices; i++) {
     rotated_vertices[i] = first_rotation * current_vertices[i];
   }
@@ -91,7 +99,7 @@ void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
       (rotated_center_of_gravity - rotated_vertices[ground_touch_vertex_id_1])
           .cross(second_axis)(2);
   if (balance_check && std::abs(direction) < EPS) {
-    throw std::runtime_error("Balanced at the second rotation");
+    return balanced_at_second_rotation_status;
   }
   if (direction < 0.0) {
     second_axis = -second_axis;
@@ -99,7 +107,7 @@ void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
   // When another point touches the ground, the rotation stops
   // So the third touching point is the vertices with the minimum rotation angle
   // to touch the ground
-  std::vector<double> second_angles(number_of_vertices);
+  std::vector<double> &second_angles = buffers.vertex_values;
   for (int i = 0; i < number_of_vertices; i++) {
     Eigen::Vector3d v1v3 =
         rotated_vertices[i] - rotated_vertices[ground_touch_vertex_id_1];
@@ -117,11 +125,16 @@ void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
   rotation = second_rotation * first_rotation;
 
   // stability check
+  if (!stability_check) {
+    stability = true;
+    return success_status;
+  }
 
   // calculate the coordinates after the second rotation
   Eigen::Vector3d final_center_of_gravity =
       second_rotation * rotated_center_of_gravity;
-  std::vector<Eigen::Vector3d> final_vertices(number_of_vertices);
+  std::vector<Eigen::Vector3d> &final_vertices = buffers.final_vertices;
+  final_vertices.resize(number_of_vertices);
   for (int i = 0; i < number_of_vertices; i++) {
     final_vertices[i] = second_rotation * rotated_vertices[i];
   }
@@ -129,7 +142,8 @@ void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
   // calculate the convex hull of the vertices touching the ground
   double min_z = final_vertices[ground_touch_vertex_id_1](2);
 
-  std::vector<Eigen::Vector2d> points_on_ground;
+  std::vector<Eigen::Vector2d> &points_on_ground = buffers.points_on_ground;
+  points_on_ground.clear();
 
   for (auto &vertex : final_vertices) {
     if (vertex(2) <= min_z + EPS) {
@@ -142,8 +156,10 @@ void find_three_points(const std::vector<Eigen::Vector3d> &current_vertices,
   Eigen::Vector2d projected_center_of_gravity =
       final_center_of_gravity.head<2>();
 
-  stability =
-      check_inside_convex_hull(projected_center_of_gravity, points_on_ground);
+  std::vector<Eigen::Vector2d> &hull = buffers.hull;
+  calculate_planar_convex_hull(points_on_ground, hull);
+  stability = is_inside_convex_polygon(projected_center_of_gravity, hull);
+  return success_status;
 }
 
 template <typename T>
@@ -328,7 +344,21 @@ place_calculator::place_calculator(const Eigen::Isometry3d &old_mean,
                                    const double &support_surface,
                                    const Eigen::Isometry3d &gripper_transform,
                                    const bool balance_check,
-                                   const bool stability_check) {
+                                   const bool stability_check,
+                                   ActionWorkspace *workspace) {
+  action_status status =
+      calculate(old_mean, center_of_gravity, vertices, support_surface,
+                gripper_transform, balance_check, stability_check, workspace);
+  if (status != success_status) {
+    throw std::runtime_error(action_status_message(status));
+  }
+}
+
+action_status place_calculator::calculate(
+    const Eigen::Isometry3d &old_mean, const Eigen::Vector3d &center_of_gravity,
+    const std::vector<Eigen::Vector3d> &vertices, const double &support_surface,
+    const Eigen::Isometry3d &gripper_transform, const bool balance_check,
+    const bool stability_check, ActionWorkspace *workspace) {
   this->center_of_gravity = center_of_gravity;
   this->support_surface = support_surface;
   this->gripper_transform = gripper_transform;
@@ -336,11 +366,11 @@ place_calculator::place_calculator(const Eigen::Isometry3d &old_mean,
 
   Eigen::Vector3d current_center_of_gravity =
       gripper_transform * old_mean * center_of_gravity;
-  int number_of_vertices = vertices.size();
-  std::vector<Eigen::Vector3d> current_vertices(number_of_vertices);
-  for (int i = 0; i < number_of_vertices; i++) {
-    current_vertices[i] = gripper_transform * old_mean * vertices[i];
-  }
+  ActionWorkspace temporary_workspace;
+  ActionWorkspace &buffers =
+      (workspace != nullptr ? *workspace : temporary_workspace);
+  std::vector<Eigen::Vector3d> &current_vertices = buffers.current_vertices;
+  transform_points(gripper_transform * old_mean, vertices, current_vertices);
 
   // calculate the three vertices of the object touching the ground
   int ground_touch_vertex_id_1, ground_touch_vertex_id_2,
@@ -348,18 +378,21 @@ place_calculator::place_calculator(const Eigen::Isometry3d &old_mean,
                                 // the second and the third.
   Eigen::Quaterniond rotation;
   bool stability;
-  find_three_points(current_vertices, current_center_of_gravity,
-                    ground_touch_vertex_id_1, ground_touch_vertex_id_2,
-                    ground_touch_vertex_id_3, rotation, stability,
-                    balance_check);
+  action_status status = find_three_points(
+      current_vertices, current_center_of_gravity, ground_touch_vertex_id_1,
+      ground_touch_vertex_id_2, ground_touch_vertex_id_3, rotation, stability,
+      balance_check, stability_check, &buffers);
+  if (status != success_status) {
+    return status;
+  }
 
   ground_touch_vertex_1 = vertices[ground_touch_vertex_id_1];
   ground_touch_vertex_2 = vertices[ground_touch_vertex_id_2];
   ground_touch_vertex_3 = vertices[ground_touch_vertex_id_3];
 
-  // If the object is not stable after placing, throw exception
+  // If the object is not stable after placing, the placing fails
   if (stability_check && !stability) {
-    throw std::runtime_error("Unstable after placing");
+    return unstable_after_placing_status;
   }
 
   // calculate new mean
@@ -384,6 +417,7 @@ place_calculator::place_calculator(const Eigen::Isometry3d &old_mean,
   new_mean = gripper_transform.inverse() *
              Eigen::Translation3d(final_translation) * rotation *
              gripper_transform * old_mean;
+  return success_status;
 }
 
 class calculate_perturbation : public place_calculator {
@@ -457,3 +491,13 @@ void place_update_Lie_distribution(const Eigen::Isometry3d &old_mean,
   // argument and Jacobian.
   new_covariance = Jacobian * old_covariance * Jacobian.transpose();
 }
+
+Eigen::Matrix3d
+place_translation_Jacobian(const Eigen::Isometry3d &gripper_transform) {
+  // The center of gravity in the world coordinates moves by the change of the
+  // translation, and its x and y-coordinates in the gripper coordinates are
+  // kept by the action
+  Eigen::Matrix3d rotation = gripper_transform.rotation();
+  return rotation.transpose() * Eigen::Vector3d(1.0, 1.0, 0.0).asDiagonal() *
+         rotation;
+}
@@ -0,0 +1,197 @@
+#include "o2ac_pose_distribution_updater/base/planar_convex_hull.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// The relative error bound of the orientation determinant calculated by
+// doubles, (3 + 16 * epsilon) * epsilon with epsilon = 2^-53
+const double ORIENTATION_ERROR_BOUND = 3.3306690738754716e-16;
+
+void two_sum(const double a, const double b, double &sum, double &error) {
+  // sum + error == a + b exactly. The arguments are copied since sum may be
+  // one of them.
+  sum = a + b;
+  double b_virtual = sum - a, a_virtual = sum - b_virtual;
+  error = (a - a_virtual) + (b - b_virtual);
+}
+
+int exact_orientation_2d(const Eigen::Vector2d &a, const Eigen::Vector2d &b,
+                         const Eigen::Vector2d &c) {
+  // The determinant is the sum of the six products of the coordinates, and
+  // each product is the sum of two doubles. The terms are accumulated into a
+  // nonoverlapping expansion, whose sign is that of its largest component.
+  const double factors[6][2] = {{a(0), b(1)},  {-a(0), c(1)}, {-a(1), b(0)},
+                                {a(1), c(0)},  {b(0), c(1)},  {-b(1), c(0)}};
+  double expansion[12];
+  int length = 0;
+  for (int k = 0; k < 6; k++) {
+    double product = factors[k][0] * factors[k][1];
+    double terms[2] = {product,
+                       std::fma(factors[k][0], factors[k][1], -product)};
+    for (const double &term : terms) {
+      double sum = term;
+      for (int i = 0; i < length; i++) {
+        two_sum(sum, expansion[i], sum, expansion[i]);
+      }
+      expansion[length++] = sum;
+    }
+  }
+  for (int i = length - 1; i >= 0; i--) {
+    if (expansion[i] != 0.0) {
+      return (expansion[i] > 0.0 ? 1 : -1);
+    }
+  }
+  return 0;
+}
+
+bool lexicographically_less(const Eigen::Vector2d &a,
+                            const Eigen::Vector2d &b) {
+  return a(0) < b(0) || (a(0) == b(0) && a(1) < b(1));
+}
+
+bool is_on_segment(const Eigen::Vector2d &point, const Eigen::Vector2d &a,
+                   const Eigen::Vector2d &b) {
+  return orientation_2d(a, b, point) == 0 &&
+         std::min(a(0), b(0)) <= point(0) && point(0) <= std::max(a(0), b(0)) &&
+         std::min(a(1), b(1)) <= point(1) && point(1) <= std::max(a(1), b(1));
+}
+
+bool do_intersect_segments(const Eigen::Vector2d &a, const Eigen::Vector2d &b,
+                           const Eigen::Vector2d &c, const Eigen::Vector2d &d) {
+  int orientation_c = orientation_2d(a, b, c),
+      orientation_d = orientation_2d(a, b, d),
+      orientation_a = orientation_2d(c, d, a),
+      orientation_b = orientation_2d(c, d, b);
+  if (orientation_c * orientation_d < 0 && orientation_a * orientation_b < 0) {
+    return true;
+  }
+  return is_on_segment(c, a, b) || is_on_segment(d, a, b) ||
+         is_on_segment(a, c, d) || is_on_segment(b, c, d);
+}
+
+bool is_inside_or_on_convex_polygon(const Eigen::Vector2d &point,
+                                    const std::vector<Eigen::Vector2d> &hull) {
+  int size = hull.size();
+  if (size == 1) {
+    return point == hull[0];
+  } else if (size == 2) {
+    return is_on_segment(point, hull[0], hull[1]);
+  }
+  for (int i = 0; i < size; i++) {
+    if (orientation_2d(hull[i], hull[(i + 1) % size], point) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+int orientation_2d(const Eigen::Vector2d &a, const Eigen::Vector2d &b,
+                   const Eigen::Vector2d &c) {
+  double left = (b(0) - a(0)) * (c(1) - a(1)),
+         right = (b(1) - a(1)) * (c(0) - a(0));
+  double determinant = left - right;
+  double bound = ORIENTATION_ERROR_BOUND * (std::abs(left) + std::abs(right));
+  if (determinant > bound) {
+    return 1;
+  } else if (determinant < -bound) {
+    return -1;
+  }
+  return exact_orientation_2d(a, b, c);
+}
+
+void calculate_planar_convex_hull(std::vector<Eigen::Vector2d> &points,
+                                  std::vector<Eigen::Vector2d> &hull) {
+  hull.clear();
+  int number_of_points = points.size();
+  if (number_of_points == 0) {
+    return;
+  }
+  std::sort(points.begin(), points.end(), lexicographically_less);
+
+  // the lower chain from the left to the right, and then the upper chain back
+  // to the first point, which is added twice and removed at the end. The
+  // duplicated points are skipped.
+  for (int i = 0; i < number_of_points; i++) {
+    if (i > 0 && points[i] == points[i - 1]) {
+      continue;
+    }
+    while (hull.size() >= 2 &&
+           orientation_2d(hull[hull.size() - 2], hull.back(), points[i]) <= 0) {
+      hull.pop_back();
+    }
+    hull.push_back(points[i]);
+  }
+  const int lower_size = hull.size();
+  for (int i = number_of_points - 2; i >= 0; i--) {
+    if (points[i] == points[i + 1]) {
+      continue;
+    }
+    while (hull.size() > lower_size &&
+           orientation_2d(hull[hull.size() - 2], hull.back(), points[i]) <= 0) {
+      hull.pop_back();
+    }
+    hull.push_back(points[i]);
+  }
+  if (hull.size() > 1) {
+    hull.pop_back();
+  }
+}
+
+bool is_inside_convex_polygon(const Eigen::Vector2d &point,
+                              const std::vector<Eigen::Vector2d> &hull) {
+  int size = hull.size();
+  if (size < 3) {
+    return false;
+  }
+  // the point must be in the cone of the polygon at hull[0], and then in the
+  // triangle (hull[0], hull[low], hull[low + 1]) found by a binary search
+  if (orientation_2d(hull[0], hull[1], point) <= 0 ||
+      orientation_2d(hull[0], hull[size - 1], point) >= 0) {
+    return false;
+  }
+  int low = 1, high = size - 1;
+  while (high - low > 1) {
+    int middle = (low + high) / 2;
+    if (orientation_2d(hull[0], hull[middle], point) > 0) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return orientation_2d(hull[low], hull[low + 1], point) > 0;
+}
+
+bool do_intersect_convex_polygons(const std::vector<Eigen::Vector2d> &hull_0,
+                                  const std::vector<Eigen::Vector2d> &hull_1) {
+  if (hull_0.empty() || hull_1.empty()) {
+    return false;
+  }
+  // Either a vertex of a polygon is in the other, or their boundaries cross
+  for (const auto &vertex : hull_0) {
+    if (is_inside_or_on_convex_polygon(vertex, hull_1)) {
+      return true;
+    }
+  }
+  for (const auto &vertex : hull_1) {
+    if (is_inside_or_on_convex_polygon(vertex, hull_0)) {
+      return true;
+    }
+  }
+  // a point has no edge, and a segment has one
+  if (hull_0.size() == 1 || hull_1.size() == 1) {
+    return false;
+  }
+  int edges_0 = (hull_0.size() == 2 ? 1 : hull_0.size()),
+      edges_1 = (hull_1.size() == 2 ? 1 : hull_1.size());
+  for (int i = 0; i < edges_0; i++) {
+    for (int j = 0; j < edges_1; j++) {
+      if (do_intersect_segments(hull_0[i], hull_0[(i + 1) % hull_0.size()],
+                                hull_1[j],
+                                hull_1[(j + 1) % hull_1.size()])) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
@@ -1,52 +1,53 @@
 #include "o2ac_pose_distribution_updater/base/planner.hpp"
-#include "o2ac_pose_distribution_updater/base/convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/planar_convex_hull.hpp"
 
 namespace {
 double LARGE_EPS = 1e-3, EPS = 1e-9, INF = 1e9;
 double pi = acos(-1);
 } // namespace
 
-void Planner::apply_action(const Eigen::Isometry3d &old_mean,
+void Planner::apply_action(EstimatorContext &context,
+                           const Eigen::Isometry3d &old_mean,
                            const CovarianceMatrix &old_covariance,
                            const UpdateAction &action,
                            Eigen::Isometry3d &new_mean,
-                           CovarianceMatrix &new_covariance) {
+                           CovarianceMatrix &new_covariance) const {
   if (action.type == place_action_type) {
-    place_step_with_Lie_distribution(
-        gripped_geometry->vertices, gripped_geometry->triangles,
-        action.gripper_pose, support_surface, old_mean, old_covariance,
-        new_mean, new_covariance, true);
+    place_step_with_Lie_distribution(context, *gripped_object,
+                                     action.gripper_pose, support_surface,
+                                     old_mean, old_covariance, new_mean,
+                                     new_covariance, true);
     new_mean = action.gripper_pose * new_mean;
     new_covariance = transform_covariance(action.gripper_pose, new_covariance);
   } else if (action.type == grasp_action_type) {
     grasp_step_with_Lie_distribution(
-        gripped_geometry->vertices, gripped_geometry->triangles,
-        action.gripper_pose, action.gripper_pose.inverse() * old_mean,
+        context, *gripped_object, action.gripper_pose,
+        action.gripper_pose.inverse() * old_mean,
         transform_covariance(action.gripper_pose.inverse(), old_covariance),
         new_mean, new_covariance, true);
   } else if (action.type == push_action_type) {
     push_step_with_Lie_distribution(
-        gripped_geometry->vertices, gripped_geometry->triangles,
-        action.gripper_pose, action.gripper_pose.inverse() * old_mean,
+        context, *gripped_object, action.gripper_pose,
+        action.gripper_pose.inverse() * old_mean,
         transform_covariance(action.gripper_pose.inverse(), old_covariance),
         new_mean, new_covariance, true);
     new_mean = action.gripper_pose * new_mean;
     new_covariance = transform_covariance(action.gripper_pose, new_covariance);
   } else if (action.type == touch_action_type) {
     touched_step_with_Lie_distribution(
-        0, gripped_geometry->vertices, gripped_geometry->triangles,
+        context, 0, *gripped_object,
         eigen_to_fcl_transform(action.gripper_pose), old_mean, old_covariance,
         new_mean, new_covariance);
   } else if (action.type == look_action_type) {
     cv::Mat mean_image;
     boost::array<unsigned int, 4> ROI{0, image_height, 0, image_width};
-    generate_image(mean_image, gripped_geometry->vertices,
-                   gripped_geometry->triangles, action.gripper_pose * old_mean,
+    generate_image(mean_image, gripped_object->vertices,
+                   gripped_object->triangles, action.gripper_pose * old_mean,
                    ROI);
-    look_step_with_Lie_distribution(
-        gripped_geometry->vertices, gripped_geometry->triangles,
-        action.gripper_pose, mean_image, ROI, old_mean, old_covariance,
-        new_mean, new_covariance, true);
+    look_step_with_Lie_distribution(context, *gripped_object,
+                                    action.gripper_pose, mean_image, ROI,
+                                    old_mean, old_covariance, new_mean,
+                                    new_covariance, true);
   }
 }
 
@@ -62,10 +63,11 @@ Eigen::AngleAxisd rotation_to_minus_Z(const Eigen::Vector3d &vector) {
 void Planner::calculate_action_candidates(
     const Eigen::Isometry3d &current_gripper_pose,
     const Eigen::Isometry3d &current_mean, const CovarianceMatrix &covariance,
-    const bool &gripping, std::vector<UpdateAction> &candidates) {
+    const bool &gripping, RandomStream &stream,
+    std::vector<UpdateAction> &candidates) const {
   if (gripping) {
     // add place action candidates
-    for (auto &plane : place_candidates) {
+    for (auto &plane : gripped_object->place_candidates) {
       UpdateAction action;
       action.type = place_action_type;
 
@@ -104,16 +106,18 @@ void Planner::calculate_action_candidates(
     }
     // add touch action candidates
     int number_of_touch_actions = 10;
-    auto random_array = std::move(
-        get_random_array(number_of_touch_actions, convex_hull_vertices.size()));
+    const std::vector<Eigen::Vector3d> &convex_hull_vertices =
+        gripped_object->convex_hull.vertices;
+    auto random_array = std::move(get_random_array(
+        number_of_touch_actions, convex_hull_vertices.size(), stream));
     for (int t = 0; t < random_array.size(); t++) {
       auto &vertex = convex_hull_vertices[random_array[t]];
       UpdateAction action;
       action.type = touch_action_type;
 
-      Eigen::Vector3d direction = current_gripper_pose.rotation() *
-                                  current_mean.rotation() *
-                                  (vertex - center_of_gravity);
+      Eigen::Vector3d direction =
+          current_gripper_pose.rotation() * current_mean.rotation() *
+          (vertex - gripped_object->center_of_gravity);
 
       Eigen::Isometry3d rotated_gripper_pose =
           rotation_to_minus_Z(direction) * current_gripper_pose;
@@ -136,9 +140,9 @@ void Planner::calculate_action_candidates(
           current_gripper_pose *
           Eigen::AngleAxisd(pi / 2.0 * t, Eigen::Vector3d::UnitX());
       action.gripper_pose =
-          Eigen::Translation3d(looked_point - rotated_gripper_pose *
-                                                  current_mean *
-                                                  center_of_gravity) *
+          Eigen::Translation3d(looked_point -
+                               rotated_gripper_pose * current_mean *
+                                   gripped_object->center_of_gravity) *
           rotated_gripper_pose;
 
       if ((*validity_checker)(look_action_type, current_gripper_pose,
@@ -160,21 +164,24 @@ void Planner::calculate_action_candidates(
         }
       }
     }
+    // the projection of the convex hull has the same hull as that of the
+    // object
     std::vector<Eigen::Vector2d> projected_points, hull;
-    std::transform(gripped_geometry->vertices.begin(),
-                   gripped_geometry->vertices.end(),
+    std::transform(gripped_object->convex_hull.vertices.begin(),
+                   gripped_object->convex_hull.vertices.end(),
                    std::back_inserter(projected_points),
                    [&current_mean](const Eigen::Vector3d &vertex) {
                      return (Eigen::Vector2d)(current_mean * vertex).head<2>();
                    });
 
-    convex_hull_for_Eigen_Vector2d(projected_points, hull);
+    calculate_planar_convex_hull(projected_points, hull);
 
-    Eigen::Vector3d current_center = current_mean * center_of_gravity;
+    Eigen::Vector3d current_center =
+        current_mean * gripped_object->center_of_gravity;
     Eigen::Vector2d projected_center = current_center.head<2>();
     int number_of_push_actions = 10;
-    auto random_array =
-        std::move(get_random_array(number_of_push_actions, hull.size()));
+    auto random_array = std::move(
+        get_random_array(number_of_push_actions, hull.size(), stream));
     for (int t = 0; t < random_array.size(); t++) {
       int i = random_array[t], j = (i + 1) % hull.size();
       Eigen::Vector2d edge = (hull[j] - hull[i]).normalized();
@@ -226,15 +233,20 @@ void Planner::set_geometry(
     const std::shared_ptr<mesh_object> &gripped_geometry,
     const std::shared_ptr<std::vector<Eigen::Isometry3d>> &grasp_points,
     const double &support_surface) {
-  this->gripped_geometry = gripped_geometry;
+  set_geometry(prepare_object(gripped_geometry->vertices,
+                              gripped_geometry->triangles),
+               grasp_points, support_surface);
+}
+
+void Planner::set_geometry(
+    const PreparedObjectPtr &gripped_object,
+    const std::shared_ptr<std::vector<Eigen::Isometry3d>> &grasp_points,
+    const double &support_surface) {
+  this->gripped_object = gripped_object;
   this->grasp_points = grasp_points;
   this->support_surface = support_surface;
-  center_of_gravity = calculate_center_of_gravity(gripped_geometry->vertices,
-                                                  gripped_geometry->triangles);
-  calculate_place_candidates(gripped_geometry->vertices, center_of_gravity,
-                             place_candidates, convex_hull_vertices);
   fprintf(stderr, "number of place candidates:%d\n",
-          (int)place_candidates.size());
+          (int)gripped_object->place_candidates.size());
   Eigen::Isometry3d camera_pose = get_camera_pose();
   looked_point = camera_pose * (-0.10 * Eigen::Vector3d::UnitZ());
 }
@@ -246,6 +258,19 @@ Planner::calculate_plan(const Eigen::Isometry3d &current_gripper_pose,
                         const CovarianceMatrix &current_covariance,
                         const CovarianceMatrix &objective_coefficients,
                         const double &objective_value) {
+  return calculate_plan(default_context, current_gripper_pose,
+                        current_gripping, current_mean, current_covariance,
+                        objective_coefficients, objective_value);
+}
+
+std::vector<UpdateAction>
+Planner::calculate_plan(EstimatorContext &context,
+                        const Eigen::Isometry3d &current_gripper_pose,
+                        const bool &current_gripping,
+                        const Eigen::Isometry3d &current_mean,
+                        const CovarianceMatrix &current_covariance,
+                        const CovarianceMatrix &objective_coefficients,
+                        const double &objective_value) const {
 
   struct node {
     Eigen::Isometry3d mean, gripper_pose;
@@ -290,14 +315,17 @@ Planner::calculate_plan(const Eigen::Isometry3d &current_gripper_pose,
       optimal_score = score;
     }
 
+    // the candidates of each node take a step of the random sequence of the
+    // context, whose stream is not used by particles
+    RandomStream stream(random_seed, context.random_step++, 0);
     std::vector<UpdateAction> candidates;
     calculate_action_candidates(nodes[id].gripper_pose, nodes[id].mean,
                                 nodes[id].covariance, nodes[id].gripping,
-                                candidates);
+                                stream, candidates);
     for (auto &candidate : candidates) {
       node new_node;
       try {
-        apply_action(nodes[id].mean, nodes[id].covariance, candidate,
+        apply_action(context, nodes[id].mean, nodes[id].covariance, candidate,
                      new_node.mean, new_node.covariance);
       } catch (std::runtime_error &e) {
         std::cerr << e.what() << std::endl;
@@ -356,6 +384,19 @@ Planner::best_scores_for_each_costs(
     const Eigen::Isometry3d &current_mean,
     const CovarianceMatrix &current_covariance,
     const CovarianceMatrix &objective_coefficients, const int &max_cost) {
+  return best_scores_for_each_costs(default_context, current_gripper_pose,
+                                    current_gripping, current_mean,
+                                    current_covariance, objective_coefficients,
+                                    max_cost);
+}
+
+std::vector<std::pair<double, std::vector<UpdateAction>>>
+Planner::best_scores_for_each_costs(
+    EstimatorContext &context, const Eigen::Isometry3d &current_gripper_pose,
+    const bool &current_gripping, const Eigen::Isometry3d &current_mean,
+    const CovarianceMatrix &current_covariance,
+    const CovarianceMatrix &objective_coefficients,
+    const int &max_cost) const {
 
   struct node {
     Eigen::Isometry3d mean, gripper_pose;
@@ -393,14 +434,17 @@ Planner::best_scores_for_each_costs(
       continue;
     }
 
+    // the candidates of each node take a step of the random sequence of the
+    // context, whose stream is not used by particles
+    RandomStream stream(random_seed, context.random_step++, 0);
     std::vector<UpdateAction> candidates;
     calculate_action_candidates(nodes[id].gripper_pose, nodes[id].mean,
                                 nodes[id].covariance, nodes[id].gripping,
-                                candidates);
+                                stream, candidates);
     for (auto &candidate : candidates) {
       node new_node;
       try {
-        apply_action(nodes[id].mean, nodes[id].covariance, candidate,
+        apply_action(context, nodes[id].mean, nodes[id].covariance, candidate,
                      new_node.mean, new_node.covariance);
       } catch (std::runtime_error &e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,246 @@
+#include "o2ac_pose_distribution_updater/base/prepared_object.hpp"
+#include "o2ac_pose_distribution_updater/base/convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/planar_convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/estimator.hpp"
+#include "o2ac_pose_distribution_updater/base/random_particle.hpp"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace {
+double EPS = 1e-9;
+// the number of the cells of the support map along a side of a face of the
+// cube
+const int SUPPORT_MAP_RESOLUTION = 4;
+
+int support_map_cell(const Eigen::Vector3d &direction) {
+  // the face of the cube hit by the direction, and the cell of the face
+  int axis;
+  double length = direction.cwiseAbs().maxCoeff(&axis);
+  if (length == 0.0) {
+    return 0;
+  }
+  int face = 2 * axis + (direction(axis) < 0.0 ? 1 : 0);
+  int cell = face;
+  for (int k = 1; k < 3; k++) {
+    double coordinate = direction((axis + k) % 3) / length;
+    cell = cell * SUPPORT_MAP_RESOLUTION +
+           std::min(SUPPORT_MAP_RESOLUTION - 1,
+                    (int)((coordinate + 1.0) / 2.0 * SUPPORT_MAP_RESOLUTION));
+  }
+  return cell;
+}
+};
+
+PreparedObjectPtr
+prepare_object(const std::vector<Eigen::Vector3d> &vertices,
+               const std::vector<boost::array<int, 3>> &triangles) {
+  std::shared_ptr<PreparedObject> object = std::make_shared<PreparedObject>();
+  object->vertices = vertices;
+  object->triangles = triangles;
+  object->center_of_gravity = calculate_center_of_gravity(vertices, triangles);
+  make_BVHModel(object->geometry, vertices, triangles);
+  calculate_mesh_connectivity(triangles, object->connectivity);
+  calculate_convex_hull(vertices, object->convex_hull);
+  calculate_place_candidates(object->convex_hull, object->center_of_gravity,
+                             object->place_candidates);
+  return object;
+}
+
+ObjectParts::ObjectParts(const PreparedObject &object)
+    : vertices(object.vertices), triangles(object.triangles),
+      hull_vertices(object.convex_hull.vertices),
+      connectivity(&object.connectivity), convex_hull(&object.convex_hull),
+      center_of_gravity(object.center_of_gravity) {}
+
+ObjectParts::ObjectParts(const std::vector<Eigen::Vector3d> &vertices,
+                         const std::vector<boost::array<int, 3>> &triangles,
+                         const MeshConnectivity *connectivity)
+    : vertices(vertices), triangles(triangles), hull_vertices(vertices),
+      connectivity(connectivity), convex_hull(nullptr),
+      center_of_gravity(calculate_center_of_gravity(vertices, triangles)) {}
+
+void make_BVHModel(object_geometry_ptr &bvhmodel,
+                   const std::vector<Eigen::Vector3d> &vertices,
+                   const std::vector<boost::array<int, 3>> &triangles) {
+  bvhmodel = object_geometry_ptr(new object_geometry());
+  std::vector<fcl::Vec3f> fcl_points(vertices.size());
+  for (int i = 0; i < vertices.size(); i++) {
+    fcl_points[i] = fcl::Vec3f(vertices[i][0], vertices[i][1], vertices[i][2]);
+  }
+  std::vector<fcl::Triangle> fcl_triangles(triangles.size());
+  for (int j = 0; j < triangles.size(); j++) {
+    fcl_triangles[j] =
+        fcl::Triangle(triangles[j][0], triangles[j][1], triangles[j][2]);
+  }
+  bvhmodel->beginModel(fcl_points.size(), fcl_triangles.size());
+  bvhmodel->addSubModel(fcl_points, fcl_triangles);
+  bvhmodel->endModel();
+}
+
+void calculate_mesh_connectivity(
+    const std::vector<boost::array<int, 3>> &triangles,
+    MeshConnectivity &connectivity) {
+  // sort the pairs of the vertices of the half-edges with their indices, so
+  // that the half-edges of the same edge are adjacent
+  std::vector<std::pair<std::pair<int, int>, int>> sorted_half_edges;
+  sorted_half_edges.reserve(3 * triangles.size());
+  for (int t = 0; t < triangles.size(); t++) {
+    for (int k = 0; k < 3; k++) {
+      int a = triangles[t][k], b = triangles[t][(k + 1) % 3];
+      sorted_half_edges.push_back(std::make_pair(
+          std::make_pair(std::min(a, b), std::max(a, b)), 3 * t + k));
+    }
+  }
+  std::sort(sorted_half_edges.begin(), sorted_half_edges.end());
+
+  connectivity.edges.clear();
+  connectivity.half_edges.resize(sorted_half_edges.size());
+  for (int i = 0; i < sorted_half_edges.size(); i++) {
+    if (i == 0 ||
+        sorted_half_edges[i].first != sorted_half_edges[i - 1].first) {
+      connectivity.edges.push_back(sorted_half_edges[i].first);
+    }
+    connectivity.half_edges[sorted_half_edges[i].second] =
+        connectivity.edges.size() - 1;
+  }
+}
+
+void calculate_convex_hull(const std::vector<Eigen::Vector3d> &vertices,
+                           ConvexHull &hull) {
+  convex_hull_for_Eigen_Vector3d(vertices, hull.vertices, hull.faces);
+
+  // The vertices of the hull are copies of the vertices of the object. The
+  // first of the duplicated vertices is used.
+  auto less = [](const Eigen::Vector3d &a, const Eigen::Vector3d &b) {
+    return std::lexicographical_compare(a.data(), a.data() + 3, b.data(),
+                                        b.data() + 3);
+  };
+  std::map<Eigen::Vector3d, int, decltype(less)> indices(less);
+  for (int i = (int)vertices.size() - 1; i >= 0; i--) {
+    indices[vertices[i]] = i;
+  }
+  hull.vertex_indices.resize(hull.vertices.size());
+  for (int i = 0; i < hull.vertices.size(); i++) {
+    auto found = indices.find(hull.vertices[i]);
+    if (found == indices.end()) {
+      throw std::runtime_error("A vertex of the hull is not in the mesh");
+    }
+    hull.vertex_indices[i] = found->second;
+  }
+
+  hull.adjacency.assign(hull.vertices.size(), std::vector<int>());
+  for (auto &face : hull.faces) {
+    for (int k = 0; k < 3; k++) {
+      hull.adjacency[face[k]].push_back(face[(k + 1) % 3]);
+      hull.adjacency[face[(k + 1) % 3]].push_back(face[k]);
+    }
+  }
+  for (auto &neighbors : hull.adjacency) {
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()),
+                    neighbors.end());
+  }
+
+  hull.support_starts.resize(6 * SUPPORT_MAP_RESOLUTION *
+                             SUPPORT_MAP_RESOLUTION);
+  for (int cell = 0; cell < hull.support_starts.size(); cell++) {
+    int face = cell / (SUPPORT_MAP_RESOLUTION * SUPPORT_MAP_RESOLUTION),
+        axis = face / 2;
+    Eigen::Vector3d direction;
+    direction(axis) = (face % 2 == 0 ? 1.0 : -1.0);
+    direction((axis + 1) % 3) =
+        ((cell / SUPPORT_MAP_RESOLUTION) % SUPPORT_MAP_RESOLUTION + 0.5) * 2.0 /
+            SUPPORT_MAP_RESOLUTION -
+        1.0;
+    direction((axis + 2) % 3) =
+        (cell % SUPPORT_MAP_RESOLUTION + 0.5) * 2.0 / SUPPORT_MAP_RESOLUTION -
+        1.0;
+    int best = 0;
+    for (int i = 1; i < hull.vertices.size(); i++) {
+      if (direction.dot(hull.vertices[i]) >
+          direction.dot(hull.vertices[best])) {
+        best = i;
+      }
+    }
+    hull.support_starts[cell] = best;
+  }
+}
+
+int find_support_vertex(const ConvexHull &hull,
+                        const Eigen::Vector3d &direction) {
+  int vertex = hull.support_starts[support_map_cell(direction)];
+  double value = direction.dot(hull.vertices[vertex]);
+  bool improved = true;
+  while (improved) {
+    // move to the best neighbor, if it is better
+    improved = false;
+    for (const int &neighbor : hull.adjacency[vertex]) {
+      double neighbor_value = direction.dot(hull.vertices[neighbor]);
+      if (neighbor_value > value) {
+        vertex = neighbor;
+        value = neighbor_value;
+        improved = true;
+      }
+    }
+  }
+  return vertex;
+}
+
+void calculate_place_candidates(
+    const ConvexHull &hull, const Eigen::Vector3d &center_of_gravity,
+    std::vector<Eigen::Hyperplane<double, 3>> &candidates) {
+  candidates.clear();
+
+  // To group the faces with the same normal vector, sort the faces by the
+  // inner products of their normals with a random vector. The random vector is
+  // drawn from a fixed stream, so the candidates do not depend on the global
+  // random sequence.
+  RandomStream stream(0, 0, 0);
+  Eigen::Vector3d random_vector = get_UND_Vector3d(stream);
+
+  // pairs of the inner products of the normals of the faces and the random
+  // vector (key to sort faces) and face ids
+  std::vector<std::pair<double, int>> sort_keys;
+  for (int id = 0; id < hull.faces.size(); id++) {
+    auto &face = hull.faces[id];
+    Eigen::Vector3d normal = (hull.vertices[face[1]] - hull.vertices[face[0]])
+                                 .cross(hull.vertices[face[2]] -
+                                        hull.vertices[face[0]])
+                                 .normalized();
+    sort_keys.push_back(std::make_pair(random_vector.dot(normal), id));
+  }
+  std::sort(sort_keys.begin(), sort_keys.end());
+
+  for (int t = 0; t < sort_keys.size();) {
+    // collect vertices of faces with the same normal vectors
+    std::vector<Eigen::Vector3d> facet;
+    double key_bound = sort_keys[t].first + EPS;
+    do {
+      for (int k = 0; k < 3; k++) {
+        facet.push_back(hull.vertices[hull.faces[sort_keys[t].second][k]]);
+      }
+    } while (++t < sort_keys.size() && sort_keys[t].first < key_bound);
+
+    Eigen::Vector3d normal =
+        (facet[1] - facet[0]).cross(facet[2] - facet[0]).normalized();
+    Eigen::Vector3d axis = normal.cross(-Eigen::Vector3d::UnitZ());
+    axis = (axis.norm() != 0.0 ? axis.normalized() : Eigen::Vector3d::UnitX());
+    double angle =
+        atan2(sqrt(pow(normal[0], 2) + pow(normal[1], 2)), -normal[2]);
+    Eigen::AngleAxisd rotation(angle, axis);
+    Eigen::Vector2d projected_center = (rotation * center_of_gravity).head<2>();
+
+    std::vector<Eigen::Vector2d> projected_points, hull_of_facet;
+    std::transform(facet.begin(), facet.end(),
+                   std::back_inserter(projected_points),
+                   [&rotation](const Eigen::Vector3d &vertex) {
+                     return (Eigen::Vector2d)(rotation * vertex).head<2>();
+                   });
+
+    calculate_planar_convex_hull(projected_points, hull_of_facet);
+    if (is_inside_convex_polygon(projected_center, hull_of_facet)) {
+      candidates.push_back(Eigen::Hyperplane<double, 3>(normal, facet[0]));
+    }
+  }
+}
@@ -1,5 +1,5 @@
 #include "o2ac_pose_distribution_updater/base/push_action_helpers.hpp"
-#include "o2ac_pose_distribution_updater/base/convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/planar_convex_hull.hpp"
 
 namespace {
 const double INF = 1e9, EPS = 1e-9, LARGE_EPS = 1e-3;
@@ -10,13 +10,28 @@ push_calculator::push_calculator(const std::vector<Eigen::Vector3d> &vertices,
                                  const Eigen::Isometry3d &old_mean,
                                  const Eigen::Vector3d &center_of_gravity,
                                  const double &gripper_width,
-                                 const bool balance_check) {
+                                 const bool balance_check,
+                                 ActionWorkspace *workspace) {
+  action_status status =
+      calculate(vertices, gripper_transform, old_mean, center_of_gravity,
+                gripper_width, balance_check, workspace);
+  if (status != success_status) {
+    throw std::runtime_error(action_status_message(status));
+  }
+}
+
+action_status push_calculator::calculate(
+    const std::vector<Eigen::Vector3d> &vertices,
+    const Eigen::Isometry3d &gripper_transform,
+    const Eigen::Isometry3d &old_mean, const Eigen::Vector3d &center_of_gravity,
+    const double &gripper_width, const bool balance_check,
+    ActionWorkspace *workspace) {
 
   // rotate the world coordinates to make the direction of the gripper y-axis
   Eigen::Vector3d gripping_direction =
       gripper_transform.rotation() * Eigen::Vector3d::UnitZ();
   if (abs(gripping_direction(2)) > LARGE_EPS) {
-    throw(std::runtime_error("Invalid gripper transform"));
+    return invalid_gripper_transform_status;
   }
   Eigen::AngleAxisd initial_rotation(
       -std::atan2(gripping_direction(1), gripping_direction(0)),
@@ -27,8 +42,13 @@ push_calculator::push_calculator(const std::vector<Eigen::Vector3d> &vertices,
   this->center_of_gravity = center_of_gravity;
   this->gripper_width = gripper_width;
 
+  ActionWorkspace temporary_workspace;
+  ActionWorkspace &buffers =
+      (workspace != nullptr ? *workspace : temporary_workspace);
+
   Eigen::Isometry3d current_transform = rotated_gripper_transform * old_mean;
-  std::vector<Eigen::Vector3d> current_vertices;
+  std::vector<Eigen::Vector3d> &current_vertices = buffers.current_vertices;
+  current_vertices.clear();
   std::transform(vertices.begin(), vertices.end(),
                  std::back_inserter(current_vertices),
                  [current_transform](const Eigen::Vector3d &vertex) {
@@ -40,7 +60,10 @@ push_calculator::push_calculator(const std::vector<Eigen::Vector3d> &vertices,
   Eigen::Vector2d projected_center =
       (current_transform * center_of_gravity).block(0, 0, 2, 1);
 
-  std::vector<Eigen::Vector2d> projected_points, hull;
+  std::vector<Eigen::Vector2d> &projected_points = buffers.projected_points,
+                               &hull = buffers.hull;
+  projected_points.clear();
+  hull.clear();
 
   std::transform(current_vertices.begin(), current_vertices.end(),
                  std::back_inserter(projected_points),
@@ -48,7 +71,7 @@ push_calculator::push_calculator(const std::vector<Eigen::Vector3d> &vertices,
                    return (Eigen::Vector2d)vertex.block(0, 0, 2, 1);
                  });
 
-  convex_hull_for_Eigen_Vector2d(projected_points, hull);
+  calculate_planar_convex_hull(projected_points, hull);
 
   // find the left-most and right-most vertices of the hull
 
@@ -94,16 +117,16 @@ push_calculator::push_calculator(const std::vector<Eigen::Vector3d> &vertices,
     }
     left_vertex_id = next_left_vertex_id;
     if (left_vertex_id == first_left_vertex_id) {
-      throw(std::runtime_error("center of gravity is out of the convex hull"));
+      return center_of_gravity_outside_status;
     }
   }
   if (hull[next_left_vertex_id](0) >
       rotated_gripper_transform.translation()(0) + gripper_width / 2.0) {
-    throw std::runtime_error("gripper does not reach the object");
+    return gripper_does_not_reach_status;
   }
   if (balance_check && std::abs(first_rotation_value) < EPS &&
       rotation.angle() > EPS) {
-    throw(std::runtime_error("Balanced at the first rotation"));
+    return balanced_at_first_rotation_status;
   }
 
   // find the vertices of the object corresponding the vertices of the hull
@@ -116,9 +139,13 @@ push_calculator::push_calculator(const std::vector<Eigen::Vector3d> &vertices,
         return i;
       }
     }
+    return -1;
   };
   int gripper_touch_vertex_id_1 = search_vertex(left_vertex_id);
   int gripper_touch_vertex_id_2 = search_vertex(next_left_vertex_id);
+  if (gripper_touch_vertex_id_1 == -1 || gripper_touch_vertex_id_2 == -1) {
+    return vertex_not_found_status;
+  }
 
   gripper_touch_vertex_1 = vertices[gripper_touch_vertex_id_1];
   gripper_touch_vertex_2 = vertices[gripper_touch_vertex_id_2];
@@ -140,6 +167,7 @@ push_calculator::push_calculator(const std::vector<Eigen::Vector3d> &vertices,
              Eigen::Translation3d(total_translation) *
              Eigen::AngleAxisd(rotation.angle(), Eigen::Vector3d::UnitZ()) *
              current_transform;
+  return success_status;
 }
 
 template <typename T>
@@ -250,3 +278,19 @@ void push_update_Lie_distribution(const Eigen::Isometry3d &old_mean,
   // argument and Jacobian.
   new_covariance = Jacobian * old_covariance * Jacobian.transpose();
 }
+
+Eigen::Matrix3d
+push_translation_Jacobian(const Eigen::Isometry3d &gripper_transform) {
+  // The center of gravity in the world coordinates moves by the change of the
+  // translation, and its y and z-coordinates in the rotated gripper
+  // coordinates are kept by the action
+  Eigen::Vector3d gripping_direction =
+      gripper_transform.rotation() * Eigen::Vector3d::UnitZ();
+  Eigen::Matrix3d rotation =
+      Eigen::AngleAxisd(-std::atan2(gripping_direction(1),
+                                    gripping_direction(0)),
+                        Eigen::Vector3d::UnitZ()) *
+      gripper_transform.rotation();
+  return rotation.transpose() * Eigen::Vector3d(0.0, 1.0, 1.0).asDiagonal() *
+         rotation;
+}
@@ -1,46 +1,180 @@
 #include "o2ac_pose_distribution_updater/base/random_particle.hpp"
-#include <random>
+#include <algorithm>
+#include <atomic>
+#include <boost/math/special_functions/erf.hpp>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
 
 namespace {
-std::random_device seed_generator;
-std::default_random_engine engine(0);
-std::normal_distribution<> unit_normal_distribution(0.0, 1.0);
+// Constants of Philox4x32 (Salmon et al., "Parallel random numbers: as easy
+// as 1, 2, 3", SC11)
+const std::uint32_t PHILOX_M0 = 0xD2511F53, PHILOX_M1 = 0xCD9E8D57;
+const std::uint32_t PHILOX_W0 = 0x9E3779B9, PHILOX_W1 = 0xBB67AE85;
+const int PHILOX_ROUNDS = 10;
+
+// The seed of the streams used by the functions without explicit streams
+const std::uint64_t GLOBAL_SEED = ~(std::uint64_t)0;
+std::atomic<std::uint64_t> next_global_stream(0);
+
+RandomStream next_global_random_stream() {
+  return RandomStream(GLOBAL_SEED, next_global_stream++, 0);
+}
+
+// Sobol sequence with the direction numbers of Joe and Kuo
+// (new-joe-kuo-6.21201). The first dimension is the van der Corput sequence.
+const int SOBOL_DIMENSION = 6, SOBOL_BITS = 32;
+const int SOBOL_DEGREES[SOBOL_DIMENSION] = {0, 1, 2, 3, 3, 4};
+const std::uint32_t SOBOL_COEFFICIENTS[SOBOL_DIMENSION] = {0, 0, 1, 1, 2, 1};
+const std::uint32_t SOBOL_INITIAL_NUMBERS[SOBOL_DIMENSION][4] = {
+    {}, {1}, {1, 3}, {1, 3, 1}, {1, 1, 1}, {1, 1, 3, 3}};
+
+// The stream id of the random stream which gives the scrambling seeds.
+// Particles never have this index.
+const std::uint32_t SCRAMBLING_STREAM_ID = ~(std::uint32_t)0;
+
+using SobolDirections =
+    std::array<std::array<std::uint32_t, SOBOL_BITS>, SOBOL_DIMENSION>;
+
+SobolDirections make_Sobol_directions() {
+  SobolDirections v;
+  for (int j = 0; j < SOBOL_BITS; j++) {
+    v[0][j] = (std::uint32_t)1 << (SOBOL_BITS - 1 - j);
+  }
+  for (int d = 1; d < SOBOL_DIMENSION; d++) {
+    int s = SOBOL_DEGREES[d];
+    std::uint32_t a = SOBOL_COEFFICIENTS[d];
+    for (int j = 0; j < SOBOL_BITS; j++) {
+      if (j < s) {
+        v[d][j] = SOBOL_INITIAL_NUMBERS[d][j] << (SOBOL_BITS - 1 - j);
+      } else {
+        v[d][j] = v[d][j - s] ^ (v[d][j - s] >> s);
+        for (int k = 1; k < s; k++) {
+          if ((a >> (s - 1 - k)) & 1) {
+            v[d][j] ^= v[d][j - k];
+          }
+        }
+      }
+    }
+  }
+  return v;
+}
+
+const SobolDirections SOBOL_DIRECTIONS = make_Sobol_directions();
+
+std::uint32_t reverse_bits(std::uint32_t x) {
+  x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+  x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F) | ((x & 0x0F0F0F0F) << 4);
+  x = ((x >> 8) & 0x00FF00FF) | ((x & 0x00FF00FF) << 8);
+  return (x >> 16) | (x << 16);
+}
+
+std::uint32_t nested_uniform_scramble(std::uint32_t x,
+                                      const std::uint32_t &seed) {
+  // Owen scrambling by the hash of Laine and Karras (Burley, "Practical
+  // Hash-based Owen Scrambling", JCGT 2020). Each bit is flipped depending
+  // only on the higher bits, which keeps the stratification of the sequence.
+  x = reverse_bits(x);
+  x += seed;
+  x ^= x * 0x6c50b47c;
+  x ^= x * 0xb82f1e52;
+  x ^= x * 0xc7afe638;
+  x ^= x * 0x8d22f6e6;
+  return reverse_bits(x);
+}
 } // namespace
 
-template <int D> Eigen::Matrix<double, D, 1> get_UND_Vector() {
-  // Random Vector generator
+RandomStream::RandomStream(const std::uint64_t &seed, const std::uint64_t &step,
+                           const std::uint32_t &stream_id)
+    : key{{(std::uint32_t)seed, (std::uint32_t)(seed >> 32)}},
+      counter{{0, stream_id, (std::uint32_t)step, (std::uint32_t)(step >> 32)}},
+      buffer_position(4), has_spare_normal(false), spare_normal(0.0) {}
 
-  // All coordinates are independent
-  // The distribution of each coordinate is the normal distribution with mean
-  // 0.0, variance 1.0
+std::array<std::uint32_t, 4> RandomStream::next_block() {
+  std::array<std::uint32_t, 4> x = counter;
+  std::array<std::uint32_t, 2> k = key;
+  for (int round = 0; round < PHILOX_ROUNDS; round++) {
+    std::uint64_t product0 = (std::uint64_t)PHILOX_M0 * x[0];
+    std::uint64_t product1 = (std::uint64_t)PHILOX_M1 * x[2];
+    x = {{(std::uint32_t)(product1 >> 32) ^ x[1] ^ k[0],
+          (std::uint32_t)product1,
+          (std::uint32_t)(product0 >> 32) ^ x[3] ^ k[1],
+          (std::uint32_t)product0}};
+    k[0] += PHILOX_W0;
+    k[1] += PHILOX_W1;
+  }
+  counter[0]++;
+  return x;
+}
 
-  Eigen::Matrix<double, D, 1> p;
-  for (int i = 0; i < D; i++) {
-    p(i) = unit_normal_distribution(engine);
+std::uint32_t RandomStream::next_uint32() {
+  if (buffer_position == 4) {
+    buffer = next_block();
+    buffer_position = 0;
   }
-  return p;
+  return buffer[buffer_position++];
 }
 
-Particle get_UND_particle() {
-  // Random Particle generator
-  return get_UND_Vector<6>();
+std::uint64_t RandomStream::next_uint64() {
+  std::uint64_t high = next_uint32();
+  return (high << 32) | next_uint32();
 }
 
-Eigen::Vector3d get_UND_Vector3d() {
+double RandomStream::uniform() {
+  // 53 random bits, shifted by a half to exclude 0 and 1
+  return ((next_uint64() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+std::uint64_t RandomStream::uniform_int(const std::uint64_t &range) {
+  // reject the values which cause bias
+  std::uint64_t threshold = (-range) % range;
+  while (1) {
+    std::uint64_t x = next_uint64();
+    if (x >= threshold) {
+      return x % range;
+    }
+  }
+}
+
+double RandomStream::normal() {
+  // Box-Muller transform
+  if (has_spare_normal) {
+    has_spare_normal = false;
+    return spare_normal;
+  }
+  double radius = std::sqrt(-2.0 * std::log(uniform()));
+  double angle = 2.0 * M_PI * uniform();
+  spare_normal = radius * std::sin(angle);
+  has_spare_normal = true;
+  return radius * std::cos(angle);
+}
+
+Particle get_UND_particle(RandomStream &stream) {
   // Random Particle generator
-  return get_UND_Vector<3>();
+
+  // All coordinates are independent
+  // The distribution of each coordinate is the normal distribution with mean
+  // 0.0, variance 1.0
+  return stream.normal_vector<6>();
 }
 
-std::vector<int> get_random_array(int length, int range) {
+Eigen::Vector3d get_UND_Vector3d(RandomStream &stream) {
+  // Random Vector generator
+  return stream.normal_vector<3>();
+}
+
+std::vector<int> get_random_array(int length, int range,
+                                  RandomStream &stream) {
+  // Random sorted subset of [0, range) with 'length' elements
   std::vector<int> return_array;
   if (length >= range) {
     return_array.resize(range);
     std::iota(return_array.begin(), return_array.end(), 0);
   } else {
     return_array.resize(length);
-    std::uniform_int_distribution<> random_int_generator(0, range - length);
     for (int i = 0; i < length; i++) {
-      return_array[i] = random_int_generator(engine);
+      return_array[i] = stream.uniform_int(range - length + 1);
     }
     std::sort(return_array.begin(), return_array.end());
     for (int i = 1; i < length; i++) {
@@ -49,3 +183,98 @@ std::vector<int> get_random_array(int length, int range) {
   }
   return return_array;
 }
+
+Particle get_QMC_UND_particle(const std::uint64_t &seed,
+                              const std::uint64_t &step,
+                              const std::uint32_t &index) {
+  RandomStream scrambling_stream(seed, step, SCRAMBLING_STREAM_ID);
+  Particle p;
+  for (int d = 0; d < SOBOL_DIMENSION; d++) {
+    std::uint32_t x = 0;
+    for (int j = 0; (index >> j) != 0; j++) {
+      if ((index >> j) & 1) {
+        x ^= SOBOL_DIRECTIONS[d][j];
+      }
+    }
+    x = nested_uniform_scramble(x, scrambling_stream.next_uint32());
+    // u is in the open interval (0, 1)
+    double u = (x + 0.5) / 4294967296.0;
+    p(d) = -std::sqrt(2.0) * boost::math::erfc_inv(2.0 * u);
+  }
+  return p;
+}
+
+std::vector<int>
+get_systematic_resampling_indices(const Eigen::VectorXd &weights,
+                                  const int &number_of_samples,
+                                  RandomStream &stream) {
+  double sum_of_weights = weights.sum();
+  if (!(sum_of_weights > 0.0)) {
+    throw std::runtime_error("The sum of weights is 0");
+  }
+  // The last particle with a positive weight, which absorbs the rounding
+  // errors of the cumulative sum
+  int last = weights.size() - 1;
+  while (weights(last) <= 0.0) {
+    last--;
+  }
+  std::vector<int> indices(number_of_samples);
+  double u = stream.uniform();
+  int i = 0;
+  double cumulative_weight = weights(0);
+  for (int k = 0; k < number_of_samples; k++) {
+    double position = (u + k) * sum_of_weights / number_of_samples;
+    while (i < last && cumulative_weight <= position) {
+      i++;
+      cumulative_weight += weights(i);
+    }
+    indices[k] = i;
+  }
+  return indices;
+}
+
+std::vector<int>
+get_residual_resampling_indices(const Eigen::VectorXd &weights,
+                                const int &number_of_samples,
+                                RandomStream &stream) {
+  double sum_of_weights = weights.sum();
+  if (!(sum_of_weights > 0.0)) {
+    throw std::runtime_error("The sum of weights is 0");
+  }
+  std::vector<int> indices;
+  indices.reserve(number_of_samples);
+  Eigen::VectorXd residuals(weights.size());
+  for (int i = 0; i < weights.size(); i++) {
+    double expected_count =
+        number_of_samples * std::max(weights(i), 0.0) / sum_of_weights;
+    int count = std::floor(expected_count);
+    residuals(i) = expected_count - count;
+    for (int j = 0; j < count && indices.size() < number_of_samples; j++) {
+      indices.push_back(i);
+    }
+  }
+  int number_of_remaining_samples = number_of_samples - indices.size();
+  if (number_of_remaining_samples > 0) {
+    std::vector<int> remaining_indices = get_systematic_resampling_indices(
+        residuals, number_of_remaining_samples, stream);
+    indices.insert(indices.end(), remaining_indices.begin(),
+                   remaining_indices.end());
+    std::sort(indices.begin(), indices.end());
+  }
+  return indices;
+}
+
+Particle get_UND_particle() {
+  RandomStream stream = next_global_random_stream();
+  return get_UND_particle(stream);
+}
+
+Eigen::Vector3d get_UND_Vector3d() {
+  RandomStream stream = next_global_random_stream();
+  return get_UND_Vector3d(stream);
+}
+
+std::vector<int> get_random_array(int length, int range) {
+  RandomStream stream = next_global_random_stream();
+  return get_random_array(length, range, stream);
+}
@@ -0,0 +1,118 @@
+#include "o2ac_pose_distribution_updater/base/thread_pool.hpp"
+#include <algorithm>
+
+int default_number_of_threads() {
+  int number_of_threads = std::thread::hardware_concurrency();
+  return number_of_threads > 0 ? number_of_threads : 1;
+}
+
+ThreadPool::ThreadPool(const int &number_of_threads)
+    : task(nullptr), n(0), chunk_size(1), number_of_chunks(0), next_chunk(0),
+      generation(0), running_workers(0), stopping(false), failed_chunk(-1) {
+  int total_threads =
+      (number_of_threads > 0 ? number_of_threads : default_number_of_threads());
+  for (int worker_id = 1; worker_id < total_threads; worker_id++) {
+    workers.push_back(std::thread(&ThreadPool::worker_loop, this, worker_id));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  job_condition.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::execute_chunks(const int &worker_id) {
+  // take chunks one by one until all chunks are taken
+  while (1) {
+    int chunk_id = next_chunk++;
+    if (chunk_id >= number_of_chunks) {
+      break;
+    }
+    int begin = chunk_id * chunk_size;
+    int end = std::min(begin + chunk_size, n);
+    try {
+      (*task)(begin, end, worker_id);
+    } catch (...) {
+      // keep only the exception of the first chunk to be deterministic
+      std::lock_guard<std::mutex> lock(mutex);
+      if (failed_chunk == -1 || chunk_id < failed_chunk) {
+        failed_chunk = chunk_id;
+        failure = std::current_exception();
+      }
+    }
+  }
+}
+
+void ThreadPool::worker_loop(const int &worker_id) {
+  unsigned long executed_generation = 0;
+  while (1) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      job_condition.wait(lock, [&] {
+        return stopping || generation != executed_generation;
+      });
+      if (stopping) {
+        return;
+      }
+      executed_generation = generation;
+    }
+    execute_chunks(worker_id);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running_workers--;
+    }
+    finish_condition.notify_one();
+  }
+}
+
+void ThreadPool::parallel_for(const int &n, const int &chunk_size,
+                              const ChunkTask &task) {
+  if (n <= 0) {
+    return;
+  }
+  int number_of_chunks = (n + chunk_size - 1) / chunk_size;
+  std::unique_lock<std::mutex> job_lock(job_mutex, std::defer_lock);
+  if (workers.empty() || number_of_chunks == 1 || !job_lock.try_lock()) {
+    // no need to wake up the workers, or they are busy with the job of
+    // another thread
+    for (int begin = 0; begin < n; begin += chunk_size) {
+      task(begin, std::min(begin + chunk_size, n), 0);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->task = &task;
+    this->n = n;
+    this->chunk_size = chunk_size;
+    this->number_of_chunks = number_of_chunks;
+    next_chunk = 0;
+    running_workers = workers.size();
+    failed_chunk = -1;
+    failure = nullptr;
+    generation++;
+  }
+  job_condition.notify_all();
+
+  // the calling thread also works as the worker 0
+  execute_chunks(0);
+
+  std::exception_ptr thrown_failure;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    finish_condition.wait(lock, [&] { return running_workers == 0; });
+    this->task = nullptr;
+    thrown_failure = failure;
+    failure = nullptr;
+  }
+  if (thrown_failure) {
+    std::rethrow_exception(thrown_failure);
+  }
+}
@@ -77,13 +77,15 @@ void PoseBeliefVisualizer::inner_publish_marker_for_pose_belief(
 
   CovarianceMatrix X =
       safe_XXT(covariance); // old_covariance == X * X.transpose()
+  std::uint64_t step = visualization_step++;
 
   if (belief.distribution_type == belief.RPY_COVARIANCE) {
     // The covariance matrix is interpreted as covariance in 6 axes of particles
 
     Particle mean = pose_to_particle(belief.distribution.pose.pose);
     for (int i = 0; i < number_of_particles; i++) {
-      Particle particle = mean + X * get_UND_particle();
+      RandomStream stream(random_seed, step, i);
+      Particle particle = mean + X * get_UND_particle(stream);
       geometry_msgs::Pose converted_pose;
       particle_to_pose(particle, converted_pose);
       poses_to_publish.push_back(
@@ -97,11 +99,10 @@ void PoseBeliefVisualizer::inner_publish_marker_for_pose_belief(
     Eigen::Isometry3d mean;
     tf::poseMsgToEigen(belief.distribution.pose.pose, mean);
     for (int i = 0; i < number_of_particles; i++) {
-      Eigen::Matrix<double, 6, 1> deviation_vector = X * get_UND_particle();
-      Eigen::Isometry3d deviation =
-          Eigen::Isometry3d(Eigen::Matrix<double, 4, 4>(
-              hat_operator<double>(deviation_vector).exp())) *
-          mean;
+      RandomStream stream(random_seed, step, i);
+      Eigen::Matrix<double, 6, 1> deviation_vector =
+          X * get_UND_particle(stream);
+      Eigen::Isometry3d deviation = se3_exp<double>(deviation_vector) * mean;
       // convert this transform to msg poses and store them
       geometry_msgs::Pose converted_pose;
       tf::poseEigenToMsg(deviation, converted_pose);
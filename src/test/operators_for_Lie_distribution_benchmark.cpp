@@ -0,0 +1,262 @@
+/*
+A benchmark of the closed forms in operators_for_Lie_distribution.hpp
+
+usage: operators_for_Lie_distribution_benchmark [repetitions]
+
+Each operator is timed against the implementation it replaced: the matrix
+exponential and logarithm of unsupported/Eigen/MatrixFunctions for se3_exp and
+se3_log, Bernoulli_series of adjoint for se3_inverse_left_Jacobian, the power
+series for se3_left_Jacobian and the conjugation of the basis for Adjoint. The
+maximum difference of the results is also printed.
+
+The batch operators are compared with se3_exp and se3_log applied to the
+particles of a ParticleSet one by one, and the time per particle is printed.
+The batch exponential of float poses is compared with that of double.
+ */
+
+#include "o2ac_pose_distribution_updater/base/batch_operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/random_particle.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <unsupported/Eigen/MatrixFunctions>
+
+namespace {
+// The former implementation of Adjoint
+Eigen::Matrix<double, 6, 6> Adjoint_by_conjugation(const Eigen::Isometry3d &t) {
+  Eigen::Matrix<double, 6, 6> m;
+  for (int i = 0; i < 6; i++) {
+    Particle unit_vector = Particle::Unit(i);
+    m.col(i) = check_operator<double>(
+        t.matrix() * hat_operator<double>(unit_vector) * t.inverse().matrix());
+  }
+  return m;
+}
+
+Eigen::Matrix<double, 6, 6> left_Jacobian_by_series(const Particle &v) {
+  CovarianceMatrix ad = adjoint<double>(v), sum = CovarianceMatrix::Zero(),
+                   power = CovarianceMatrix::Identity();
+  for (int n = 0; n < MAX_N; n++) {
+    sum += power / boost::math::factorial<double>(n + 1);
+    power *= ad;
+  }
+  return sum;
+}
+
+// Average time of f(i) in microseconds. The results are accumulated in 'sink'
+// so that the calls are not optimized out.
+double measure(const int &repetitions, const std::function<double(int)> &f,
+               double &sink) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repetitions; i++) {
+    sink += f(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count() /
+         repetitions;
+}
+
+void print(const std::string &name, const double &old_time,
+           const double &new_time, const double &difference,
+           const std::string &unit = "us") {
+  std::cout << name << ": " << old_time << " " << unit << " -> " << new_time
+            << " " << unit << " ("
+            << old_time / new_time << "x), max difference " << difference
+            << std::endl;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int repetitions = argc > 1 ? std::atoi(argv[1]) : 100000;
+  if (repetitions <= 0) {
+    std::cerr << "usage: operators_for_Lie_distribution_benchmark "
+                 "[repetitions]"
+              << std::endl;
+    return 1;
+  }
+
+  // random vectors whose rotation angles are at most about 2
+  RandomStream stream(0, 0, 0);
+  std::vector<Particle> vectors(repetitions);
+  std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
+      transforms(repetitions);
+  for (int i = 0; i < repetitions; i++) {
+    vectors[i] = 0.5 * get_UND_particle(stream);
+    transforms[i] = se3_exp<double>(vectors[i]);
+  }
+
+  double sink = 0.0, old_time, new_time, difference;
+
+  old_time = measure(
+      repetitions,
+      [&](int i) { return hat_operator<double>(vectors[i]).exp()(0, 3); },
+      sink);
+  new_time = measure(
+      repetitions,
+      [&](int i) { return se3_exp<double>(vectors[i]).matrix()(0, 3); }, sink);
+  difference = 0.0;
+  for (int i = 0; i < repetitions; i++) {
+    difference = std::max(difference,
+                          (hat_operator<double>(vectors[i]).exp() -
+                           se3_exp<double>(vectors[i]).matrix())
+                              .cwiseAbs()
+                              .maxCoeff());
+  }
+  print("exp", old_time, new_time, difference);
+
+  old_time = measure(
+      repetitions,
+      [&](int i) { return transforms[i].matrix().log()(0, 3); }, sink);
+  new_time = measure(
+      repetitions, [&](int i) { return se3_log<double>(transforms[i])(0); },
+      sink);
+  difference = 0.0;
+  for (int i = 0; i < repetitions; i++) {
+    difference = std::max(
+        difference, (check_operator<double>(transforms[i].matrix().log()) -
+                     se3_log<double>(transforms[i]))
+                        .cwiseAbs()
+                        .maxCoeff());
+  }
+  print("log", old_time, new_time, difference);
+
+  old_time = measure(
+      repetitions,
+      [&](int i) { return left_Jacobian_by_series(vectors[i])(0, 5); }, sink);
+  new_time = measure(
+      repetitions,
+      [&](int i) { return se3_left_Jacobian<double>(vectors[i])(0, 5); },
+      sink);
+  difference = 0.0;
+  for (int i = 0; i < repetitions; i++) {
+    difference = std::max(difference, (left_Jacobian_by_series(vectors[i]) -
+                                       se3_left_Jacobian<double>(vectors[i]))
+                                          .cwiseAbs()
+                                          .maxCoeff());
+  }
+  print("left Jacobian", old_time, new_time, difference);
+
+  old_time = measure(
+      repetitions,
+      [&](int i) {
+        return Bernoulli_series(adjoint<double>(vectors[i]))(0, 5);
+      },
+      sink);
+  new_time = measure(
+      repetitions,
+      [&](int i) {
+        return se3_inverse_left_Jacobian<double>(vectors[i])(0, 5);
+      },
+      sink);
+  difference = 0.0;
+  for (int i = 0; i < repetitions; i++) {
+    difference =
+        std::max(difference, (Bernoulli_series(adjoint<double>(vectors[i])) -
+                              se3_inverse_left_Jacobian<double>(vectors[i]))
+                                 .cwiseAbs()
+                                 .maxCoeff());
+  }
+  print("inverse left Jacobian", old_time, new_time, difference);
+
+  old_time = measure(
+      repetitions,
+      [&](int i) { return Adjoint_by_conjugation(transforms[i])(0, 5); },
+      sink);
+  new_time = measure(
+      repetitions,
+      [&](int i) { return Adjoint<double>(transforms[i])(0, 5); }, sink);
+  difference = 0.0;
+  for (int i = 0; i < repetitions; i++) {
+    difference = std::max(difference, (Adjoint_by_conjugation(transforms[i]) -
+                                       Adjoint<double>(transforms[i]))
+                                          .cwiseAbs()
+                                          .maxCoeff());
+  }
+  print("Adjoint", old_time, new_time, difference);
+
+  ParticleSet particle_set;
+  particle_set.resize(repetitions);
+  for (int i = 0; i < repetitions; i++) {
+    particle_set.tangents.col(i) = vectors[i];
+  }
+  std::vector<int> indices(repetitions);
+  std::iota(indices.begin(), indices.end(), 0);
+  ParticleSet::TangentMatrix xis(6, repetitions);
+  Eigen::Isometry3d mean = transforms[0];
+
+  old_time = measure(
+      1,
+      [&](int) {
+        for (int i = 0; i < repetitions; i++) {
+          particle_set.set_transform(
+              i, se3_exp<double>(particle_set.tangents.col(i)) * mean);
+        }
+        return particle_set.translations(0, 0);
+      },
+      sink);
+  ParticleSet::TranslationMatrix expected_translations =
+      particle_set.translations;
+  new_time = measure(
+      1,
+      [&](int) {
+        batch_se3_exp(particle_set, mean, 0, repetitions);
+        return particle_set.translations(0, 0);
+      },
+      sink);
+  difference = (particle_set.translations - expected_translations)
+                   .cwiseAbs()
+                   .maxCoeff();
+  print("exp of particles", 1000.0 * old_time / repetitions,
+        1000.0 * new_time / repetitions, difference, "ns per particle");
+
+  BasicParticleSet<float> float_particle_set;
+  float_particle_set.resize(repetitions);
+  float_particle_set.tangents = particle_set.tangents;
+  old_time = new_time;
+  new_time = measure(
+      1,
+      [&](int) {
+        batch_se3_exp(float_particle_set, mean, 0, repetitions);
+        return (double)float_particle_set.translations(0, 0);
+      },
+      sink);
+  difference = (float_particle_set.translations.cast<double>() -
+                expected_translations)
+                   .cwiseAbs()
+                   .maxCoeff();
+  print("exp of float particles", 1000.0 * old_time / repetitions,
+        1000.0 * new_time / repetitions, difference, "ns per particle");
+
+  Eigen::Isometry3d inverse_of_mean = mean.inverse();
+  old_time = measure(
+      1,
+      [&](int) {
+        for (int k = 0; k < repetitions; k++) {
+          xis.col(k) = se3_log<double>(particle_set.transform(indices[k]) *
+                                       inverse_of_mean);
+        }
+        return xis(0, 0);
+      },
+      sink);
+  ParticleSet::TangentMatrix expected_xis = xis;
+  new_time = measure(
+      1,
+      [&](int) {
+        batch_se3_log(particle_set, indices, inverse_of_mean, 0, repetitions,
+                      xis);
+        return xis(0, 0);
+      },
+      sink);
+  difference = (xis - expected_xis).cwiseAbs().maxCoeff();
+  print("log of particles", 1000.0 * old_time / repetitions,
+        1000.0 * new_time / repetitions, difference, "ns per particle");
+
+  // prevent the optimization of the measured calls
+  if (sink == 0.123456789) {
+    std::cout << sink << std::endl;
+  }
+  return 0;
+}
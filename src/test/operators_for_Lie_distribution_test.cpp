@@ -0,0 +1,293 @@
+/*
+Tests of the closed forms of the exponential map and the logarithm of SE(3)
+
+se3_exp and se3_log are compared with the matrix exponential and logarithm of
+unsupported/Eigen/MatrixFunctions on random vectors of various sizes, including
+the small angles where Taylor series are used. The derivatives by AutoDiff are
+also checked.
+
+The Jacobians of SE(3) are compared with their power series and with AutoDiff,
+and Adjoint with its definition. The batch operators must agree with se3_exp
+and se3_log particle by particle, and the batch exponential of float poses
+with that of double to the rounding errors of float.
+ */
+
+#include "o2ac_pose_distribution_updater/base/batch_operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/random_particle.hpp"
+#include <gtest/gtest.h>
+#include <numeric>
+#include <unsupported/Eigen/AutoDiff>
+#include <unsupported/Eigen/MatrixFunctions>
+
+const int number_of_samples = 1000;
+// rotation angles of the samples. pi is excluded because the logarithm of
+// MatrixFunctions loses precision near pi
+const std::vector<double> rotation_angles = {0.0,  1e-9, 1e-6, 1e-3, 0.1,
+                                             0.316, 0.317, 1.0,  2.0,  3.0};
+const double TOLERANCE = 1e-12;
+
+// A random vector of se(3) whose rotation angle is 'angle'
+Particle random_vector(RandomStream &stream, const double &angle) {
+  Particle v = get_UND_particle(stream);
+  v.tail<3>() *= angle / v.tail<3>().norm();
+  return v;
+}
+
+TEST(SE3Test, ExpAgreesWithMatrixFunctions) {
+  RandomStream stream(0, 0, 0);
+  for (double angle : rotation_angles) {
+    for (int n = 0; n < number_of_samples; n++) {
+      Particle v = random_vector(stream, angle);
+      Eigen::Matrix<double, 4, 4> expected = hat_operator<double>(v).exp();
+      ASSERT_LT((se3_exp<double>(v).matrix() - expected).norm(), TOLERANCE)
+          << "angle: " << angle;
+    }
+  }
+}
+
+TEST(SE3Test, LogAgreesWithMatrixFunctions) {
+  RandomStream stream(0, 0, 1);
+  for (double angle : rotation_angles) {
+    for (int n = 0; n < number_of_samples; n++) {
+      Eigen::Isometry3d t = se3_exp<double>(random_vector(stream, angle));
+      Particle expected = check_operator<double>(t.matrix().log());
+      ASSERT_LT((se3_log<double>(t) - expected).norm(), TOLERANCE)
+          << "angle: " << angle;
+    }
+  }
+}
+
+TEST(SE3Test, LogNearPi) {
+  // log is the inverse of exp for the rotation angles up to pi
+  RandomStream stream(0, 0, 2);
+  for (double distance : {1e-1, 1e-3, 1e-5, 1e-7, 0.0}) {
+    for (int n = 0; n < number_of_samples; n++) {
+      Particle v = random_vector(stream, M_PI - distance);
+      Particle w = se3_log<double>(se3_exp<double>(v));
+      if (distance == 0.0) {
+        // the axis is determined up to the sign
+        EXPECT_LT(std::min((w - v).tail<3>().norm(), (w + v).tail<3>().norm()),
+                  TOLERANCE);
+      } else {
+        ASSERT_LT((w - v).norm(), TOLERANCE) << "distance: " << distance;
+      }
+    }
+  }
+}
+
+TEST(SE3Test, AutoDiff) {
+  // The Jacobian of log(exp(v)) is the identity matrix, including at v = 0
+  using AD = Eigen::AutoDiffScalar<Particle>;
+  RandomStream stream(0, 0, 3);
+  for (double angle : rotation_angles) {
+    Particle v = random_vector(stream, angle);
+    Eigen::Matrix<AD, 6, 1> x;
+    for (int i = 0; i < 6; i++) {
+      x(i) = AD(v(i), 6, i);
+    }
+    Eigen::Matrix<AD, 6, 1> y = se3_log<AD>(se3_exp<AD>(x));
+    for (int i = 0; i < 6; i++) {
+      EXPECT_NEAR(y(i).value(), v(i), TOLERANCE);
+      for (int j = 0; j < 6; j++) {
+        EXPECT_NEAR(y(i).derivatives()(j), (i == j ? 1.0 : 0.0), 1e-9)
+            << "angle: " << angle;
+      }
+    }
+  }
+}
+
+TEST(SE3Test, LeftJacobianIsSeries) {
+  // se3_left_Jacobian(v) is the sum of adjoint(v)^n / (n + 1)!, and
+  // se3_inverse_left_Jacobian(v) agrees with Bernoulli_series(adjoint(v)) when
+  // the series converges quickly
+  RandomStream stream(0, 0, 4);
+  for (double angle : rotation_angles) {
+    for (int n = 0; n < number_of_samples; n++) {
+      Particle v = random_vector(stream, angle);
+      CovarianceMatrix ad = adjoint<double>(v);
+      CovarianceMatrix series = CovarianceMatrix::Zero(),
+                       power = CovarianceMatrix::Identity();
+      for (int k = 0; k < 60; k++) {
+        series += power / boost::math::factorial<double>(k + 1);
+        power *= ad;
+      }
+      ASSERT_LT((se3_left_Jacobian<double>(v) - series).norm(),
+                TOLERANCE * series.norm())
+          << "angle: " << angle;
+      if (angle <= 1.0) {
+        ASSERT_LT(
+            (se3_inverse_left_Jacobian<double>(v) - Bernoulli_series(ad))
+                .norm(),
+            TOLERANCE)
+            << "angle: " << angle;
+      }
+    }
+  }
+}
+
+TEST(SE3Test, InverseJacobians) {
+  RandomStream stream(0, 0, 5);
+  for (double angle : rotation_angles) {
+    for (int n = 0; n < number_of_samples; n++) {
+      Particle v = random_vector(stream, angle);
+      ASSERT_LT((se3_left_Jacobian<double>(v) *
+                     se3_inverse_left_Jacobian<double>(v) -
+                 CovarianceMatrix::Identity())
+                    .norm(),
+                TOLERANCE);
+      ASSERT_LT((se3_right_Jacobian<double>(v) *
+                     se3_inverse_right_Jacobian<double>(v) -
+                 CovarianceMatrix::Identity())
+                    .norm(),
+                TOLERANCE);
+    }
+  }
+}
+
+TEST(SE3Test, RightJacobianByAutoDiff) {
+  // log(exp(v) * exp(dv)) = v + se3_inverse_right_Jacobian(v) * dv and
+  // exp(v + dv) = exp(v) * exp(se3_right_Jacobian(v) * dv) for small dv
+  using AD = Eigen::AutoDiffScalar<Particle>;
+  RandomStream stream(0, 0, 6);
+  for (double angle : rotation_angles) {
+    Particle v = random_vector(stream, angle);
+    Eigen::Matrix<AD, 6, 1> dv, x;
+    for (int i = 0; i < 6; i++) {
+      dv(i) = AD(0.0, 6, i);
+      x(i) = AD(v(i), 6, i);
+    }
+    Eigen::Transform<AD, 3, Eigen::Isometry> exp_v =
+        se3_exp<double>(v).cast<AD>();
+    Eigen::Matrix<AD, 6, 1> y = se3_log<AD>(exp_v * se3_exp<AD>(dv));
+    Eigen::Matrix<AD, 6, 1> z = se3_log<AD>(
+        Eigen::Transform<AD, 3, Eigen::Isometry>(exp_v.inverse()) *
+        se3_exp<AD>(x));
+    CovarianceMatrix inverse_right_Jacobian, right_Jacobian;
+    for (int i = 0; i < 6; i++) {
+      inverse_right_Jacobian.row(i) = y(i).derivatives().transpose();
+      right_Jacobian.row(i) = z(i).derivatives().transpose();
+    }
+    EXPECT_LT((inverse_right_Jacobian - se3_inverse_right_Jacobian<double>(v))
+                  .norm(),
+              1e-9)
+        << "angle: " << angle;
+    EXPECT_LT((right_Jacobian - se3_right_Jacobian<double>(v)).norm(), 1e-9)
+        << "angle: " << angle;
+  }
+}
+
+TEST(SE3Test, Adjoint) {
+  // hat_operator(Adjoint(t) * u) == t * hat_operator(u) * t^{-1}
+  RandomStream stream(0, 0, 7);
+  for (int n = 0; n < number_of_samples; n++) {
+    Eigen::Isometry3d t = se3_exp<double>(get_UND_particle(stream));
+    Particle u = get_UND_particle(stream);
+    Eigen::Matrix<double, 4, 4> expected =
+        t.matrix() * hat_operator<double>(u) * t.inverse().matrix();
+    ASSERT_LT(
+        (hat_operator<double>(Adjoint<double>(t) * u) - expected).norm(),
+        TOLERANCE * std::max(1.0, expected.norm()));
+  }
+}
+
+TEST(SE3Test, BatchAgreesWithScalar) {
+  // The number of particles is not a multiple of SE3_BATCH_SIZE, and the
+  // angles include those near pi
+  RandomStream stream(0, 0, 8);
+  std::vector<double> angles = rotation_angles;
+  angles.push_back(M_PI - 1e-3);
+  angles.push_back(M_PI);
+  int number_of_particles = 3 * angles.size() + 5;
+  ParticleSet particle_set;
+  particle_set.resize(number_of_particles);
+  for (int i = 0; i < number_of_particles; i++) {
+    particle_set.tangents.col(i) =
+        random_vector(stream, angles[i % angles.size()]);
+  }
+  Eigen::Isometry3d right = se3_exp<double>(get_UND_particle(stream));
+  batch_se3_exp(particle_set, right, 0, number_of_particles);
+  for (int i = 0; i < number_of_particles; i++) {
+    Eigen::Isometry3d expected =
+        se3_exp<double>(Particle(particle_set.tangents.col(i))) * right;
+    ASSERT_LT((particle_set.transform(i).matrix() - expected.matrix()).norm(),
+              TOLERANCE)
+        << "particle: " << i;
+  }
+
+  // every other particle, reversed
+  std::vector<int> indices;
+  for (int i = number_of_particles - 1; i >= 0; i -= 2) {
+    indices.push_back(i);
+  }
+  ParticleSet::TangentMatrix xis(6, indices.size());
+  batch_se3_log(particle_set, indices, right.inverse(), 0, indices.size(),
+                xis);
+  for (int k = 0; k < indices.size(); k++) {
+    Particle expected =
+        se3_log<double>(particle_set.transform(indices[k]) * right.inverse());
+    ASSERT_LT((xis.col(k) - expected).norm(), TOLERANCE)
+        << "particle: " << indices[k];
+    // the logarithm is the inverse of the exponential except the sign of
+    // the axis at pi
+    if (angles[indices[k] % angles.size()] < M_PI) {
+      ASSERT_LT((xis.col(k) - particle_set.tangents.col(indices[k])).norm(),
+                1e-9)
+          << "particle: " << indices[k];
+    }
+  }
+
+  std::vector<Eigen::Vector3d> points(7), transformed;
+  for (auto &point : points) {
+    point = get_UND_Vector3d(stream);
+  }
+  transform_points(right, points, transformed);
+  ASSERT_EQ(transformed.size(), points.size());
+  for (int i = 0; i < points.size(); i++) {
+    ASSERT_LT((transformed[i] - right * points[i]).norm(), TOLERANCE);
+  }
+}
+
+TEST(SE3Test, FloatBatchAgreesWithDouble) {
+  // The exponential of float poses has the rounding errors of float, and the
+  // logarithm of them is calculated in double. The rotations of float are
+  // orthogonal only up to the rounding errors, on which the branches of the
+  // logarithm depend differently, so the logarithms agree to that order.
+  RandomStream stream(0, 0, 9);
+  int number_of_particles = 3 * SE3Batch<float>::size + 5;
+  BasicParticleSet<double> double_particles;
+  BasicParticleSet<float> float_particles;
+  double_particles.resize(number_of_particles);
+  float_particles.resize(number_of_particles);
+  for (int i = 0; i < number_of_particles; i++) {
+    double_particles.tangents.col(i) =
+        random_vector(stream, rotation_angles[i % rotation_angles.size()]);
+  }
+  float_particles.tangents = double_particles.tangents;
+  Eigen::Isometry3d right = se3_exp<double>(get_UND_particle(stream));
+  batch_se3_exp(double_particles, right, 0, number_of_particles);
+  batch_se3_exp(float_particles, right, 0, number_of_particles);
+  for (int i = 0; i < number_of_particles; i++) {
+    ASSERT_LT((float_particles.transform(i).matrix() -
+               double_particles.transform(i).matrix())
+                  .norm(),
+              1e-5)
+        << "particle: " << i;
+  }
+
+  std::vector<int> indices(number_of_particles);
+  std::iota(indices.begin(), indices.end(), 0);
+  ParticleSet::TangentMatrix xis(6, number_of_particles);
+  batch_se3_log(float_particles, indices, right.inverse(), 0,
+                number_of_particles, xis);
+  for (int i = 0; i < number_of_particles; i++) {
+    Particle expected =
+        se3_log<double>(float_particles.transform(i) * right.inverse());
+    ASSERT_LT((xis.col(i) - expected).norm(), 1e-5) << "particle: " << i;
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,308 @@
+/*
+A tool to choose the cheapest update settings of the place, grasp and push
+actions of an object which meet an error budget of the covariance
+
+usage: particle_count_tuner stl_file config_file error_budget output_file
+                            action:belief_file [action:belief_file ...]
+
+'action' is place, grasp or push. The beliefs of place are read in the format
+of test/place_test_*_Lie_*.txt, and those of grasp and push in the format of
+test/grasp_test_*_Lie_1.txt. The cases which are expected to fail are skipped.
+
+For each action, the covariance after the action from each belief is
+calculated by reference_number_of_particles quasi-Monte Carlo particles. Then
+the linearization, the sigma points, and the particles and the rotation
+particles of each sampling method with 8, 16, ..., max_number_of_particles
+particles are tried with number_of_seeds seeds. The error of a setting is the
+mean relative error (in the Frobenius norm) of the covariances from the
+reference, where a failed update counts as 1, the error of the zero matrix.
+The fastest setting whose error is at most error_budget is chosen, or the most
+accurate one if no setting meets the budget.
+
+The output file is the config file with the chosen *_update_method,
+*_sampling_method and *_number_of_particles of the tuned actions.
+ */
+
+#include "o2ac_pose_distribution_updater/base/estimator.hpp"
+#include "o2ac_pose_distribution_updater/base/read_stl.hpp"
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <yaml-cpp/yaml.h>
+
+const int reference_number_of_particles = 4096;
+const int max_number_of_particles = 1024;
+const int number_of_seeds = 4;
+
+// The names in the config file
+const char *const UPDATE_METHOD_NAMES[] = {
+    "linear_approximation", "particles", "sigma_points", "rotation_particles"};
+const char *const SAMPLING_METHOD_NAMES[] = {"monte_carlo",
+                                             "quasi_monte_carlo"};
+
+enum action_type { place_action, grasp_action, push_action };
+const char *const ACTION_NAMES[] = {"place", "grasp", "push"};
+
+struct belief_case {
+  Eigen::Isometry3d gripper_transform, mean;
+  CovarianceMatrix covariance;
+  double support_surface; // only for place
+};
+
+void load_cases(const std::string &file_path, const action_type &action,
+                std::vector<belief_case> &cases) {
+  // read the cases of the test file which are expected to succeed. The place
+  // test files have the support surface and no number of cases.
+  FILE *in = fopen(file_path.c_str(), "r");
+  if (in == NULL) {
+    throw std::runtime_error("cannot open " + file_path);
+  }
+  int number_of_cases = std::numeric_limits<int>::max();
+  if (action != place_action) {
+    fscanf(in, "%d", &number_of_cases);
+  }
+  for (int t = 0; t < number_of_cases; t++) {
+    Particle gripper_pose_particle, mean;
+    if (fscanf(in, "%lf", &(gripper_pose_particle(0))) == EOF) {
+      break;
+    }
+    for (int i = 1; i < 6; i++) {
+      fscanf(in, "%lf", &(gripper_pose_particle(i)));
+    }
+    for (int i = 0; i < 6; i++) {
+      fscanf(in, "%lf", &(mean(i)));
+    }
+    belief_case new_case;
+    for (int i = 0; i < 6; i++) {
+      for (int j = 0; j < 6; j++) {
+        fscanf(in, "%lf", &(new_case.covariance(i, j)));
+      }
+    }
+    new_case.support_surface = 0.0;
+    if (action == place_action) {
+      fscanf(in, "%lf", &new_case.support_surface);
+    }
+    new_case.gripper_transform =
+        particle_to_eigen_transform(gripper_pose_particle);
+    new_case.mean = particle_to_eigen_transform(mean);
+
+    int success;
+    fscanf(in, "%d\n", &success);
+    if (success == 0) {
+      char expected_error_message[999];
+      fgets(expected_error_message, 999, in);
+    } else {
+      double expected_value;
+      for (int i = 0; i < 6 + 36; i++) {
+        fscanf(in, "%lf", &expected_value);
+      }
+      cases.push_back(new_case);
+    }
+  }
+  fclose(in);
+}
+
+struct setting {
+  update_method method;
+  sampling_method sampling;
+  int number_of_particles;
+  double error, milliseconds;
+};
+
+int main(int argc, char **argv) {
+  if (argc < 6) {
+    fprintf(stderr,
+            "usage: %s stl_file config_file error_budget output_file "
+            "action:belief_file [action:belief_file ...]\n",
+            argv[0]);
+    return 1;
+  }
+  double error_budget = atof(argv[3]);
+
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  read_stl_from_file_path(std::string(argv[1]), vertices, triangles);
+  for (auto &vertex : vertices) {
+    vertex /= 1000.0; // milimeter -> meter
+  }
+  // the steps on the prepared object scan only the vertices of its hull
+  PreparedObjectPtr object = prepare_object(vertices, triangles);
+
+  std::vector<belief_case> cases[3];
+  for (int k = 5; k < argc; k++) {
+    std::string argument(argv[k]);
+    std::size_t colon = argument.find(':');
+    int action = 0;
+    while (action < 3 && argument.substr(0, colon) != ACTION_NAMES[action]) {
+      action++;
+    }
+    if (colon == std::string::npos || action == 3) {
+      fprintf(stderr, "unknown action of %s\n", argv[k]);
+      return 1;
+    }
+    load_cases(argument.substr(colon + 1), (action_type)action, cases[action]);
+  }
+
+  PoseEstimator estimator;
+  estimator.load_config_file(std::string(argv[2]));
+  estimator.set_adaptive_sampling(false, 0.0);
+  YAML::Node config = YAML::LoadFile(std::string(argv[2]));
+
+  // update the distribution of the case by the action with the setting, and
+  // returns false if the update fails
+  auto update = [&](const action_type &action, const belief_case &belief,
+                    const update_method &method,
+                    const sampling_method &sampling,
+                    const int &number_of_particles, const int &seed,
+                    CovarianceMatrix &new_covariance) {
+    estimator.set_update_method(method);
+    estimator.place_sampling_method = estimator.grasp_sampling_method =
+        estimator.push_sampling_method = sampling;
+    estimator.place_number_of_particles = estimator.grasp_number_of_particles =
+        estimator.push_number_of_particles = number_of_particles;
+    estimator.place_min_number_of_particles =
+        estimator.grasp_min_number_of_particles =
+            estimator.push_min_number_of_particles = number_of_particles;
+    estimator.place_max_number_of_particles =
+        estimator.grasp_max_number_of_particles =
+            estimator.push_max_number_of_particles = number_of_particles;
+    estimator.set_random_seed(seed);
+    Eigen::Isometry3d new_mean;
+    try {
+      if (action == place_action) {
+        estimator.place_step_with_Lie_distribution(
+            *object, belief.gripper_transform, belief.support_surface,
+            belief.mean, belief.covariance, new_mean, new_covariance);
+      } else if (action == grasp_action) {
+        estimator.grasp_step_with_Lie_distribution(
+            *object, belief.gripper_transform, belief.mean, belief.covariance,
+            new_mean, new_covariance);
+      } else {
+        estimator.push_step_with_Lie_distribution(
+            *object, belief.gripper_transform, belief.mean, belief.covariance,
+            new_mean, new_covariance);
+      }
+    } catch (std::runtime_error &e) {
+      return false;
+    }
+    return new_covariance.allFinite();
+  };
+
+  for (int action = 0; action < 3; action++) {
+    if (cases[action].empty()) {
+      continue;
+    }
+    const action_type type = (action_type)action;
+
+    // The reference covariances. The beliefs whose reference fails are not
+    // used.
+    std::vector<belief_case> beliefs;
+    std::vector<CovarianceMatrix, Eigen::aligned_allocator<CovarianceMatrix>>
+        references;
+    for (const auto &belief : cases[action]) {
+      CovarianceMatrix reference;
+      if (update(type, belief, particle_update, quasi_monte_carlo_sampling,
+                 reference_number_of_particles, number_of_seeds, reference) &&
+          reference.norm() > 0.0) {
+        beliefs.push_back(belief);
+        references.push_back(reference);
+      }
+    }
+    printf("%s: %d beliefs\n", ACTION_NAMES[action], (int)beliefs.size());
+    if (beliefs.empty()) {
+      continue;
+    }
+
+    std::vector<setting> settings;
+    settings.push_back(
+        setting{linear_approximation_update, monte_carlo_sampling, 0});
+    settings.push_back(setting{sigma_point_update, monte_carlo_sampling, 0});
+    for (update_method method : {particle_update, rotation_particle_update}) {
+      for (sampling_method sampling :
+           {monte_carlo_sampling, quasi_monte_carlo_sampling}) {
+        for (int number_of_particles = 8;
+             number_of_particles <= max_number_of_particles;
+             number_of_particles *= 2) {
+          settings.push_back(setting{method, sampling, number_of_particles});
+        }
+      }
+    }
+
+    printf("%22s %18s %10s %10s %10s\n", "update method", "sampling method",
+           "particles", "error", "time [ms]");
+    const setting *chosen = nullptr;
+    for (auto &candidate : settings) {
+      // the linearization and the sigma points do not depend on the seed
+      int seeds = (candidate.method == linear_approximation_update ||
+                           candidate.method == sigma_point_update
+                       ? 1
+                       : number_of_seeds);
+      double sum_of_errors = 0.0;
+      auto start = std::chrono::steady_clock::now();
+      for (int seed = 0; seed < seeds; seed++) {
+        for (int t = 0; t < beliefs.size(); t++) {
+          CovarianceMatrix new_covariance;
+          sum_of_errors +=
+              (update(type, beliefs[t], candidate.method, candidate.sampling,
+                      candidate.number_of_particles, seed, new_covariance)
+                   ? (new_covariance - references[t]).norm() /
+                         references[t].norm()
+                   : 1.0);
+        }
+      }
+      candidate.milliseconds =
+          1e3 *
+          std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        start)
+              .count() /
+          (seeds * beliefs.size());
+      candidate.error = sum_of_errors / (seeds * beliefs.size());
+      printf("%22s %18s %10d %10.4lf %10.4lf\n",
+             UPDATE_METHOD_NAMES[candidate.method],
+             SAMPLING_METHOD_NAMES[candidate.sampling],
+             candidate.number_of_particles, candidate.error,
+             candidate.milliseconds);
+    }
+    for (const auto &candidate : settings) {
+      if (candidate.error <= error_budget &&
+          (chosen == nullptr ||
+           candidate.milliseconds < chosen->milliseconds)) {
+        chosen = &candidate;
+      }
+    }
+    if (chosen == nullptr) {
+      printf("no setting meets the error budget %lf\n", error_budget);
+      for (const auto &candidate : settings) {
+        if (chosen == nullptr || candidate.error < chosen->error) {
+          chosen = &candidate;
+        }
+      }
+    }
+    printf("chosen: %s, %s, %d particles, error: %.4lf, time: %.4lf ms\n",
+           UPDATE_METHOD_NAMES[chosen->method],
+           SAMPLING_METHOD_NAMES[chosen->sampling],
+           chosen->number_of_particles, chosen->error, chosen->milliseconds);
+
+    std::string prefix = ACTION_NAMES[action];
+    config[prefix + "_update_method"] = UPDATE_METHOD_NAMES[chosen->method];
+    if (chosen->number_of_particles > 0) {
+      config[prefix + "_sampling_method"] =
+          SAMPLING_METHOD_NAMES[chosen->sampling];
+      config[prefix + "_number_of_particles"] = chosen->number_of_particles;
+      std::string max_key = prefix + "_max_number_of_particles";
+      if (!config[max_key] ||
+          config[max_key].as<int>() < chosen->number_of_particles) {
+        config[max_key] = chosen->number_of_particles;
+      }
+      std::string min_key = prefix + "_min_number_of_particles";
+      if (config[min_key] &&
+          config[min_key].as<int>() > chosen->number_of_particles) {
+        config[min_key] = chosen->number_of_particles;
+      }
+    }
+  }
+
+  std::ofstream out(argv[4]);
+  out << config << '\n';
+  return 0;
+}
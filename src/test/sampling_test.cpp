@@ -0,0 +1,1717 @@
+/*
+Comparison of Monte Carlo and quasi-Monte Carlo sampling of particles
+
+The error of the estimated covariance is measured against the number of
+particles. The first test measures the covariance of the generated particles
+themselves. The second test measures the covariance updated by grasp actions
+on the meshes in test/CAD, with the cases of test/grasp_test_*_Lie_1.txt. The
+reference covariance is calculated with many quasi-Monte Carlo particles.
+
+The sigma point update is compared with the particles on place actions in the
+same way, with the cases of test/place_test_cones_Lie_3.txt.
+
+The weighted mean on SE(3), from which all the updated Lie distributions are
+calculated, and the single-pass weighted moments of the other distributions
+are also checked.
+
+The resampling methods and the persistent particle belief are checked next.
+The particles whose poses are float are compared with those of double on the
+place and grasp cases.
+Finally, the place step is checked not to allocate memory after the first step,
+to count the reasons of the failures of its particles, and to give the same
+results when the steps of several contexts run on one estimator at once. The
+plans of several contexts on one planner are checked in the same way.
+ */
+
+#include "o2ac_pose_distribution_updater/base/batch_operators_for_Lie_distribution.hpp"
+#include "o2ac_pose_distribution_updater/base/convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/planar_convex_hull.hpp"
+#include "o2ac_pose_distribution_updater/base/planner.hpp"
+#include "o2ac_pose_distribution_updater/base/read_stl.hpp"
+#include "o2ac_pose_distribution_updater/base/weighted_moments.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <gtest/gtest.h>
+#include <limits>
+#include <map>
+#include <new>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+
+// The number of the calls of operator new, which is replaced to count them
+std::atomic<long> number_of_allocations(0);
+
+void *operator new(std::size_t size) {
+  number_of_allocations++;
+  void *pointer = std::malloc(size > 0 ? size : 1);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+
+const std::string package_directory = PACKAGE_DIRECTORY;
+const int number_of_seeds = 8;
+const std::vector<int> numbers_of_particles = {64, 128, 256};
+const int reference_number_of_particles = 4096;
+// The tolerance of the round trips through the poses of the particles, which
+// are rounded to float if O2AC_FLOAT_PARTICLE_POSES is defined
+const double POSE_TOLERANCE =
+    std::is_same<ParticlePoseScalar, float>::value ? 1e-5 : 1e-9;
+
+struct grasp_case {
+  Eigen::Isometry3d gripper_transform, mean;
+  CovarianceMatrix covariance;
+};
+
+void load_successful_grasp_cases(const std::string &file_path,
+                                 std::vector<grasp_case> &cases) {
+  // read the cases of the test file which are expected to succeed
+  FILE *in = fopen(file_path.c_str(), "r");
+  ASSERT_FALSE(in == NULL);
+  int number_of_cases;
+  fscanf(in, "%d", &number_of_cases);
+  for (int t = 0; t < number_of_cases; t++) {
+    Particle gripper_pose_particle, mean;
+    for (int i = 0; i < 6; i++) {
+      fscanf(in, "%lf", &(gripper_pose_particle(i)));
+    }
+    for (int i = 0; i < 6; i++) {
+      fscanf(in, "%lf", &(mean(i)));
+    }
+    grasp_case new_case;
+    for (int i = 0; i < 6; i++) {
+      for (int j = 0; j < 6; j++) {
+        fscanf(in, "%lf", &(new_case.covariance(i, j)));
+      }
+    }
+    new_case.gripper_transform =
+        particle_to_eigen_transform(gripper_pose_particle);
+    new_case.mean = particle_to_eigen_transform(mean);
+
+    int success;
+    fscanf(in, "%d\n", &success);
+    if (success == 0) {
+      char expected_error_message[999];
+      fgets(expected_error_message, 999, in);
+    } else {
+      double expected_value;
+      for (int i = 0; i < 6 + 36; i++) {
+        fscanf(in, "%lf", &expected_value);
+      }
+      cases.push_back(new_case);
+    }
+  }
+  fclose(in);
+}
+
+struct place_case {
+  Eigen::Isometry3d gripper_transform, mean;
+  CovarianceMatrix covariance;
+  double support_surface;
+};
+
+void load_successful_place_cases(const std::string &file_path,
+                                 std::vector<place_case> &cases) {
+  // read the cases of the test file which are expected to succeed
+  FILE *in = fopen(file_path.c_str(), "r");
+  ASSERT_FALSE(in == NULL);
+  while (1) {
+    Particle gripper_pose_particle, mean;
+    if (fscanf(in, "%lf", &(gripper_pose_particle(0))) == EOF) {
+      break;
+    }
+    for (int i = 1; i < 6; i++) {
+      fscanf(in, "%lf", &(gripper_pose_particle(i)));
+    }
+    for (int i = 0; i < 6; i++) {
+      fscanf(in, "%lf", &(mean(i)));
+    }
+    place_case new_case;
+    for (int i = 0; i < 6; i++) {
+      for (int j = 0; j < 6; j++) {
+        fscanf(in, "%lf", &(new_case.covariance(i, j)));
+      }
+    }
+    fscanf(in, "%lf", &new_case.support_surface);
+    new_case.gripper_transform =
+        particle_to_eigen_transform(gripper_pose_particle);
+    new_case.mean = particle_to_eigen_transform(mean);
+
+    int success;
+    fscanf(in, "%d\n", &success);
+    if (success == 0) {
+      char expected_error_message[999];
+      fgets(expected_error_message, 999, in);
+    } else {
+      double expected_value;
+      for (int i = 0; i < 6 + 36; i++) {
+        fscanf(in, "%lf", &expected_value);
+      }
+      cases.push_back(new_case);
+    }
+  }
+  fclose(in);
+}
+
+void load_mesh(const std::string &file_path,
+               std::vector<Eigen::Vector3d> &vertices,
+               std::vector<boost::array<int, 3>> &triangles) {
+  read_stl_from_file_path(file_path, vertices, triangles);
+  for (auto &vertex : vertices) {
+    vertex /= 1000.0; // milimeter -> meter
+  }
+}
+
+double relative_error(const CovarianceMatrix &estimated,
+                      const CovarianceMatrix &reference) {
+  return (estimated - reference).norm() / reference.norm();
+}
+
+TEST(SamplingTest, GeneratedCovariance) {
+  // The covariance of the particles themselves, whose expected value is the
+  // given covariance
+  std::vector<grasp_case> cases;
+  load_successful_grasp_cases(
+      package_directory + "/test/grasp_test_gearmotor_Lie_1.txt", cases);
+  ASSERT_FALSE(cases.empty());
+  const CovarianceMatrix &covariance = cases[0].covariance;
+
+  PoseEstimator estimator;
+  estimator.set_particle_parameters(1, Particle::Zero());
+  EstimatorContext &context = estimator.default_context;
+  sampling_method methods[2] = {monte_carlo_sampling,
+                                quasi_monte_carlo_sampling};
+  std::map<int, double> errors[2];
+  for (int m = 0; m < 2; m++) {
+    for (int number_of_particles : numbers_of_particles) {
+      for (int seed = 0; seed < number_of_seeds; seed++) {
+        estimator.set_random_seed(seed);
+        estimator.sample_particles(
+            context, number_of_particles, number_of_particles,
+            number_of_particles, methods[m], Particle::Zero(), covariance,
+            [&](const int &first, const int &last) {
+              context.particle_set.weights.segment(first, last - first)
+                  .setOnes();
+            });
+        Particle new_mean;
+        CovarianceMatrix new_covariance;
+        estimator.calculate_new_distribution(context, new_mean, new_covariance);
+        errors[m][number_of_particles] +=
+            relative_error(new_covariance, covariance) / number_of_seeds;
+      }
+    }
+  }
+  for (int number_of_particles : numbers_of_particles) {
+    printf("particles: %4d, MC error: %.4lf, QMC error: %.4lf\n",
+           number_of_particles, errors[0][number_of_particles],
+           errors[1][number_of_particles]);
+    EXPECT_LT(errors[1][number_of_particles], errors[0][number_of_particles]);
+    // QMC is more accurate than MC with twice as many particles
+    if (errors[0].count(2 * number_of_particles)) {
+      EXPECT_LT(errors[1][number_of_particles],
+                errors[0][2 * number_of_particles]);
+    }
+  }
+}
+
+TEST(SamplingTest, GraspCovarianceOnCADMeshes) {
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_use_linear_approximation(false);
+  estimator.set_adaptive_sampling(false, 0.0);
+
+  // update the distribution by a grasp action with the given number of
+  // particles. Returns false if the update fails.
+  auto grasp_covariance = [&](const std::vector<Eigen::Vector3d> &vertices,
+                              const std::vector<boost::array<int, 3>>
+                                  &triangles,
+                              const grasp_case &grasp,
+                              const int &number_of_particles,
+                              const sampling_method &method, const int &seed,
+                              CovarianceMatrix &new_covariance) {
+    estimator.grasp_number_of_particles = number_of_particles;
+    estimator.grasp_max_number_of_particles = number_of_particles;
+    estimator.grasp_sampling_method = method;
+    estimator.set_random_seed(seed);
+    Eigen::Isometry3d new_mean;
+    try {
+      estimator.grasp_step_with_Lie_distribution(
+          vertices, triangles, grasp.gripper_transform, grasp.mean,
+          grasp.covariance, new_mean, new_covariance);
+    } catch (std::runtime_error &e) {
+      return false;
+    }
+    return true;
+  };
+
+  double total_errors[2] = {0.0, 0.0};
+  sampling_method methods[2] = {monte_carlo_sampling,
+                                quasi_monte_carlo_sampling};
+  for (std::string object_name : {"gearmotor", "shaft"}) {
+    std::vector<Eigen::Vector3d> vertices;
+    std::vector<boost::array<int, 3>> triangles;
+    load_mesh(package_directory + "/test/CAD/" + object_name + ".stl",
+              vertices, triangles);
+    std::vector<grasp_case> cases;
+    load_successful_grasp_cases(package_directory + "/test/grasp_test_" +
+                                    object_name + "_Lie_1.txt",
+                                cases);
+    for (int t = 0; t < cases.size(); t++) {
+      CovarianceMatrix reference_covariance;
+      if (!grasp_covariance(vertices, triangles, cases[t],
+                            reference_number_of_particles,
+                            quasi_monte_carlo_sampling, number_of_seeds,
+                            reference_covariance)) {
+        continue;
+      }
+      for (int number_of_particles : numbers_of_particles) {
+        double errors[2] = {0.0, 0.0};
+        int number_of_successes = 0;
+        for (int seed = 0; seed < number_of_seeds; seed++) {
+          // compare only the seeds with which both methods succeed
+          CovarianceMatrix new_covariances[2];
+          bool success = true;
+          for (int m = 0; m < 2; m++) {
+            success &= grasp_covariance(vertices, triangles, cases[t],
+                                        number_of_particles, methods[m], seed,
+                                        new_covariances[m]);
+          }
+          if (!success) {
+            continue;
+          }
+          number_of_successes++;
+          for (int m = 0; m < 2; m++) {
+            errors[m] +=
+                relative_error(new_covariances[m], reference_covariance);
+          }
+        }
+        if (number_of_successes == 0) {
+          continue;
+        }
+        printf("%s case %d, particles: %4d, MC error: %.4lf, QMC error: "
+               "%.4lf\n",
+               object_name.c_str(), t, number_of_particles,
+               errors[0] / number_of_successes,
+               errors[1] / number_of_successes);
+        for (int m = 0; m < 2; m++) {
+          total_errors[m] += errors[m] / number_of_successes;
+        }
+      }
+    }
+  }
+  // The updated pose is not a smooth function of the sampled pose, so the
+  // gain of QMC is smaller than that for the generated covariance, but it
+  // must not be worse on average.
+  EXPECT_GT(total_errors[0], 0.0);
+  EXPECT_LE(total_errors[1], total_errors[0]);
+}
+
+TEST(SigmaPointTest, IdentityAction) {
+  // If the action does nothing, the sigma points give the old distribution
+  // exactly
+  PoseEstimator estimator;
+  estimator.set_particle_parameters(1, Particle::Zero());
+  EstimatorContext &context = estimator.default_context;
+  RandomStream stream(0, 0, 0);
+  CovarianceMatrix A;
+  for (int j = 0; j < 6; j++) {
+    A.col(j) = 0.05 * get_UND_particle(stream);
+  }
+  CovarianceMatrix old_covariance = A * A.transpose();
+  Eigen::Isometry3d old_mean =
+      particle_to_eigen_transform(get_UND_particle(stream));
+
+  Eigen::Isometry3d new_mean;
+  CovarianceMatrix new_covariance;
+  ASSERT_TRUE(estimator.propagate_sigma_points(
+      context, old_mean, old_covariance,
+      [&](const int &i, const int &worker_id) {
+        context.particle_set.set_transform(
+            i, se3_exp<double>(context.particle_set.tangents.col(i)) *
+                   old_mean);
+        context.particle_set.weights(i) = 1.0;
+      },
+      new_mean, new_covariance));
+  EXPECT_EQ(context.particle_set.size(), 13);
+  EXPECT_LT((new_mean.matrix() - old_mean.matrix()).norm(), POSE_TOLERANCE);
+  EXPECT_LT(relative_error(new_covariance, old_covariance), POSE_TOLERANCE);
+
+  // fails if the action fails at a sigma point
+  EXPECT_FALSE(estimator.propagate_sigma_points(
+      context, old_mean, old_covariance,
+      [&](const int &i, const int &worker_id) {
+        context.particle_set.set_transform(i, old_mean);
+        context.particle_set.weights(i) = (i == 12 ? 0.0 : 1.0);
+      },
+      new_mean, new_covariance));
+}
+
+TEST(SigmaPointTest, PlaceCovarianceOnCones) {
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_adaptive_sampling(false, 0.0);
+  const int number_of_sigma_points = 13;
+
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  std::vector<place_case> cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", cases);
+
+  // update the distribution by a place action. Returns false if the update
+  // fails.
+  auto place_covariance = [&](const place_case &place,
+                              const update_method &method,
+                              const int &number_of_particles,
+                              const sampling_method &sampling, const int &seed,
+                              CovarianceMatrix &new_covariance) {
+    estimator.set_update_method(method);
+    estimator.place_number_of_particles = number_of_particles;
+    estimator.place_max_number_of_particles = number_of_particles;
+    estimator.place_sampling_method = sampling;
+    estimator.set_random_seed(seed);
+    Eigen::Isometry3d new_mean;
+    try {
+      estimator.place_step_with_Lie_distribution(
+          vertices, triangles, place.gripper_transform, place.support_surface,
+          place.mean, place.covariance, new_mean, new_covariance);
+    } catch (std::runtime_error &e) {
+      return false;
+    }
+    return new_covariance.allFinite();
+  };
+
+  double total_sigma_point_error = 0.0, total_particle_error = 0.0;
+  for (int t = 0; t < cases.size(); t++) {
+    CovarianceMatrix reference_covariance, sigma_point_covariance;
+    if (!place_covariance(cases[t], particle_update,
+                          reference_number_of_particles,
+                          quasi_monte_carlo_sampling, number_of_seeds,
+                          reference_covariance) ||
+        !place_covariance(cases[t], sigma_point_update, 0,
+                          monte_carlo_sampling, 0, sigma_point_covariance) ||
+        estimator.default_context.particle_set.size() !=
+            number_of_sigma_points) {
+      continue;
+    }
+    // the same number of evaluations of the action by random particles
+    double particle_error = 0.0;
+    int number_of_successes = 0;
+    for (int seed = 0; seed < number_of_seeds; seed++) {
+      CovarianceMatrix new_covariance;
+      if (place_covariance(cases[t], particle_update, number_of_sigma_points,
+                           monte_carlo_sampling, seed, new_covariance)) {
+        particle_error += relative_error(new_covariance, reference_covariance);
+        number_of_successes++;
+      }
+    }
+    if (number_of_successes == 0) {
+      continue;
+    }
+    double sigma_point_error =
+        relative_error(sigma_point_covariance, reference_covariance);
+    printf("case %d, sigma point error: %.4lf, particle error: %.4lf\n", t,
+           sigma_point_error, particle_error / number_of_successes);
+    total_sigma_point_error += sigma_point_error;
+    total_particle_error += particle_error / number_of_successes;
+  }
+  EXPECT_GT(total_particle_error, 0.0);
+  EXPECT_LT(total_sigma_point_error, total_particle_error);
+}
+
+TEST(RotationParticleTest, PlaceCovarianceOnCones) {
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_adaptive_sampling(false, 0.0);
+  const int number_of_particles = 64;
+
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  std::vector<place_case> cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", cases);
+
+  // update the distribution by a place action. Returns false if the update
+  // fails.
+  auto place_covariance = [&](const place_case &place,
+                              const CovarianceMatrix &old_covariance,
+                              const update_method &method,
+                              const int &number_of_particles,
+                              const sampling_method &sampling, const int &seed,
+                              CovarianceMatrix &new_covariance) {
+    estimator.set_update_method(method);
+    estimator.place_number_of_particles = number_of_particles;
+    estimator.place_max_number_of_particles = number_of_particles;
+    estimator.place_sampling_method = sampling;
+    estimator.set_random_seed(seed);
+    Eigen::Isometry3d new_mean;
+    try {
+      estimator.place_step_with_Lie_distribution(
+          vertices, triangles, place.gripper_transform, place.support_surface,
+          place.mean, old_covariance, new_mean, new_covariance);
+    } catch (std::runtime_error &e) {
+      return false;
+    }
+    return new_covariance.allFinite();
+  };
+
+  // The rotations are drawn in the same way by both methods, so the errors of
+  // the covariances of the translations are compared
+  auto translation_error = [](const CovarianceMatrix &estimated,
+                              const CovarianceMatrix &reference) {
+    return (estimated - reference).topLeftCorner<3, 3>().norm() /
+           reference.topLeftCorner<3, 3>().norm();
+  };
+
+  double total_rotation_particle_error = 0.0, total_particle_error = 0.0;
+  for (int t = 0; t < cases.size(); t++) {
+    // If the rotation is certain, the translation is propagated exactly, as
+    // by the linearization at the mean
+    CovarianceMatrix translation_covariance = CovarianceMatrix::Zero();
+    translation_covariance.topLeftCorner<3, 3>() =
+        cases[t].covariance.topLeftCorner<3, 3>();
+    CovarianceMatrix linear_covariance, propagated_covariance;
+    if (place_covariance(cases[t], translation_covariance,
+                         linear_approximation_update, 0, monte_carlo_sampling,
+                         0, linear_covariance) &&
+        place_covariance(cases[t], translation_covariance,
+                         rotation_particle_update, number_of_particles,
+                         monte_carlo_sampling, 0, propagated_covariance)) {
+      EXPECT_LT((propagated_covariance - linear_covariance).norm(),
+                1e-6 * translation_covariance.norm());
+    }
+
+    // The translations of the test cases are determined by the rotations, so
+    // the translations independent of the rotations are added
+    CovarianceMatrix covariance = cases[t].covariance;
+    covariance.topLeftCorner<3, 3>() += 0.01 * Eigen::Matrix3d::Identity();
+    CovarianceMatrix reference_covariance;
+    if (!place_covariance(cases[t], covariance, particle_update,
+                          reference_number_of_particles,
+                          quasi_monte_carlo_sampling, number_of_seeds,
+                          reference_covariance)) {
+      continue;
+    }
+    // the same number of evaluations of the action
+    double rotation_particle_error = 0.0, particle_error = 0.0;
+    int number_of_successes = 0;
+    for (int seed = 0; seed < number_of_seeds; seed++) {
+      CovarianceMatrix rotation_particle_covariance, particle_covariance;
+      if (place_covariance(cases[t], covariance, rotation_particle_update,
+                           number_of_particles, monte_carlo_sampling, seed,
+                           rotation_particle_covariance) &&
+          place_covariance(cases[t], covariance, particle_update,
+                           number_of_particles, monte_carlo_sampling, seed,
+                           particle_covariance)) {
+        rotation_particle_error += translation_error(
+            rotation_particle_covariance, reference_covariance);
+        particle_error +=
+            translation_error(particle_covariance, reference_covariance);
+        number_of_successes++;
+      }
+    }
+    if (number_of_successes == 0) {
+      continue;
+    }
+    printf("case %d, rotation particle error: %.4lf, particle error: %.4lf\n",
+           t, rotation_particle_error / number_of_successes,
+           particle_error / number_of_successes);
+    total_rotation_particle_error +=
+        rotation_particle_error / number_of_successes;
+    total_particle_error += particle_error / number_of_successes;
+  }
+  EXPECT_GT(total_particle_error, 0.0);
+  EXPECT_LT(total_rotation_particle_error, total_particle_error);
+}
+
+TEST(AdaptiveSamplingTest, EasyStepsUseFewerParticles) {
+  // All the particles of a certain place action succeed, so adaptive sampling
+  // stops below the nominal number of particles, while it adds particles
+  // beyond it for a grasp action of which many particles fail
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_update_method(particle_update);
+  const int nominal_number_of_particles = 100;
+  estimator.place_min_number_of_particles =
+      estimator.grasp_min_number_of_particles = 25;
+  estimator.place_number_of_particles = estimator.grasp_number_of_particles =
+      nominal_number_of_particles;
+  estimator.place_max_number_of_particles =
+      estimator.grasp_max_number_of_particles = 800;
+  ParticleSet &particle_set = estimator.default_context.particle_set;
+
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  std::vector<place_case> place_cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", place_cases);
+  ASSERT_FALSE(place_cases.empty());
+  const place_case &place = place_cases[0];
+  auto place_step = [&](const bool &use_adaptive_sampling) {
+    estimator.set_adaptive_sampling(use_adaptive_sampling, 0.5);
+    estimator.set_random_seed(0);
+    Eigen::Isometry3d new_mean;
+    CovarianceMatrix new_covariance;
+    estimator.place_step_with_Lie_distribution(
+        vertices, triangles, place.gripper_transform, place.support_surface,
+        place.mean, 1e-4 * place.covariance, new_mean, new_covariance);
+  };
+  place_step(false);
+  EXPECT_EQ(particle_set.size(), nominal_number_of_particles);
+  place_step(true);
+  EXPECT_LT(particle_set.size(), nominal_number_of_particles);
+  EXPECT_EQ((particle_set.weights.array() > 0.0).count(),
+            particle_set.size());
+
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  std::vector<grasp_case> grasp_cases;
+  load_successful_grasp_cases(
+      package_directory + "/test/grasp_test_gearmotor_Lie_1.txt", grasp_cases);
+  ASSERT_FALSE(grasp_cases.empty());
+  const grasp_case &grasp = grasp_cases[0];
+  estimator.set_random_seed(0);
+  Eigen::Isometry3d new_mean;
+  CovarianceMatrix new_covariance;
+  try {
+    estimator.grasp_step_with_Lie_distribution(
+        vertices, triangles, grasp.gripper_transform, grasp.mean,
+        100.0 * grasp.covariance, new_mean, new_covariance);
+  } catch (std::runtime_error &e) {
+  }
+  EXPECT_GT(particle_set.size(), nominal_number_of_particles);
+}
+
+TEST(AutomaticUpdateTest, ChoosesMethodByUncertainty) {
+  // A place action is nearly linear within a tiny uncertainty, but not within
+  // the uncertainty of some test cases, where the touching vertices change
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_adaptive_sampling(false, 0.0);
+  estimator.set_update_method(automatic_update);
+
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  std::vector<place_case> cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", cases);
+  ASSERT_FALSE(cases.empty());
+
+  EstimatorContext &context = estimator.default_context;
+  int number_of_steps = 0;
+  for (const auto &place : cases) {
+    Eigen::Isometry3d new_mean, linear_mean;
+    CovarianceMatrix new_covariance, linear_covariance;
+    try {
+      estimator.place_step_with_Lie_distribution(
+          vertices, triangles, place.gripper_transform, place.support_surface,
+          place.mean, 1e-8 * place.covariance, new_mean, new_covariance);
+    } catch (std::runtime_error &e) {
+      continue;
+    }
+    number_of_steps++;
+    EXPECT_EQ(context.last_update_method, linear_approximation_update);
+    EXPECT_GE(context.last_nonlinearity, 0.0);
+    EXPECT_LE(context.last_nonlinearity, estimator.automatic_linear_threshold);
+    // the result is that of the linearization
+    estimator.set_update_method(linear_approximation_update);
+    estimator.place_step_with_Lie_distribution(
+        vertices, triangles, place.gripper_transform, place.support_surface,
+        place.mean, 1e-8 * place.covariance, linear_mean, linear_covariance);
+    number_of_steps++;
+    EXPECT_EQ(context.last_nonlinearity, -1.0);
+    EXPECT_TRUE(new_mean.isApprox(linear_mean));
+    EXPECT_TRUE(new_covariance.isApprox(linear_covariance));
+    estimator.set_update_method(automatic_update);
+
+    try {
+      estimator.place_step_with_Lie_distribution(
+          vertices, triangles, place.gripper_transform, place.support_surface,
+          place.mean, place.covariance, new_mean, new_covariance);
+    } catch (std::runtime_error &e) {
+      continue;
+    }
+    number_of_steps++;
+    // some of the cases are still linear, since the rotations keep the
+    // touching vertices
+    if (context.last_nonlinearity < 0.0 ||
+        context.last_nonlinearity > estimator.automatic_sigma_point_threshold) {
+      EXPECT_EQ(context.last_update_method, particle_update);
+    }
+  }
+  EXPECT_GT(number_of_steps, 0);
+  EXPECT_GT(context.update_method_counts[particle_update], 0);
+
+  // every step is counted once
+  int number_of_counted_steps = 0;
+  for (int k = 0; k < number_of_update_methods; k++) {
+    number_of_counted_steps += context.update_method_counts[k];
+    EXPECT_GE(context.update_method_seconds[k], 0.0);
+  }
+  EXPECT_EQ(number_of_counted_steps, number_of_steps);
+  EXPECT_EQ(context.update_method_counts[automatic_update], 0);
+}
+
+TEST(LieDistributionTest, WeightedMean) {
+  // The weighted mean on SE(3) satisfies sum_i w_i log(T_i * mean^{-1}) == 0
+  // and does not depend on the number of threads. The particles with zero
+  // weights are ignored.
+  const int number_of_particles = 200;
+  PoseEstimator estimator;
+  estimator.set_particle_parameters(number_of_particles, Particle::Zero());
+  EstimatorContext &context = estimator.default_context;
+  RandomStream stream(0, 0, 0);
+  Eigen::Isometry3d center =
+      particle_to_eigen_transform(get_UND_particle(stream));
+  for (int i = 0; i < number_of_particles; i++) {
+    Particle xi = 0.3 * get_UND_particle(stream);
+    context.particle_set.set_transform(i, se3_exp<double>(xi) * center);
+    context.particle_set.weights(i) = (i % 3 == 0 ? 0.0 : stream.uniform());
+  }
+  context.particle_set.weights /= context.particle_set.weights.sum();
+
+  Eigen::Isometry3d means[2];
+  CovarianceMatrix covariances[2];
+  for (int t = 0; t < 2; t++) {
+    estimator.set_number_of_threads(1 + 2 * t);
+    estimator.calculate_weighted_Lie_distribution(context, means[t],
+                                                  covariances[t]);
+  }
+  EXPECT_TRUE(means[0].matrix() == means[1].matrix());
+  EXPECT_TRUE(covariances[0] == covariances[1]);
+
+  Particle sum_of_xi = Particle::Zero();
+  CovarianceMatrix covariance = CovarianceMatrix::Zero();
+  for (int i = 0; i < number_of_particles; i++) {
+    Particle xi = se3_log<double>(context.particle_set.transform(i) *
+                                  means[0].inverse());
+    sum_of_xi += context.particle_set.weights(i) * xi;
+    covariance += context.particle_set.weights(i) * xi * xi.transpose();
+  }
+  EXPECT_LT(sum_of_xi.norm(), 10 * POSE_TOLERANCE);
+  EXPECT_LT(relative_error(covariances[0], covariance), 10 * POSE_TOLERANCE);
+}
+
+TEST(WeightedMomentTest, AgreesWithTwoPasses) {
+  // The single-pass moments agree with E[xx^T] - E[x]E[x]^T with Bessel's
+  // correction, also when the accumulators of uneven chunks are merged and
+  // when the weights are far below the smallest double
+  const int number_of_particles = 300;
+  RandomStream stream(0, 0, 0);
+  ParticleSet::TangentMatrix particles(6, number_of_particles);
+  Eigen::VectorXd weights(number_of_particles);
+  for (int i = 0; i < number_of_particles; i++) {
+    particles.col(i) = Particle::Constant(100.0) + get_UND_particle(stream);
+    weights(i) = (i % 5 == 0 ? 0.0 : stream.uniform());
+  }
+  Eigen::VectorXd normalized_weights = weights / weights.sum();
+  Particle mean = particles * normalized_weights;
+  CovarianceMatrix covariance =
+      particles * normalized_weights.asDiagonal() * particles.transpose() -
+      mean * mean.transpose();
+  double effective_sample_size =
+      weights.sum() * weights.sum() / weights.squaredNorm();
+  covariance /= 1.0 - 1.0 / effective_sample_size;
+
+  for (double log_scale : {0.0, -2000.0}) {
+    WeightedMomentAccumulator<6> single, merged, chunk;
+    for (int i = 0; i < number_of_particles; i++) {
+      double log_weight = std::log(weights(i)) + log_scale;
+      single.add(particles.col(i), log_weight);
+      chunk.add(particles.col(i), log_weight);
+      if (i % 7 == 3 || i == number_of_particles - 1) {
+        merged.merge(chunk);
+        chunk = WeightedMomentAccumulator<6>();
+      }
+    }
+    for (const auto &moments : {single, merged}) {
+      EXPECT_NEAR(moments.log_sum_of_weights(),
+                  std::log(weights.sum()) + log_scale, 1e-9);
+      EXPECT_NEAR(moments.effective_sample_size(), effective_sample_size,
+                  1e-9 * effective_sample_size);
+      EXPECT_LT((moments.mean() - mean).norm(), 1e-9 * mean.norm());
+      EXPECT_LT(relative_error(moments.covariance(), covariance), 1e-9);
+    }
+  }
+
+  // calculate_new_distribution does not depend on the number of threads
+  PoseEstimator estimator;
+  estimator.set_particle_parameters(number_of_particles, Particle::Zero());
+  EstimatorContext &context = estimator.default_context;
+  context.particle_set.tangents = particles;
+  context.particle_set.weights = weights;
+  Particle new_means[2];
+  CovarianceMatrix new_covariances[2];
+  for (int t = 0; t < 2; t++) {
+    estimator.set_number_of_threads(1 + 2 * t);
+    estimator.calculate_new_distribution(context, new_means[t],
+                                         new_covariances[t]);
+  }
+  EXPECT_TRUE(new_means[0] == new_means[1]);
+  EXPECT_TRUE(new_covariances[0] == new_covariances[1]);
+  EXPECT_LT(relative_error(new_covariances[0], covariance), 1e-9);
+}
+
+TEST(ResamplingTest, CountsAreRoundedExpectations) {
+  // Both methods draw the i-th particle floor(n * w_i) or ceil(n * w_i) times
+  const int number_of_particles = 50, number_of_samples = 1000;
+  RandomStream stream(0, 0, 0);
+  Eigen::VectorXd weights(number_of_particles);
+  for (int i = 0; i < number_of_particles; i++) {
+    weights(i) = (i % 4 == 0 ? 0.0 : stream.uniform());
+  }
+  for (int m = 0; m < 2; m++) {
+    for (int seed = 0; seed < number_of_seeds; seed++) {
+      RandomStream resampling_stream(seed, 0, 0);
+      std::vector<int> indices =
+          (m == 0 ? get_systematic_resampling_indices(
+                        weights, number_of_samples, resampling_stream)
+                  : get_residual_resampling_indices(weights, number_of_samples,
+                                                    resampling_stream));
+      ASSERT_EQ(indices.size(), number_of_samples);
+      std::vector<int> counts(number_of_particles, 0);
+      for (int i : indices) {
+        ASSERT_GE(i, 0);
+        ASSERT_LT(i, number_of_particles);
+        counts[i]++;
+      }
+      for (int i = 0; i < number_of_particles; i++) {
+        double expected_count = number_of_samples * weights(i) / weights.sum();
+        EXPECT_GE(counts[i], std::floor(expected_count - 1e-9));
+        EXPECT_LE(counts[i], std::ceil(expected_count + 1e-9));
+      }
+    }
+  }
+}
+
+TEST(PersistentBeliefTest, KeepsNonGaussianShape) {
+  // The first step keeps only the particles on one side of the old mean,
+  // which is not a normal distribution. The following steps of an action doing
+  // nothing resample the kept particles, so they stay on that side, while
+  // particles drawn from the normal distribution do not.
+  const int number_of_particles = 256;
+  PoseEstimator estimator;
+  estimator.set_particle_parameters(1, Particle::Zero());
+  EstimatorContext &context = estimator.default_context;
+  RandomStream stream(0, 0, 0);
+  CovarianceMatrix A;
+  for (int j = 0; j < 6; j++) {
+    A.col(j) = 0.05 * get_UND_particle(stream);
+  }
+  CovarianceMatrix old_covariance = A * A.transpose();
+  Eigen::Isometry3d old_mean =
+      particle_to_eigen_transform(get_UND_particle(stream));
+
+  // the first coordinate of the i-th particle around old_mean
+  auto deviation = [&](const int &i) {
+    return se3_log<double>(context.particle_set.transform(i) *
+                           old_mean.inverse())(0);
+  };
+  auto truncating_action = [&](const int &first, const int &last) {
+    for (int i = first; i < last; i++) {
+      context.particle_set.weights(i) = (deviation(i) > 0.0 ? 1.0 : 0.0);
+    }
+  };
+  auto identity_action = [&](const int &first, const int &last) {
+    context.particle_set.weights.segment(first, last - first).setOnes();
+  };
+  auto count_positive_deviations = [&]() {
+    int count = 0;
+    for (int i = 0; i < context.particle_set.size(); i++) {
+      count += (deviation(i) > 0.0 ? 1 : 0);
+    }
+    return count;
+  };
+
+  for (int m = 0; m < 2; m++) {
+    // copies of the kept particles, and jittered ones
+    double jitter = (m == 0 ? 0.0 : 0.1);
+    estimator.set_persistent_particles(
+        true, (m == 0 ? residual_resampling : systematic_resampling), jitter);
+    Eigen::Isometry3d mean, next_mean;
+    CovarianceMatrix covariance, next_covariance;
+    estimator.sample_Lie_particles(
+        context, number_of_particles, number_of_particles,
+        number_of_particles, monte_carlo_sampling, old_mean, old_covariance,
+        truncating_action);
+    estimator.calculate_new_Lie_distribution(context, old_mean, mean,
+                                             covariance);
+    ASSERT_TRUE(context.matches_particle_belief(mean, covariance));
+    EXPECT_FALSE(context.matches_particle_belief(old_mean, old_covariance));
+
+    for (int step = 0; step < 3; step++) {
+      estimator.sample_Lie_particles(
+          context, number_of_particles, number_of_particles,
+          number_of_particles, monte_carlo_sampling, mean, covariance,
+          identity_action);
+      ASSERT_EQ(context.particle_set.size(), number_of_particles);
+      if (jitter == 0.0) {
+        EXPECT_EQ(count_positive_deviations(), number_of_particles);
+      } else {
+        EXPECT_GT(count_positive_deviations(), 0.9 * number_of_particles);
+        EXPECT_GT(context.particle_set.tangents.colwise().norm().minCoeff(),
+                  0.0);
+      }
+      estimator.calculate_new_Lie_distribution(context, mean, next_mean,
+                                               next_covariance);
+      mean = next_mean;
+      covariance = next_covariance;
+    }
+
+    // Without the kept particles, the normal distribution is sampled
+    estimator.clear_particle_belief();
+    estimator.sample_Lie_particles(
+        context, number_of_particles, number_of_particles,
+        number_of_particles, monte_carlo_sampling, mean, covariance,
+        identity_action);
+    EXPECT_LT(count_positive_deviations(), number_of_particles);
+  }
+}
+
+// The poses after an action of the particles of the Lie distribution
+// (mean, covariance), whose poses are stored as PoseScalar. The tangents are
+// the same for any PoseScalar. Returns the number of the particles for which
+// the action succeeds.
+template <typename PoseScalar>
+int act_on_particles(
+    const Eigen::Isometry3d &mean, const CovarianceMatrix &covariance,
+    const int &number_of_particles,
+    const std::function<action_status(const Eigen::Isometry3d &,
+                                      Eigen::Isometry3d &)> &action,
+    BasicParticleSet<PoseScalar> &particle_set) {
+  RandomStream stream(0, 0, 0);
+  CovarianceMatrix X = safe_XXT(covariance);
+  particle_set.resize(number_of_particles);
+  for (int i = 0; i < number_of_particles; i++) {
+    particle_set.tangents.col(i) = X * get_UND_particle(stream);
+  }
+  batch_se3_exp(particle_set, mean, 0, number_of_particles);
+  int number_of_successes = 0;
+  for (int i = 0; i < number_of_particles; i++) {
+    Eigen::Isometry3d new_pose;
+    if (action(particle_set.transform(i), new_pose) == success_status) {
+      particle_set.set_transform(i, new_pose);
+      particle_set.weights(i) = 1.0;
+      number_of_successes++;
+    } else {
+      particle_set.weights(i) = 0.0;
+    }
+  }
+  return number_of_successes;
+}
+
+// log(particle_set.transform(i) * mean^{-1}) for all particles
+template <typename PoseScalar>
+ParticleSet::TangentMatrix
+xis_around(const BasicParticleSet<PoseScalar> &particle_set,
+           const Eigen::Isometry3d &mean) {
+  std::vector<int> indices(particle_set.size());
+  std::iota(indices.begin(), indices.end(), 0);
+  ParticleSet::TangentMatrix xis(6, indices.size());
+  batch_se3_log(particle_set, indices, mean.inverse(), 0, indices.size(), xis);
+  return xis;
+}
+
+TEST(FloatPoseTest, AgreesWithDouble) {
+  // The particles whose poses are float are compared with those whose poses
+  // are double, on the place and grasp cases of test/. The vertices touching
+  // the ground or the gripper can change by the rounding of the poses, so the
+  // results of some particles differ, but the covariances must agree.
+  const int number_of_particles = 1000;
+  double max_covariance_error = 0.0, total_mismatch_ratio = 0.0;
+  int number_of_cases = 0;
+  auto compare = [&](const std::string &name, const Eigen::Isometry3d &mean,
+                     const CovarianceMatrix &covariance,
+                     const std::function<action_status(
+                         const Eigen::Isometry3d &, Eigen::Isometry3d &)>
+                         &action) {
+    BasicParticleSet<double> double_particles;
+    BasicParticleSet<float> float_particles;
+    int double_successes = act_on_particles(mean, covariance,
+                                            number_of_particles, action,
+                                            double_particles);
+    act_on_particles(mean, covariance, number_of_particles, action,
+                     float_particles);
+    if (double_successes < number_of_particles / 10) {
+      return;
+    }
+    // The poses after the action differ more than the rounding error if the
+    // touching vertices change
+    int number_of_mismatches = 0;
+    for (int i = 0; i < number_of_particles; i++) {
+      if (double_particles.weights(i) != float_particles.weights(i) ||
+          se3_log<double>(float_particles.transform(i) *
+                          double_particles.transform(i).inverse())
+                  .norm() > 1e-4) {
+        number_of_mismatches++;
+      }
+    }
+    // The logarithm is discontinuous at the rotation angle pi, so the
+    // particles near it are not used for the covariances
+    Eigen::Isometry3d reference_mean;
+    action(mean, reference_mean);
+    ParticleSet::TangentMatrix double_xis =
+        xis_around(double_particles, reference_mean);
+    ParticleSet::TangentMatrix float_xis =
+        xis_around(float_particles, reference_mean);
+    WeightedMomentAccumulator<6> double_moments, float_moments;
+    for (int i = 0; i < number_of_particles; i++) {
+      if (double_particles.weights(i) > 0.0 &&
+          float_particles.weights(i) > 0.0 &&
+          double_xis.col(i).tail<3>().norm() < M_PI - 0.01 &&
+          float_xis.col(i).tail<3>().norm() < M_PI - 0.01) {
+        double_moments.add(double_xis.col(i), 0.0);
+        float_moments.add(float_xis.col(i), 0.0);
+      }
+    }
+    double error = relative_error(float_moments.covariance(),
+                                  double_moments.covariance());
+    double mismatch_ratio = (double)number_of_mismatches / number_of_particles;
+    printf("%s, covariance error: %.2e, mismatched particles: %.4lf\n",
+           name.c_str(), error, mismatch_ratio);
+    max_covariance_error = std::max(max_covariance_error, error);
+    total_mismatch_ratio += mismatch_ratio;
+    number_of_cases++;
+  };
+
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  Eigen::Vector3d center_of_gravity =
+      calculate_center_of_gravity(vertices, triangles);
+  std::vector<place_case> place_cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", place_cases);
+  for (int t = 0; t < place_cases.size(); t++) {
+    const place_case &place = place_cases[t];
+    compare("place case " + std::to_string(t), place.mean, place.covariance,
+            [&](const Eigen::Isometry3d &pose, Eigen::Isometry3d &new_pose) {
+              place_calculator calculator;
+              action_status status = calculator.calculate(
+                  pose, center_of_gravity, vertices, place.support_surface,
+                  place.gripper_transform, false, false);
+              new_pose = calculator.new_mean;
+              return status;
+            });
+  }
+
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  center_of_gravity = calculate_center_of_gravity(vertices, triangles);
+  std::vector<grasp_case> grasp_cases;
+  load_successful_grasp_cases(
+      package_directory + "/test/grasp_test_gearmotor_Lie_1.txt", grasp_cases);
+  for (int t = 0; t < grasp_cases.size(); t++) {
+    const grasp_case &grasp = grasp_cases[t];
+    compare("grasp case " + std::to_string(t), grasp.mean, grasp.covariance,
+            [&](const Eigen::Isometry3d &pose, Eigen::Isometry3d &new_pose) {
+              grasp_calculator calculator;
+              action_status status = calculator.calculate(
+                  vertices, vertices, grasp.gripper_transform, pose,
+                  center_of_gravity, false, false);
+              new_pose = calculator.new_mean;
+              return status;
+            });
+  }
+  ASSERT_GT(number_of_cases, 0);
+  EXPECT_LT(max_covariance_error, 1e-5);
+  EXPECT_LT(total_mismatch_ratio / number_of_cases, 1e-2);
+}
+
+TEST(AllocationTest, SteadyStatePlaceStep) {
+  // The workspaces and the buffers of the estimator keep their capacities, so
+  // the place steps after the first one call operator new no times, for any
+  // number of threads
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  std::vector<place_case> cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", cases);
+  ASSERT_FALSE(cases.empty());
+  const place_case &place = cases[0];
+
+  for (int number_of_threads : {1, 3}) {
+    estimator.set_number_of_threads(number_of_threads);
+    Eigen::Isometry3d new_mean;
+    CovarianceMatrix new_covariance;
+    auto place_step = [&]() {
+      estimator.place_step_with_Lie_distribution(
+          vertices, triangles, place.gripper_transform, place.support_surface,
+          place.mean, place.covariance, new_mean, new_covariance);
+    };
+    place_step();
+    long number_of_allocations_before = number_of_allocations;
+    for (int step = 0; step < 3; step++) {
+      place_step();
+    }
+    EXPECT_EQ(number_of_allocations - number_of_allocations_before, 0)
+        << "threads: " << number_of_threads;
+  }
+}
+
+TEST(AllocationTest, SteadyStateGraspAndPushSteps) {
+  // The workspaces are reserved for the largest truncated object, so the grasp
+  // and push steps on a prepared object after the first one call operator new
+  // no times, although the sizes of the truncated objects depend on the
+  // particles drawn at each step, for any number of threads
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_use_linear_approximation(false);
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  PreparedObjectPtr object = prepare_object(vertices, triangles);
+  std::vector<grasp_case> cases;
+  load_successful_grasp_cases(
+      package_directory + "/test/grasp_test_gearmotor_Lie_1.txt", cases);
+  ASSERT_FALSE(cases.empty());
+  const grasp_case &grasp = cases[0];
+  // the gripper turned to push along the gripping direction of the grasp
+  Eigen::Isometry3d push_gripper_transform =
+      grasp.gripper_transform *
+      Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitX());
+
+  Eigen::Isometry3d new_mean;
+  CovarianceMatrix new_covariance;
+  std::vector<std::function<void()>> steps = {
+      [&]() {
+        estimator.grasp_step_with_Lie_distribution(
+            *object, grasp.gripper_transform, grasp.mean, grasp.covariance,
+            new_mean, new_covariance);
+      },
+      [&]() {
+        estimator.push_step_with_Lie_distribution(
+            *object, push_gripper_transform, grasp.mean, grasp.covariance,
+            new_mean, new_covariance);
+      }};
+  for (int number_of_threads : {1, 3}) {
+    estimator.set_number_of_threads(number_of_threads);
+    for (int k = 0; k < steps.size(); k++) {
+      estimator.set_random_seed(number_of_threads);
+      steps[k]();
+      long number_of_allocations_before = number_of_allocations;
+      // the later steps draw other particles
+      for (int step = 0; step < 3; step++) {
+        steps[k]();
+      }
+      EXPECT_EQ(number_of_allocations - number_of_allocations_before, 0)
+          << (k == 0 ? "grasp" : "push") << ", threads: " << number_of_threads;
+    }
+  }
+}
+
+TEST(ActionStatusTest, CountsMatchWeights) {
+  // Every particle of a grasp step of a wide distribution is counted once, by
+  // success or by the reason of its failure, and the throwing constructor
+  // reports the same reason as the status
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_use_linear_approximation(false);
+  estimator.set_adaptive_sampling(false, 0.0);
+  estimator.set_number_of_threads(3);
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  std::vector<grasp_case> cases;
+  load_successful_grasp_cases(
+      package_directory + "/test/grasp_test_gearmotor_Lie_1.txt", cases);
+  ASSERT_FALSE(cases.empty());
+  const grasp_case &grasp = cases[0];
+
+  EstimatorContext &context = estimator.default_context;
+  Eigen::Isometry3d new_mean;
+  CovarianceMatrix new_covariance;
+  try {
+    estimator.grasp_step_with_Lie_distribution(
+        vertices, triangles, grasp.gripper_transform, grasp.mean,
+        100.0 * grasp.covariance, new_mean, new_covariance);
+  } catch (std::runtime_error &e) {
+  }
+  const ActionStatusCounts &counts = context.action_status_counts;
+  int number_of_evaluations = 0;
+  for (int k = 0; k < number_of_action_statuses; k++) {
+    number_of_evaluations += counts[k];
+  }
+  ParticleSet &particle_set = context.particle_set;
+  EXPECT_EQ(number_of_evaluations, particle_set.size());
+  EXPECT_EQ(counts[success_status],
+            (particle_set.weights.array() > 0.0).count());
+  EXPECT_GT(counts[success_status], 0);
+  EXPECT_LT(counts[success_status], particle_set.size());
+  // the successful particles have the same weight
+  EXPECT_NEAR(context.last_effective_sample_size, counts[success_status],
+              1e-9 * counts[success_status]);
+
+  Eigen::Vector3d center_of_gravity =
+      calculate_center_of_gravity(vertices, triangles);
+  std::map<std::string, int> number_of_messages;
+  for (int i = 0; i < particle_set.size(); i++) {
+    grasp_calculator calculator;
+    action_status status =
+        calculator.calculate(vertices, vertices, grasp.gripper_transform,
+                             particle_set.transform(i), center_of_gravity);
+    std::string message = action_status_message(success_status);
+    try {
+      grasp_calculator(vertices, vertices, grasp.gripper_transform,
+                       particle_set.transform(i), center_of_gravity);
+    } catch (std::runtime_error &e) {
+      message = e.what();
+    }
+    EXPECT_EQ(message, action_status_message(status)) << i;
+    number_of_messages[message]++;
+  }
+  EXPECT_GT(number_of_messages.size(), 1);
+}
+
+TEST(ContextTest, ConcurrentStepsMatchSequentialSteps) {
+  // The steps of one estimator with different contexts run in parallel. The
+  // i-th particle of each context is drawn from the same random stream, so
+  // every context gives the result of a single step on a new context, whether
+  // the shared workers or the calling thread evaluate its particles.
+  const int number_of_contexts = 4;
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_number_of_threads(3);
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  std::vector<place_case> cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", cases);
+  ASSERT_FALSE(cases.empty());
+  const place_case &place = cases[0];
+
+  const PoseEstimator &shared_estimator = estimator;
+  auto place_step = [&](EstimatorContext &context, Eigen::Isometry3d &new_mean,
+                        CovarianceMatrix &new_covariance) {
+    shared_estimator.place_step_with_Lie_distribution(
+        context, vertices, triangles, place.gripper_transform,
+        place.support_surface, place.mean, place.covariance, new_mean,
+        new_covariance);
+  };
+  EstimatorContext sequential_context;
+  Eigen::Isometry3d expected_mean;
+  CovarianceMatrix expected_covariance;
+  place_step(sequential_context, expected_mean, expected_covariance);
+
+  std::vector<EstimatorContext, Eigen::aligned_allocator<EstimatorContext>>
+      contexts(number_of_contexts);
+  std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d>>
+      means(number_of_contexts);
+  std::vector<CovarianceMatrix, Eigen::aligned_allocator<CovarianceMatrix>>
+      covariances(number_of_contexts);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < number_of_contexts; c++) {
+    threads.push_back(std::thread(
+        [&, c]() { place_step(contexts[c], means[c], covariances[c]); }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int c = 0; c < number_of_contexts; c++) {
+    EXPECT_TRUE(means[c].matrix() == expected_mean.matrix()) << c;
+    EXPECT_TRUE(covariances[c] == expected_covariance) << c;
+    EXPECT_EQ(contexts[c].random_step, 1);
+  }
+  // the default context is not used
+  EXPECT_EQ(estimator.default_context.random_step, 0);
+}
+
+TEST(ContextTest, ConcurrentPlansMatchSequentialPlan) {
+  // Plans of one planner with different contexts run in parallel. The random
+  // choices of the candidates and the particles of the steps are drawn from
+  // the random sequence of each context, so every context gives the plan of
+  // a new context.
+  const int number_of_contexts = 4;
+  Planner planner;
+  planner.load_config_file(package_directory +
+                           "/launch/estimator_config.yaml");
+  planner.set_number_of_threads(3);
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  std::vector<grasp_case> cases;
+  load_successful_grasp_cases(
+      package_directory + "/test/grasp_test_gearmotor_Lie_1.txt", cases);
+  ASSERT_FALSE(cases.empty());
+  const grasp_case &grasp = cases[0];
+  // The belief of the case is in the coordinates of the gripper, and that of
+  // the planner is in the world. The grasp point is the gripper of the case in
+  // the coordinates of the object at the mean. The belief is narrowed so that
+  // the planner, which rejects an action if a particle fails, can grasp it.
+  Eigen::Isometry3d mean = grasp.gripper_transform * grasp.mean;
+  CovarianceMatrix covariance =
+      transform_covariance(grasp.gripper_transform, 1e-2 * grasp.covariance);
+  auto grasp_points = std::make_shared<std::vector<Eigen::Isometry3d>>(
+      1, grasp.mean.inverse());
+  planner.set_geometry(prepare_object(vertices, triangles), grasp_points, 0.0);
+
+  const Planner &shared_planner = planner;
+  using BestPlans = std::vector<std::pair<double, std::vector<UpdateAction>>>;
+  auto plan = [&](EstimatorContext &context) {
+    return shared_planner.best_scores_for_each_costs(
+        context, Eigen::Isometry3d::Identity(), false, mean, covariance,
+        CovarianceMatrix::Identity(), 1);
+  };
+  auto expect_same_plans = [](const BestPlans &plans,
+                              const BestPlans &expected_plans, const int &c) {
+    ASSERT_EQ(plans.size(), expected_plans.size()) << c;
+    for (int cost = 0; cost < plans.size(); cost++) {
+      EXPECT_EQ(plans[cost].first, expected_plans[cost].first) << c;
+      ASSERT_EQ(plans[cost].second.size(), expected_plans[cost].second.size())
+          << c;
+      for (int k = 0; k < plans[cost].second.size(); k++) {
+        EXPECT_EQ(plans[cost].second[k].type,
+                  expected_plans[cost].second[k].type)
+            << c;
+        EXPECT_TRUE(plans[cost].second[k].gripper_pose.matrix() ==
+                    expected_plans[cost].second[k].gripper_pose.matrix())
+            << c;
+      }
+    }
+  };
+  EstimatorContext sequential_context;
+  BestPlans expected_plans = plan(sequential_context);
+  // a plan of one action is found
+  ASSERT_EQ(expected_plans.size(), 2);
+  ASSERT_EQ(expected_plans[1].second.size(), 1);
+
+  std::vector<EstimatorContext, Eigen::aligned_allocator<EstimatorContext>>
+      contexts(number_of_contexts);
+  std::vector<BestPlans> plans(number_of_contexts);
+  std::vector<std::thread> threads;
+  for (int c = 0; c < number_of_contexts; c++) {
+    threads.push_back(
+        std::thread([&, c]() { plans[c] = plan(contexts[c]); }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (int c = 0; c < number_of_contexts; c++) {
+    expect_same_plans(plans[c], expected_plans, c);
+    EXPECT_EQ(contexts[c].random_step, sequential_context.random_step) << c;
+  }
+  // the default context is not used
+  EXPECT_EQ(planner.default_context.random_step, 0);
+}
+
+TEST(BatchTest, MatchesSingleSteps) {
+  // A batch of grasp steps of the beliefs of two objects gives the results
+  // of the single steps with new contexts, including the failures
+  PoseEstimator estimator;
+  estimator.load_config_file(package_directory +
+                             "/launch/estimator_config.yaml");
+  estimator.set_use_linear_approximation(false);
+  estimator.set_number_of_threads(3);
+  std::vector<PreparedObjectPtr> objects;
+  std::vector<std::string> mesh_names = {"/test/CAD/gearmotor.stl",
+                                         "/test/CAD/cones.stl"};
+  for (const auto &mesh_name : mesh_names) {
+    std::vector<Eigen::Vector3d> vertices;
+    std::vector<boost::array<int, 3>> triangles;
+    load_mesh(package_directory + mesh_name, vertices, triangles);
+    objects.push_back(prepare_object(vertices, triangles));
+  }
+  BatchedBeliefs beliefs;
+  std::vector<std::string> file_names = {"/test/grasp_test_gearmotor_Lie_1.txt",
+                                         "/test/grasp_test_cones_Lie_1.txt"};
+  for (int m = 0; m < 2; m++) {
+    std::vector<grasp_case> cases;
+    load_successful_grasp_cases(package_directory + file_names[m], cases);
+    for (const auto &grasp : cases) {
+      BatchedBelief belief;
+      belief.object = m;
+      belief.gripper_transform = grasp.gripper_transform;
+      belief.old_mean = grasp.mean;
+      belief.old_covariance = grasp.covariance;
+      beliefs.push_back(belief);
+      // a wide distribution, which may fail
+      belief.old_covariance = 100.0 * grasp.covariance;
+      beliefs.push_back(belief);
+    }
+  }
+  ASSERT_FALSE(beliefs.empty());
+
+  EstimatorContexts contexts;
+  estimator.grasp_steps_with_Lie_distribution(contexts, objects, beliefs);
+  ASSERT_EQ(contexts.size(), beliefs.size());
+  int number_of_successes = 0, number_of_failures = 0;
+  for (int b = 0; b < beliefs.size(); b++) {
+    const BatchedBelief &belief = beliefs[b];
+    const PreparedObject &object = *objects[belief.object];
+    EstimatorContext context;
+    Eigen::Isometry3d new_mean;
+    CovarianceMatrix new_covariance;
+    std::string error_message;
+    try {
+      estimator.grasp_step_with_Lie_distribution(
+          context, object, belief.gripper_transform, belief.old_mean,
+          belief.old_covariance, new_mean, new_covariance);
+    } catch (std::runtime_error &e) {
+      error_message = e.what();
+    }
+    EXPECT_EQ(belief.success, error_message.empty()) << b;
+    EXPECT_EQ(belief.error_message, error_message) << b;
+    if (belief.success && error_message.empty()) {
+      EXPECT_TRUE(belief.new_mean.matrix() == new_mean.matrix()) << b;
+      EXPECT_TRUE(belief.new_covariance == new_covariance) << b;
+      number_of_successes++;
+    }
+    EXPECT_EQ(contexts[b].random_step, 1);
+    // the diagnostics of each context are those of the single step
+    EXPECT_TRUE(contexts[b].action_status_counts ==
+                context.action_status_counts)
+        << b;
+    if (context.action_status_counts[success_status] <
+        context.particle_set.size()) {
+      number_of_failures++;
+    }
+    EXPECT_EQ(contexts[b].last_update_method, context.last_update_method)
+        << b;
+    EXPECT_TRUE(contexts[b].update_method_counts ==
+                context.update_method_counts)
+        << b;
+  }
+  EXPECT_GT(number_of_successes, 0);
+  EXPECT_GT(number_of_failures, 0);
+}
+
+TEST(PlanarConvexHullTest, AgreesWithCGAL) {
+  // The monotone chain hull, the containment and the intersection agree with
+  // those by CGAL, including the duplicated and collinear points of a grid
+  RandomStream stream(0, 0, 0);
+  auto random_points = [&](const int &t, const int &number_of_points) {
+    std::vector<Eigen::Vector2d> points(number_of_points);
+    for (auto &point : points) {
+      if (t % 2 == 0) {
+        point << stream.uniform_int(5), stream.uniform_int(5);
+      } else {
+        point << 2.0 * stream.uniform() - 1.0, 2.0 * stream.uniform() - 1.0;
+      }
+    }
+    return points;
+  };
+  for (int t = 0; t < 200; t++) {
+    std::vector<Eigen::Vector2d> points = random_points(t, 1 + t % 12),
+                                 other_points = random_points(t, 1 + t % 5);
+    std::vector<Eigen::Vector2d> sorted_points = points, hull, expected_hull;
+    calculate_planar_convex_hull(sorted_points, hull);
+    convex_hull_for_Eigen_Vector2d(points, expected_hull);
+    ASSERT_EQ(hull.size(), expected_hull.size()) << t;
+    // the same cycle, which may start from another vertex
+    int start = std::find(expected_hull.begin(), expected_hull.end(),
+                          hull[0]) -
+                expected_hull.begin();
+    ASSERT_LT(start, expected_hull.size()) << t;
+    for (int i = 0; i < hull.size(); i++) {
+      EXPECT_TRUE(hull[i] == expected_hull[(start + i) % hull.size()]) << t;
+    }
+
+    // CGAL and boost are compared only for the polygons with areas
+    if (hull.size() < 3) {
+      continue;
+    }
+    std::vector<Eigen::Vector2d> queries = random_points(t, 10);
+    queries.insert(queries.end(), points.begin(), points.end());
+    for (const auto &query : queries) {
+      EXPECT_EQ(is_inside_convex_polygon(query, hull),
+                check_inside_convex_hull(query, points))
+          << t;
+    }
+    std::vector<Eigen::Vector2d> sorted_other_points = other_points,
+                                 other_hull;
+    calculate_planar_convex_hull(sorted_other_points, other_hull);
+    if (other_hull.size() >= 3) {
+      EXPECT_EQ(do_intersect_convex_polygons(hull, other_hull),
+                do_intersect_convex_hulls(points, other_points))
+          << t;
+    }
+  }
+
+  // the degenerate polygons
+  std::vector<Eigen::Vector2d> square = {{0.0, 0.0}, {1.0, 0.0}, {1.0, 1.0},
+                                         {0.0, 1.0}},
+                               point = {{1.0, 0.5}}, far_point = {{2.0, 0.5}},
+                               segment = {{0.5, 2.0}, {0.5, 1.0}},
+                               far_segment = {{2.0, 0.0}, {2.0, 1.0}};
+  EXPECT_TRUE(do_intersect_convex_polygons(square, point));
+  EXPECT_FALSE(do_intersect_convex_polygons(square, far_point));
+  EXPECT_TRUE(do_intersect_convex_polygons(segment, square));
+  EXPECT_FALSE(do_intersect_convex_polygons(far_segment, square));
+  EXPECT_FALSE(do_intersect_convex_polygons(segment, far_segment));
+  EXPECT_FALSE(is_inside_convex_polygon(point[0], square));
+  EXPECT_FALSE(is_inside_convex_polygon(point[0], segment));
+}
+
+TEST(ClippingTest, AgreesWithClippedTriangles) {
+  // The vertices clipped by three planes in one pass are the vertices of the
+  // polygons given by clipping each triangle by the planes in turn
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  PreparedObjectPtr object = prepare_object(vertices, triangles);
+  ActionWorkspace workspace;
+  RandomStream stream(0, 0, 0);
+  auto distance_to_nearest = [](const Eigen::Vector3d &point,
+                                const std::vector<Eigen::Vector3d> &points) {
+    double distance = std::numeric_limits<double>::infinity();
+    for (const auto &other_point : points) {
+      distance = std::min(distance, (point - other_point).norm());
+    }
+    return distance;
+  };
+  int number_of_clipped_objects = 0;
+  for (int t = 0; t < 20; t++) {
+    // a slab around the center of gravity and a plane across it
+    Eigen::Vector3d normal = get_UND_Vector3d(stream).normalized(),
+                    slab_normal = get_UND_Vector3d(stream).normalized();
+    double offset = -normal.dot(object->center_of_gravity) +
+                    0.01 * get_UND_Vector3d(stream)(0),
+           slab_offset = -slab_normal.dot(object->center_of_gravity),
+           width = 0.005 + 0.01 * stream.uniform();
+    ClippingPlanes planes = {
+        Eigen::Hyperplane<double, 3>(normal, offset),
+        Eigen::Hyperplane<double, 3>(slab_normal, slab_offset + width),
+        Eigen::Hyperplane<double, 3>(-slab_normal, -slab_offset + width)};
+
+    std::vector<Eigen::Vector3d> clipped_vertices, expected_vertices;
+    clipping_object(object->vertices, object->triangles, object->connectivity,
+                    planes, clipped_vertices, &workspace);
+    for (const auto &triangle : triangles) {
+      std::vector<Eigen::Vector3d> polygon = {
+          vertices[triangle[0]], vertices[triangle[1]], vertices[triangle[2]]};
+      for (const auto &plane : planes) {
+        std::vector<Eigen::Vector3d> clipped_polygon;
+        for (int k = 0; k < polygon.size(); k++) {
+          const Eigen::Vector3d &a = polygon[k],
+                                &b = polygon[(k + 1) % polygon.size()];
+          double distance_a = plane.signedDistance(a),
+                 distance_b = plane.signedDistance(b);
+          if (distance_a >= 0.0) {
+            clipped_polygon.push_back(a);
+          }
+          if (distance_a * distance_b < 0.0) {
+            clipped_polygon.push_back((distance_b * a - distance_a * b) /
+                                      (distance_b - distance_a));
+          }
+        }
+        polygon = clipped_polygon;
+      }
+      expected_vertices.insert(expected_vertices.end(), polygon.begin(),
+                               polygon.end());
+    }
+    ASSERT_EQ(clipped_vertices.empty(), expected_vertices.empty()) << t;
+    if (!clipped_vertices.empty()) {
+      number_of_clipped_objects++;
+    }
+    for (const auto &vertex : clipped_vertices) {
+      EXPECT_LT(distance_to_nearest(vertex, expected_vertices), 1e-12) << t;
+    }
+    for (const auto &vertex : expected_vertices) {
+      EXPECT_LT(distance_to_nearest(vertex, clipped_vertices), 1e-12) << t;
+    }
+  }
+  EXPECT_GT(number_of_clipped_objects, 10);
+}
+
+TEST(PreparedObjectTest, ConnectivityAndConvexHull) {
+  // The connectivity gives the edges of the mesh, clipping the prepared object
+  // by it gives the vertices of cutting the raw mesh, and the convex hull
+  // contains the object
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  PreparedObjectPtr object = prepare_object(vertices, triangles);
+  EXPECT_TRUE(object->center_of_gravity ==
+              calculate_center_of_gravity(vertices, triangles));
+  ASSERT_EQ(object->connectivity.half_edges.size(), 3 * triangles.size());
+
+  // each half-edge refers to the edge of its vertices, and each edge is
+  // shared by two triangles since the mesh is closed
+  std::vector<int> number_of_half_edges(object->connectivity.edges.size(), 0);
+  for (int t = 0; t < triangles.size(); t++) {
+    for (int k = 0; k < 3; k++) {
+      int a = triangles[t][k], b = triangles[t][(k + 1) % 3];
+      int edge = object->connectivity.half_edges[3 * t + k];
+      EXPECT_TRUE(object->connectivity.edges[edge] ==
+                  std::make_pair(std::min(a, b), std::max(a, b)));
+      number_of_half_edges[edge]++;
+    }
+  }
+  for (const int &number : number_of_half_edges) {
+    EXPECT_EQ(number, 2);
+  }
+
+  // clipping by a plane, with the other planes far away, gives the vertices of
+  // the raw mesh cut by the plane
+  ActionWorkspace workspace;
+  RandomStream stream(0, 0, 0);
+  for (int t = 0; t < 20; t++) {
+    Eigen::Vector3d normal = get_UND_Vector3d(stream).normalized();
+    Eigen::Hyperplane<double, 3> plane(
+        normal, -normal.dot(object->center_of_gravity) +
+                    0.01 * get_UND_Vector3d(stream)(0));
+    ClippingPlanes planes = {
+        plane, Eigen::Hyperplane<double, 3>(Eigen::Vector3d::UnitX(), 1e3),
+        Eigen::Hyperplane<double, 3>(-Eigen::Vector3d::UnitX(), 1e3)};
+    std::vector<Eigen::Vector3d> expected_vertices, result_vertices;
+    std::vector<boost::array<int, 3>> expected_triangles;
+    cutting_object(vertices, triangles, plane, expected_vertices,
+                   expected_triangles);
+    clipping_object(object->vertices, object->triangles, object->connectivity,
+                    planes, result_vertices, &workspace);
+    auto less = [](const Eigen::Vector3d &a, const Eigen::Vector3d &b) {
+      return std::lexicographical_compare(a.data(), a.data() + 3, b.data(),
+                                          b.data() + 3);
+    };
+    std::sort(expected_vertices.begin(), expected_vertices.end(), less);
+    std::sort(result_vertices.begin(), result_vertices.end(), less);
+    EXPECT_TRUE(result_vertices == expected_vertices) << t;
+  }
+
+  const ConvexHull &hull = object->convex_hull;
+  ASSERT_FALSE(hull.faces.empty());
+  ASSERT_EQ(hull.adjacency.size(), hull.vertices.size());
+  for (const auto &face : hull.faces) {
+    Eigen::Vector3d normal =
+        (hull.vertices[face[1]] - hull.vertices[face[0]])
+            .cross(hull.vertices[face[2]] - hull.vertices[face[0]]);
+    for (const auto &vertex : vertices) {
+      EXPECT_LE(normal.dot(vertex - hull.vertices[face[0]]), 1e-12);
+    }
+    for (int k = 0; k < 3; k++) {
+      const std::vector<int> &neighbors = hull.adjacency[face[k]];
+      EXPECT_TRUE(std::binary_search(neighbors.begin(), neighbors.end(),
+                                     face[(k + 1) % 3]));
+    }
+  }
+  EXPECT_FALSE(object->place_candidates.empty());
+}
+
+TEST(PreparedObjectTest, HullVerticesGiveTheSameActions) {
+  // The place and grasp calculators give the same poses from the vertices of
+  // the convex hull as from all the vertices
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  RandomStream stream(0, 0, 0);
+  int number_of_successes = 0;
+
+  load_mesh(package_directory + "/test/CAD/cones.stl", vertices, triangles);
+  PreparedObjectPtr object = prepare_object(vertices, triangles);
+  const ConvexHull &hull = object->convex_hull;
+  ASSERT_EQ(hull.vertex_indices.size(), hull.vertices.size());
+  EXPECT_LT(hull.vertices.size(), vertices.size());
+  for (int i = 0; i < hull.vertices.size(); i++) {
+    EXPECT_TRUE(vertices[hull.vertex_indices[i]] == hull.vertices[i]) << i;
+  }
+  std::vector<place_case> place_cases;
+  load_successful_place_cases(
+      package_directory + "/test/place_test_cones_Lie_3.txt", place_cases);
+  for (const auto &place : place_cases) {
+    for (int k = 0; k < 10; k++) {
+      Particle noise = 0.1 * get_UND_particle(stream);
+      Eigen::Isometry3d pose = place.mean * particle_to_eigen_transform(noise);
+      place_calculator expected, result;
+      action_status expected_status = expected.calculate(
+          pose, object->center_of_gravity, vertices, place.support_surface,
+          place.gripper_transform, false, false);
+      action_status status = result.calculate(
+          pose, object->center_of_gravity, hull.vertices,
+          place.support_surface, place.gripper_transform, false, false);
+      ASSERT_EQ(status, expected_status);
+      if (status == success_status) {
+        EXPECT_TRUE(result.new_mean.isApprox(expected.new_mean, 1e-9));
+        number_of_successes++;
+      }
+    }
+  }
+
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  object = prepare_object(vertices, triangles);
+  std::vector<grasp_case> grasp_cases;
+  load_successful_grasp_cases(
+      package_directory + "/test/grasp_test_gearmotor_Lie_1.txt", grasp_cases);
+  for (const auto &grasp : grasp_cases) {
+    for (int k = 0; k < 10; k++) {
+      Particle noise = 0.1 * get_UND_particle(stream);
+      Eigen::Isometry3d pose = grasp.mean * particle_to_eigen_transform(noise);
+      grasp_calculator expected, result, climbed;
+      action_status expected_status = expected.calculate(
+          vertices, vertices, grasp.gripper_transform, pose,
+          object->center_of_gravity, false, false);
+      action_status status = result.calculate(
+          vertices, object->convex_hull.vertices, grasp.gripper_transform,
+          pose, object->center_of_gravity, false, false);
+      // the lowest vertices found by the support queries
+      action_status climbed_status = climbed.calculate(
+          vertices, object->convex_hull.vertices, grasp.gripper_transform,
+          pose, object->center_of_gravity, false, false, nullptr,
+          &object->convex_hull);
+      ASSERT_EQ(status, expected_status);
+      ASSERT_EQ(climbed_status, expected_status);
+      if (status == success_status) {
+        EXPECT_TRUE(result.new_mean.isApprox(expected.new_mean, 1e-9));
+        EXPECT_TRUE(climbed.new_mean.isApprox(expected.new_mean, 1e-9));
+        number_of_successes++;
+      }
+    }
+  }
+  EXPECT_GT(number_of_successes, 0);
+}
+
+TEST(PreparedObjectTest, SupportQueriesFindTheMaxima) {
+  // The climbing from the support map finds the maximum of the inner product
+  // over the hull for any direction
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  load_mesh(package_directory + "/test/CAD/gearmotor.stl", vertices,
+            triangles);
+  PreparedObjectPtr object = prepare_object(vertices, triangles);
+  const ConvexHull &hull = object->convex_hull;
+  RandomStream stream(0, 0, 0);
+  for (int t = 0; t < 1006; t++) {
+    // the axes hit the boundaries of the cells of the support map
+    Eigen::Vector3d direction =
+        (t < 6 ? (t % 2 == 0 ? 1.0 : -1.0) * Eigen::Vector3d::Unit(t / 2)
+               : get_UND_Vector3d(stream));
+    double expected = -std::numeric_limits<double>::infinity();
+    for (const auto &vertex : hull.vertices) {
+      expected = std::max(expected, direction.dot(vertex));
+    }
+    int vertex = find_support_vertex(hull, direction);
+    EXPECT_EQ(direction.dot(hull.vertices[vertex]), expected) << t;
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,158 @@
+/*
+A benchmark to measure the speedup of the particle evaluation against the
+number of threads
+
+usage: scaling_benchmark stl_file config_file grasp_test_file [repetitions]
+
+The cases in 'grasp_test_file' (the same format as test/grasp_test_*_Lie_1.txt)
+are updated by grasp_step_with_Lie_distribution with particles, using 1, 2, 4,
+... threads up to the number of hardware threads. The results of each thread
+count are compared with those of a single thread, which must be identical.
+The same cases are also updated at once by grasp_steps_with_Lie_distribution,
+whose time is printed with the speedup against the calls one by one.
+ */
+
+#include "o2ac_pose_distribution_updater/base/estimator.hpp"
+#include "o2ac_pose_distribution_updater/base/read_stl.hpp"
+#include <chrono>
+#include <cstring>
+
+struct grasp_case {
+  Eigen::Isometry3d gripper_transform, mean;
+  CovarianceMatrix covariance;
+};
+
+void load_grasp_cases(const std::string &file_path,
+                      std::vector<grasp_case> &cases) {
+  FILE *in = fopen(file_path.c_str(), "r");
+  if (in == NULL) {
+    throw std::runtime_error("cannot open " + file_path);
+  }
+  int number_of_cases;
+  fscanf(in, "%d", &number_of_cases);
+  for (int t = 0; t < number_of_cases; t++) {
+    Particle gripper_pose_particle, mean;
+    for (int i = 0; i < 6; i++) {
+      fscanf(in, "%lf", &(gripper_pose_particle(i)));
+    }
+    for (int i = 0; i < 6; i++) {
+      fscanf(in, "%lf", &(mean(i)));
+    }
+    grasp_case new_case;
+    for (int i = 0; i < 6; i++) {
+      for (int j = 0; j < 6; j++) {
+        fscanf(in, "%lf", &(new_case.covariance(i, j)));
+      }
+    }
+    new_case.gripper_transform =
+        particle_to_eigen_transform(gripper_pose_particle);
+    new_case.mean = particle_to_eigen_transform(mean);
+    cases.push_back(new_case);
+
+    // skip the expected result
+    int success;
+    fscanf(in, "%d\n", &success);
+    if (success == 0) {
+      char expected_error_message[999];
+      fgets(expected_error_message, 999, in);
+    } else {
+      double expected_value;
+      for (int i = 0; i < 6 + 36; i++) {
+        fscanf(in, "%lf", &expected_value);
+      }
+    }
+  }
+  fclose(in);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr,
+            "usage: %s stl_file config_file grasp_test_file [repetitions]\n",
+            argv[0]);
+    return 1;
+  }
+  int repetitions = (argc > 4 ? atoi(argv[4]) : 5);
+
+  std::vector<Eigen::Vector3d> vertices;
+  std::vector<boost::array<int, 3>> triangles;
+  read_stl_from_file_path(std::string(argv[1]), vertices, triangles);
+  for (auto &vertex : vertices) {
+    vertex /= 1000.0; // milimeter -> meter
+  }
+
+  std::vector<grasp_case> cases;
+  load_grasp_cases(std::string(argv[3]), cases);
+
+  PoseEstimator estimator;
+  estimator.load_config_file(std::string(argv[2]));
+  estimator.set_use_linear_approximation(false);
+
+  std::vector<int> thread_counts;
+  int max_threads = default_number_of_threads();
+  for (int number_of_threads = 1; number_of_threads < max_threads;
+       number_of_threads *= 2) {
+    thread_counts.push_back(number_of_threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  printf("particles: %d, cases: %d, repetitions: %d\n",
+         estimator.grasp_number_of_particles, (int)cases.size(), repetitions);
+  std::vector<PreparedObjectPtr> objects(1,
+                                         prepare_object(vertices, triangles));
+  BatchedBeliefs beliefs(cases.size());
+  for (int t = 0; t < cases.size(); t++) {
+    beliefs[t].gripper_transform = cases[t].gripper_transform;
+    beliefs[t].old_mean = cases[t].mean;
+    beliefs[t].old_covariance = cases[t].covariance;
+  }
+
+  printf("%8s %14s %10s %10s %14s %14s\n", "threads", "time [ms]", "speedup",
+         "identical", "batch [ms]", "batch speedup");
+  double single_thread_time = 0.0;
+  std::vector<CovarianceMatrix> single_thread_results;
+  for (int number_of_threads : thread_counts) {
+    estimator.set_number_of_threads(number_of_threads);
+    estimator.set_random_seed(0);
+    std::vector<CovarianceMatrix> results;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; r++) {
+      for (auto &grasp : cases) {
+        Eigen::Isometry3d new_mean;
+        CovarianceMatrix new_covariance;
+        try {
+          estimator.grasp_step_with_Lie_distribution(
+              vertices, triangles, grasp.gripper_transform, grasp.mean,
+              grasp.covariance, new_mean, new_covariance);
+        } catch (std::runtime_error &e) {
+          // failed updates are also a part of the workload
+          new_covariance.setZero();
+        }
+        results.push_back(new_covariance);
+      }
+    }
+    double time = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count() /
+                  repetitions;
+    if (number_of_threads == 1) {
+      single_thread_time = time;
+      single_thread_results = results;
+    }
+    bool identical = (results == single_thread_results);
+
+    EstimatorContexts contexts;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repetitions; r++) {
+      estimator.grasp_steps_with_Lie_distribution(contexts, objects, beliefs);
+    }
+    double batch_time = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count() /
+                        repetitions;
+    printf("%8d %14.3lf %10.2lf %10s %14.3lf %14.2lf\n", number_of_threads,
+           time, single_thread_time / time, (identical ? "yes" : "no"),
+           batch_time, time / batch_time);
+  }
+  return 0;
+}